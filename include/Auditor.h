@@ -0,0 +1,46 @@
+// include/Auditor.h
+
+#ifndef AUDITOR_H
+#define AUDITOR_H
+
+#include <string>
+#include <vector>
+
+#include "Database.h"
+
+namespace gradient {
+
+    /// Everything `audit` found wrong with the installed state.
+    struct AuditReport {
+        struct Problem {
+            std::string package;
+            std::string detail;
+        };
+        std::vector<Problem> unsatisfied;   // detail = raw dependency string
+        std::vector<Problem> conflicts;     // detail = installed package it conflicts with
+        std::vector<Problem> missingFiles;  // detail = recorded absolute path
+        std::vector<std::string> staleBroken;   // marked broken for reasons that no longer hold
+
+        [[nodiscard]] bool clean() const {
+            return unsatisfied.empty() && conflicts.empty() && missingFiles.empty()
+                && staleBroken.empty();
+        }
+    };
+
+    /// Checks the whole installed dependency graph at once: every table is
+    /// pulled with a single query and all constraints are evaluated in memory.
+    class Auditor {
+    public:
+        Auditor(const Database& db, std::string rootDir = "/");
+
+        /// @param checkFiles also lstat() every recorded file under rootDir
+        [[nodiscard]] AuditReport run(bool checkFiles = true) const;
+
+    private:
+        const Database& db_;
+        std::string rootDir_;
+    };
+
+} // namespace gradient
+
+#endif //AUDITOR_H
@@ -0,0 +1,57 @@
+// include/Bootstrapper.h
+
+#ifndef BOOTSTRAPPER_H
+#define BOOTSTRAPPER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "DiskThrottle.h"
+#include "Durability.h"
+
+namespace gradient {
+
+    /// Populates a bootstrap root (`gradient -b <root> bootstrap ...`) as one
+    /// unit of work rather than one transaction per package.
+    ///
+    /// Nothing else can observe a root that is still being built, so the
+    /// per-package guarantees of Installer are traded for throughput:
+    /// metadata and payload lists are read from each archive's table of
+    /// contents, payloads are unpacked straight into the root in parallel,
+    /// every record goes into an in-memory copy of gradient.db in a single
+    /// transaction, which is written out in one pass. Hooks and triggers then
+    /// run once against the saved database, and the root's filesystem is
+    /// synced once.
+    ///
+    /// Bootstrap only adds packages: anything already installed at another
+    /// version makes it refuse, and `replaces:` is not acted on. A failure
+    /// partway leaves the root to be rebuilt, not rolled back.
+    class Bootstrapper {
+    public:
+        /// Called from the extraction workers as each payload lands.
+        using ExtractedFn = std::function<void(const std::string& label, size_t done, size_t total)>;
+
+        /// Any `durability` but None ends the run with the single sync;
+        /// per-file flushing buys nothing for a root that is all new files.
+        Bootstrapper(std::string rootDir, std::string dbPath,
+                     unsigned jobs = 0, bool force = false,
+                     Durability::Mode durability = Durability::Mode::Syncfs);
+
+        bool run(const std::vector<std::string>& archives, const ExtractedFn& onExtracted = {});
+        /// Extraction workers wait on `throttle` whenever the disk is
+        /// congested, which adapts their effective concurrency.
+        void setThrottle(DiskThrottle* throttle) { throttle_ = throttle; }
+
+    private:
+        std::string rootDir_;
+        std::string dbPath_;
+        unsigned jobs_;
+        bool force_;
+        Durability::Mode durability_;
+        DiskThrottle* throttle_ = nullptr;
+    };
+
+} // namespace gradient
+
+#endif //BOOTSTRAPPER_H
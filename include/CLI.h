@@ -16,6 +16,15 @@ namespace gradient {
         bool force_ = false;
         std::string bootstrapDir_;
         bool parseOutput_ = false;
+        int lockTimeout_ = 300;
+        unsigned jobs_ = 0;
+        bool layers_ = false;
+        bool store_ = false;
+        std::string durability_ = "syncfs";
+        bool gentle_ = false;
+        bool background_ = false;
+        std::string limitRate_;
+        unsigned segments_ = 4;
         int argc_; char** argv_;
     };
 } // namespace anemo
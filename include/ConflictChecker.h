@@ -0,0 +1,59 @@
+// include/ConflictChecker.h
+
+#ifndef CONFLICTCHECKER_H
+#define CONFLICTCHECKER_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Database.h"
+
+namespace gradient {
+
+    /// An incoming file that is already claimed by someone else.
+    struct FileConflict {
+        std::string path;       // absolute path on the target system
+        std::string incoming;   // package that wants to install it
+        std::string owner;      // installed package, or another package in the same transaction
+        bool inTransaction;     // true if `owner` is part of the same transaction
+    };
+
+    /// Detects file conflicts before any payload is written to the target root.
+    ///
+    /// Every package of a transaction is registered with its payload paths;
+    /// paths are compared against each other in a hash map and against the
+    /// installed ownership index with one batched lookup.
+    class ConflictChecker {
+    public:
+        explicit ConflictChecker(const Database& db);
+
+        /// Register a package by its archive: one Package::inspect() pass
+        /// gives its paths, name and replaces, without extracting anything.
+        bool addArchive(const std::string& archivePath);
+
+        /// Register a package whose payload paths are already known.
+        void addPackage(const std::string& name,
+                        const std::vector<std::string>& paths,
+                        const std::vector<std::string>& replaces = {});
+
+        [[nodiscard]] std::vector<FileConflict> check() const;
+
+        /// Print conflicts in the usual warning format
+        static void report(const std::vector<FileConflict>& conflicts);
+
+    private:
+        const Database& db_;
+        // path -> first package of the transaction that ships it
+        std::unordered_map<std::string, std::string> incoming_;
+        std::vector<FileConflict> internal_;
+        // incoming package -> installed packages it may take files from:
+        // itself (an upgrade) and whatever it replaces
+        std::unordered_map<std::string, std::unordered_set<std::string>> replaces_;
+        std::vector<std::string> order_;
+    };
+
+} // namespace gradient
+
+#endif //CONFLICTCHECKER_H
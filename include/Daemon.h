@@ -0,0 +1,59 @@
+// include/Daemon.h
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Database.h"
+#include "RepoIndex.h"
+
+namespace gradient {
+
+    /// gradientd: keeps the installed-package snapshot and the parsed repo
+    /// indexes in memory and answers read-only commands over a Unix socket.
+    ///
+    /// Wire format (all integers are host-order uint32):
+    ///   request : count, then count x (len, bytes) = parse flag ("0"/"1"), cmd, args...
+    ///   response: len, stdout bytes, len, stderr bytes
+    class Daemon {
+    public:
+        static constexpr const char* kDefaultSocket = "/run/gradientd.sock";
+
+        Daemon(std::string rootPrefix, std::string socketPath);
+        ~Daemon();
+
+        /// Accept and answer requests until killed. Returns non-zero on setup failure.
+        int serve();
+
+        /// Commands gradientd can answer (none of them change state).
+        static bool isReadCommand(const std::string& cmd);
+
+        /// Client side: run `cmd` through the daemon and print its output.
+        /// Returns false if no daemon answered; the caller then runs in-process.
+        static bool forward(const std::string& socketPath,
+                            const std::string& cmd,
+                            const std::vector<std::string>& args,
+                            bool parse);
+
+    private:
+        void refresh();
+        std::string handle(const std::vector<std::string>& request, std::string& err);
+
+        std::string rootPrefix_;
+        std::string socketPath_;
+        int listenFd_ = -1;
+
+        std::unique_ptr<Database> db_;
+        int dataVersion_ = -1;
+        std::vector<PackageInfo> installed_;
+        std::unordered_map<std::string, size_t> byName_;
+        RepoIndex repos_;
+    };
+
+} // namespace gradient
+
+#endif //DAEMON_H
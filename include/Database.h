@@ -3,6 +3,7 @@
 
 #include "Package.h"
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <sqlite3.h>
 
@@ -20,18 +21,55 @@ namespace gradient {
     };
 
 
+    /// One dependencies/provides/conflicts row, already split at insert time.
+    struct ConstraintRow {
+        std::string package;
+        std::string raw;
+        Tools::Constraint constraint;
+    };
+
+    /// A trigger registered by an installed package.
+    struct TriggerRow {
+        std::string package;
+        Package::Trigger trigger;
+    };
+
+    /// Why a package is marked broken: bits of broken_packages.reasons.
+    /// audit clears a mark once the package checks out again, but only when
+    /// it can re-check every reason the mark carries.
+    namespace Broken {
+        constexpr unsigned Unknown   = 1u << 0;   // marked before reasons were kept
+        constexpr unsigned Deps      = 1u << 1;   // a dependency is unsatisfied
+        constexpr unsigned Conflicts = 1u << 2;   // conflicts with an installed package
+        constexpr unsigned Files     = 1u << 3;   // another package wrote over its files
+        constexpr unsigned Rechecked = Deps | Conflicts;
+    }
+
     class Database {
     public:
         Database(std::string  path);
         ~Database();
 
-        bool open();
+        /// Read-only connections never write, so they cannot migrate either;
+        /// check schemaCurrent() before relying on one.
+        bool open(bool readOnly = false);
+        /// Migrate and run the DDL; a no-op when user_version is current.
         bool initSchema() const;
+        bool migrate() const;
+        [[nodiscard]] bool schemaCurrent() const;
+
+        /// Replace this database's contents with the database file at `path`
+        /// (online backup API); used to work on an in-memory copy.
+        bool loadFrom(const std::string& path) const;
+        /// Write this database's contents over the file at `path` in one pass.
+        bool saveTo(const std::string& path) const;
 
         // Install
         bool addPackage(const Package::Metadata& meta,
                         const std::string& installScriptPath) const;
         bool addProvides(const Package::Metadata& meta) const;
+        bool addConflicts(const Package::Metadata& meta) const;
+        bool addTriggers(const Package::Metadata& meta) const;
         bool isProvided(const std::string& name) const;
 
         // Removal support
@@ -40,7 +78,8 @@ namespace gradient {
         std::string getInstallScript(const std::string& packageName) const;
         bool removeFiles(const std::string& packageName) const;
         bool deletePackage(const std::string& packageName) const;
-        bool markBroken(const std::string& packageName) const;
+        /// Add `reasons` (Broken:: bits) to the package's broken mark.
+        bool markBroken(const std::string& packageName, unsigned reasons) const;
 
         // Existing APIs
         bool isInstalled(const std::string& name, const std::string& version) const;
@@ -52,20 +91,55 @@ namespace gradient {
 
         bool rollbackTransaction() const;
 
+        /// Changes whenever another connection commits (PRAGMA data_version)
+        [[nodiscard]] int dataVersion() const;
+
         // ** New for audit **
         /// List all packages currently marked broken
         [[nodiscard]] std::vector<std::string> getBrokenPackages() const;
+        /// The same, with the Broken:: reasons of each mark
+        [[nodiscard]] std::vector<std::pair<std::string, unsigned>> getBrokenReasons() const;
         /// Fetch the runtime dependencies (the deps: list) of a given package
         [[nodiscard]] std::vector<std::string> getDependencies(const std::string& packageName) const;
         /// Remove a package from the broken_packages table
         bool removeBroken(const std::string& packageName) const;
         [[nodiscard]] std::vector<PackageInfo> listPackages() const;
+        /// Point lookup of one installed package; false if not installed
+        bool getPackage(const std::string& name, PackageInfo& out) const;
+        [[nodiscard]] size_t countPackages() const;
 
         bool providesSatisfies(const Tools::Constraint &c) const;
 
+        // ** Bulk loaders for the audit engine **
+        [[nodiscard]] std::vector<ConstraintRow> getAllDependencies() const;
+        /// Every registered trigger, ordered by package name
+        [[nodiscard]] std::vector<TriggerRow> getAllTriggers() const;
+        [[nodiscard]] std::vector<ConstraintRow> getAllProvides() const;
+        [[nodiscard]] std::vector<ConstraintRow> getAllConflicts() const;
+        /// (package, absolute path) for every recorded file
+        [[nodiscard]] std::vector<std::pair<std::string, std::string>> getAllFiles() const;
+
+        // ** File ownership (absolute, normalized paths) **
+        /// Packages that recorded `path`; usually zero or one
+        [[nodiscard]] std::vector<std::string> getOwners(const std::string& path) const;
+        /// (path, package) for every owned path in `paths`, in input order
+        [[nodiscard]] std::vector<std::pair<std::string, std::string>>
+        getOwners(const std::vector<std::string>& paths) const;
+
     private:
+        bool replaceConstraints(const char* table, const char* rawColumn,
+                                const std::string& packageName,
+                                const std::vector<std::string>& raws) const;
+        std::vector<ConstraintRow> selectConstraints(const char* table, const char* rawColumn) const;
+        int schemaVersion() const;
+        static bool copy(sqlite3* from, sqlite3* to);
+
         sqlite3* db_;
         std::string path_;
+        /// dirs.path -> dirs.id, filled by logFile()
+        mutable std::unordered_map<std::string, sqlite3_int64> dirCache_;
+        /// logFile()'s INSERT, prepared on first use
+        mutable sqlite3_stmt* logFileStmt_ = nullptr;
     };
 
 } // namespace anemo
@@ -0,0 +1,57 @@
+// include/DeltaHandler.h
+
+#ifndef DELTAHANDLER_H
+#define DELTAHANDLER_H
+
+#include <string>
+#include <vector>
+
+#include "Database.h"
+
+namespace gradient {
+
+    /// A binary delta published by a repository for one package, valid only
+    /// against the installed version `from`.
+    struct DeltaInfo {
+        std::string from;
+        std::string filename;
+        std::string sha256;     // of the .adelta itself; empty if not published
+    };
+
+    /// Rebuilds full .apkg archives from .adelta archives.
+    ///
+    /// An .adelta is a tar holding the new anemonix.yaml (and install.anemonix),
+    /// a `package/` tree with every new or rewritten file, a `patches/` tree of
+    /// per-file `zstd --patch-from` blocks made against the old file at the same
+    /// path, and a `delta.yaml` naming the base version plus the list of files
+    /// (`keep:`) that are unchanged and are copied from the installed root.
+    /// `delta.yaml` also publishes the SHA-256 of every regular file of the
+    /// new payload (`sha256:`, path to hex) and the target of every symlink
+    /// (`links:`), which the rebuilt tree must match exactly. The repacked
+    /// archive is not byte-identical to the published one, so it is these,
+    /// not the archive checksum, that vouch for it.
+    class DeltaHandler {
+    public:
+        /// Snapshot of the installed base a delta will be applied against.
+        /// Taken up front so reconstruction does not touch the database.
+        struct Base {
+            std::string name;
+            std::string version;
+            std::vector<std::string> files;
+        };
+
+        static bool snapshotBase(const Database& db, const std::string& name, Base& out);
+
+        /// Reconstruct `outArchive` from `deltaPath` and the files of `base`
+        /// found under `rootDir`. Fails (leaving the caller to fall back to the
+        /// full archive) if the base is not installed exactly as recorded or
+        /// any rebuilt file differs from its published hash.
+        static bool reconstruct(const std::string& deltaPath,
+                                const Base& base,
+                                const std::string& rootDir,
+                                const std::string& outArchive);
+    };
+
+} // namespace gradient
+
+#endif //DELTAHANDLER_H
@@ -0,0 +1,47 @@
+// include/DiskThrottle.h
+
+#ifndef DISKTHROTTLE_H
+#define DISKTHROTTLE_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace gradient {
+
+    /// Watches the disk under a path through /proc/diskstats and holds
+    /// writers back while its request latency climbs above what it has
+    /// been, so background work yields the disk to everything else.
+    ///
+    /// pace() is cheap enough to call per file: it samples at most every
+    /// 100 ms. When the disk is congested, the caller holds the lock while it
+    /// waits, so every other worker stalls behind it as well. Concurrency
+    /// then drops to zero until latency recovers.
+    class DiskThrottle {
+    public:
+        explicit DiskThrottle(const std::string& path);
+
+        /// Whether a device was found; pace() does nothing otherwise.
+        [[nodiscard]] bool active() const { return !device_.empty(); }
+        void pace();
+
+    private:
+        struct Sample {
+            std::uint64_t ios = 0;   // reads + writes completed
+            std::uint64_t ms = 0;    // time spent on them
+        };
+        bool sample(Sample& out) const;
+        /// Mean ms per request since the last sample, or < 0 if idle.
+        double latency();
+
+        std::string device_;
+        std::mutex mtx_;
+        Sample last_;
+        std::chrono::steady_clock::time_point lastAt_{};
+        double baseline_ = -1;   // moving average of uncongested latency
+    };
+
+} // namespace gradient
+
+#endif //DISKTHROTTLE_H
@@ -7,34 +7,99 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <string>
 #include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <curl/curl.h>
 
 namespace gradient {
 
+/// One byte budget shared by any number of transfers. Every write waits
+/// for its share, so however many downloads are still running split the
+/// whole rate between them, and one that finishes leaves its share to
+/// the rest.
+class RateLimiter {
+public:
+    explicit RateLimiter(std::uint64_t bytesPerSecond) : rate_(double(bytesPerSecond)) {}
+
+    /// Wait until `bytes` more fit under the rate.
+    void take(size_t bytes) {
+        using namespace std::chrono;
+        steady_clock::duration wait{};
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            const auto now = steady_clock::now();
+            // An idle moment earns at most kBurst worth of bytes
+            if (next_ < now - kBurst) next_ = now - kBurst;
+            next_ += duration_cast<steady_clock::duration>(duration<double>(double(bytes) / rate_));
+            wait = next_ - now;
+        }
+        if (wait > steady_clock::duration::zero()) std::this_thread::sleep_for(wait);
+    }
+
+private:
+    static constexpr std::chrono::milliseconds kBurst{250};
+    std::mutex mtx_;
+    double rate_;
+    std::chrono::steady_clock::time_point next_{};
+};
+
 /// Context for a single download’s progress.
 struct DownloadContext {
     int index;
     int total;
     std::string name;
     std::mutex* printMutex;
+    /// Draw the progress bar on stdout.
+    bool show = true;
+    /// Called with (received, expected) bytes on every curl progress tick.
+    std::function<void(curl_off_t, curl_off_t)> onProgress{};
+    /// Budget this download draws from, shared with others (null = no cap).
+    RateLimiter* limiter = nullptr;
+    /// Tries per download. Transient failures wait 1s, 2s, 4s ... (at most
+    /// 30s) before the next one, which picks up where the last stopped.
+    int attempts = 5;
+    /// Bytes already on disk when the current attempt started.
+    curl_off_t resumed = 0;
+    /// Connections for one file in downloadSegmented(), for files of at
+    /// least `segmentMin` bytes.
+    int segments = 1;
+    curl_off_t segmentMin = curl_off_t(32) << 20;
+    /// Size the repo index gives for the file (0 = unknown); below
+    /// `segmentMin` the server is not even asked about ranges.
+    curl_off_t expected = 0;
+};
+
+/// Where downloadWithCurl() writes.
+struct DownloadSink {
+    FILE* file;
+    RateLimiter* limiter;
 };
 
 /// libcurl write callback (just dump into file)
 static size_t writeFile(void* ptr, size_t size, size_t nmemb, void* stream) {
-    FILE* f = static_cast<FILE*>(stream);
-    return fwrite(ptr, size, nmemb, f);
+    auto sink = static_cast<DownloadSink*>(stream);
+    if (sink->limiter) sink->limiter->take(size * nmemb);
+    return fwrite(ptr, size, nmemb, sink->file);
 }
 
-/// libcurl xferinfo callback to update progress
-static int progressCallback(void* clientp,
-                            curl_off_t dltotal,
-                            curl_off_t dlnow,
-                            curl_off_t ultotal,
-                            curl_off_t ulnow)
-{
-    auto ctx = static_cast<DownloadContext*>(clientp);
+/// Report `dlnow` of `dltotal` bytes and redraw the progress bar.
+static void drawProgress(DownloadContext* ctx, curl_off_t dlnow, curl_off_t dltotal) {
+    if (ctx->onProgress) ctx->onProgress(dlnow, dltotal);
+    if (!ctx->show) return;
     std::lock_guard<std::mutex> lk(*ctx->printMutex);
 
     int barWidth = 40;
@@ -49,58 +114,354 @@ static int progressCallback(void* clientp,
     }
     printf("] %3d%%", percent);
     fflush(stdout);
+}
 
+/// libcurl xferinfo callback to update progress
+static int progressCallback(void* clientp,
+                            curl_off_t dltotal,
+                            curl_off_t dlnow,
+                            curl_off_t ultotal,
+                            curl_off_t ulnow)
+{
+    auto ctx = static_cast<DownloadContext*>(clientp);
+    // Count what earlier attempts left on disk
+    if (dltotal > 0) dltotal += ctx->resumed;
+    drawProgress(ctx, dlnow + ctx->resumed, dltotal);
     return 0; // return non-zero to abort
 }
 
+static void reportRetry(const DownloadContext& ctx, CURLcode res, std::chrono::seconds backoff) {
+    if (!ctx.show) return;
+    std::lock_guard<std::mutex> lk(*ctx.printMutex);
+    printf("\r  ↻ [%d/%d] %-20s %s; retrying in %llds\n",
+           ctx.index, ctx.total, ctx.name.c_str(),
+           curl_easy_strerror(res), static_cast<long long>(backoff.count()));
+    fflush(stdout);
+}
+
+/// Finish the progress line with the outcome.
+static void finishProgress(const DownloadContext& ctx, CURLcode res) {
+    if (!ctx.show) return;
+    std::lock_guard<std::mutex> lk(*ctx.printMutex);
+    if (res == CURLE_OK) {
+        printf("\r  ✔ [%d/%d] %-20s [", ctx.index, ctx.total, ctx.name.c_str());
+        for (int i = 0; i < 40; ++i) fputc('=', stdout);
+        printf("] 100%%\n");
+    } else {
+        printf("\r  ✖ [%d/%d] %-20s download failed: %s\n",
+               ctx.index, ctx.total,
+               ctx.name.c_str(),
+               curl_easy_strerror(res));
+    }
+    fflush(stdout);
+}
+
+/// Whether another attempt may succeed where this one failed: network
+/// trouble and server-side errors, not a missing file.
+static bool transientFailure(CURLcode res, long httpCode) {
+    switch (res) {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_RECV_ERROR:
+        case CURLE_SEND_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+        case CURLE_RANGE_ERROR:
+            return true;
+        case CURLE_HTTP_RETURNED_ERROR:
+            return httpCode == 408 || httpCode == 416 || httpCode == 429 || httpCode >= 500;
+        default:
+            return false;
+    }
+}
+
 /// Download a single URL to the given filesystem path, showing progress.
+/// Whatever `outPath` already holds is taken as the start of the data
+/// and only the rest is requested (HTTP Range); on failure whatever was
+/// received is kept, so a later call resumes it too.
 ///
 /// @returns true on success, false on error.
 static bool downloadWithCurl(const std::string& url,
                              const std::string& outPath,
                              DownloadContext& ctx)
 {
-    FILE* f = fopen(outPath.c_str(), "wb");
-    if (!f) return false;
-
     CURL* curl = curl_easy_init();
-    if (!curl) { fclose(f); return false; }
+    if (!curl) return false;
 
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFile);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, f);
+    CURLcode res = CURLE_OK;
+    std::chrono::seconds backoff(1);
+    for (int attempt = 1; ; ++attempt) {
+        FILE* f = fopen(outPath.c_str(), "ab");
+        if (!f) { curl_easy_cleanup(curl); return false; }
+        ctx.resumed = ftello(f);
+        DownloadSink sink{f, ctx.limiter};
+
+        curl_easy_reset(curl);
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFile);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &sink);
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, ctx.resumed);
 
-    // enable progress callback
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progressCallback);
-    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &ctx);
+        // enable progress callback
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progressCallback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &ctx);
 
-    // timeouts & retries
+        // timeouts
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 10L);
+
+        res = curl_easy_perform(curl);
+        long httpCode = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
+        if (fclose(f) != 0 && res == CURLE_OK) res = CURLE_WRITE_ERROR;
+        if (res == CURLE_OK || attempt >= ctx.attempts || !transientFailure(res, httpCode))
+            break;
+
+        // The server cannot resume (no Range support), or the range starts
+        // past the end and what is on disk is not a prefix of this file:
+        // fetch it whole
+        if (res == CURLE_RANGE_ERROR || httpCode == 416) truncate(outPath.c_str(), 0);
+        reportRetry(ctx, res, backoff);
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(backoff * 2, std::chrono::seconds(30));
+    }
+
+    finishProgress(ctx, res);
+    curl_easy_cleanup(curl);
+    // Only data is worth keeping for a later resume
+    if (res != CURLE_OK) {
+        FILE* f = fopen(outPath.c_str(), "rb");
+        const bool empty = f && fseeko(f, 0, SEEK_END) == 0 && ftello(f) == 0;
+        if (f) fclose(f);
+        if (empty) unlink(outPath.c_str());
+    }
+    return res == CURLE_OK;
+}
+
+/// One byte range of a segmented download, written in place with pwrite.
+struct DownloadSegment {
+    std::string url;
+    int fd;
+    curl_off_t next;                     // where the next byte received goes
+    curl_off_t end;                      // one past the last byte of the range
+    DownloadContext* ctx;
+    std::atomic<curl_off_t>* received;   // across all segments
+    curl_off_t size;                     // of the whole file
+    CURL* curl = nullptr;
+    bool noRanges = false;               // the server sent something else than 206
+};
+
+static size_t writeSegment(void* ptr, size_t size, size_t nmemb, void* userp) {
+    auto seg = static_cast<DownloadSegment*>(userp);
+    const size_t len = size * nmemb;
+    long code = 0;
+    curl_easy_getinfo(seg->curl, CURLINFO_RESPONSE_CODE, &code);
+    if (code != 206) {
+        seg->noRanges = true;
+        return 0;
+    }
+    if (static_cast<curl_off_t>(len) > seg->end - seg->next) return 0;
+    if (seg->ctx->limiter) seg->ctx->limiter->take(len);
+    for (size_t done = 0; done < len; ) {
+        ssize_t n = pwrite(seg->fd, static_cast<char*>(ptr) + done, len - done, seg->next + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        done += n;
+    }
+    seg->next += len;
+    *seg->received += len;
+    return len;
+}
+
+static int segmentProgress(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    auto seg = static_cast<DownloadSegment*>(clientp);
+    drawProgress(seg->ctx, seg->received->load(), seg->size);
+    return 0;
+}
+
+/// Fetch one segment, retrying like downloadWithCurl from wherever the
+/// previous attempt stopped.
+static CURLcode fetchSegment(DownloadSegment& seg) {
+    seg.curl = curl_easy_init();
+    if (!seg.curl) return CURLE_FAILED_INIT;
+    CURLcode res = CURLE_OK;
+    std::chrono::seconds backoff(1);
+    for (int attempt = 1; ; ++attempt) {
+        const std::string range = std::to_string(seg.next) + "-" + std::to_string(seg.end - 1);
+        curl_easy_reset(seg.curl);
+        curl_easy_setopt(seg.curl, CURLOPT_URL, seg.url.c_str());
+        curl_easy_setopt(seg.curl, CURLOPT_RANGE, range.c_str());
+        curl_easy_setopt(seg.curl, CURLOPT_WRITEFUNCTION, writeSegment);
+        curl_easy_setopt(seg.curl, CURLOPT_WRITEDATA, &seg);
+        curl_easy_setopt(seg.curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(seg.curl, CURLOPT_XFERINFOFUNCTION, segmentProgress);
+        curl_easy_setopt(seg.curl, CURLOPT_XFERINFODATA, &seg);
+        curl_easy_setopt(seg.curl, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(seg.curl, CURLOPT_CONNECTTIMEOUT, 10L);
+        curl_easy_setopt(seg.curl, CURLOPT_LOW_SPEED_TIME, 30L);
+        curl_easy_setopt(seg.curl, CURLOPT_LOW_SPEED_LIMIT, 10L);
+
+        res = curl_easy_perform(seg.curl);
+        if (res == CURLE_OK && seg.next != seg.end) res = CURLE_PARTIAL_FILE;
+        long httpCode = 0;
+        curl_easy_getinfo(seg.curl, CURLINFO_RESPONSE_CODE, &httpCode);
+        if (res == CURLE_OK || seg.noRanges || attempt >= seg.ctx->attempts
+            || !transientFailure(res, httpCode))
+        {
+            break;
+        }
+        reportRetry(*seg.ctx, res, backoff);
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(backoff * 2, std::chrono::seconds(30));
+    }
+    curl_easy_cleanup(seg.curl);
+    return res;
+}
+
+static size_t acceptRangesHeader(char* buffer, size_t size, size_t nitems, void* userdata) {
+    const size_t len = size * nitems;
+    std::string line(buffer, len);
+    std::transform(line.begin(), line.end(), line.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (line.starts_with("accept-ranges:") && line.find("bytes") != std::string::npos)
+        *static_cast<bool*>(userdata) = true;
+    return len;
+}
+
+/// HEAD `url` for its size, if the server also takes byte ranges.
+static bool probeRanges(const std::string& url, curl_off_t& size) {
+    CURL* curl = curl_easy_init();
+    if (!curl) return false;
+    bool ranges = false;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
     curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
     curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 10L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, acceptRangesHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &ranges);
+    const bool ok = curl_easy_perform(curl) == CURLE_OK
+                 && curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size) == CURLE_OK;
+    curl_easy_cleanup(curl);
+    return ok && ranges && size > 0;
+}
 
-    CURLcode res = curl_easy_perform(curl);
+/// Ranges still missing from a segmented download's scratch file, as
+/// "<next> <end>" lines after the file size, so a later call resumes them.
+static bool loadSegmentState(const std::string& path, curl_off_t size,
+                             std::vector<std::pair<curl_off_t, curl_off_t>>& ranges)
+{
+    std::ifstream in(path);
+    long long total = 0, next = 0, end = 0;
+    if (!(in >> total) || total != size) return false;
+    ranges.clear();
+    while (in >> next >> end) {
+        if (next < 0 || next > end || end > size) return false;
+        if (next < end) ranges.emplace_back(next, end);
+    }
+    return in.eof();
+}
 
-    // finish the line
+static bool saveSegmentState(const std::string& path, curl_off_t size,
+                             const std::vector<DownloadSegment>& segs)
+{
+    std::ofstream out(path, std::ios::trunc);
+    out << size << "\n";
+    for (auto& seg : segs) out << seg.next << " " << seg.end << "\n";
+    return bool(out.flush());
+}
+
+/// Download `url` to `outPath` over `ctx.segments` connections at once when
+/// it is at least `ctx.segmentMin` bytes and the server takes byte ranges;
+/// a single stream is capped by per-connection throughput long before a
+/// fast link is. Each connection fills its own range of a preallocated
+/// scratch file (`outPath`.seg), which becomes `outPath` once every range
+/// is complete. On failure the scratch file stays, with the ranges still
+/// missing in `outPath`.seg.ranges, and a later call fetches only those.
+/// Anything else, including a partial `outPath` to resume, goes through
+/// downloadWithCurl(), as does a server that turns out not to honour ranges.
+///
+/// @returns true on success, false on error.
+static bool downloadSegmented(const std::string& url,
+                              const std::string& outPath,
+                              DownloadContext& ctx)
+{
+    struct stat st{};
+    curl_off_t size = 0;
+    if (ctx.segments < 2 || !(url.starts_with("http://") || url.starts_with("https://"))
+        || (ctx.expected > 0 && ctx.expected < ctx.segmentMin)
+        || (::stat(outPath.c_str(), &st) == 0 && st.st_size > 0)
+        || !probeRanges(url, size) || size < ctx.segmentMin)
     {
-        std::lock_guard<std::mutex> lk(*ctx.printMutex);
-        if (res == CURLE_OK) {
-            printf("\r  ✔ [%d/%d] %-20s [", ctx.index, ctx.total, ctx.name.c_str());
-            for (int i = 0; i < 40; ++i) fputc('=', stdout);
-            printf("] 100%%\n");
-        } else {
-            printf("\r  ✖ [%d/%d] %-20s download failed: %s\n",
-                   ctx.index, ctx.total,
-                   ctx.name.c_str(),
-                   curl_easy_strerror(res));
+        return downloadWithCurl(url, outPath, ctx);
+    }
+
+    const std::string scratch = outPath + ".seg";
+    const std::string state = scratch + ".ranges";
+    auto discard = [&] {
+        ::unlink(scratch.c_str());
+        ::unlink(state.c_str());
+    };
+
+    // Pick up the ranges an earlier call left missing, if the file is the
+    // same size; otherwise start over
+    std::vector<std::pair<curl_off_t, curl_off_t>> ranges;
+    int fd = -1;
+    if (::stat(scratch.c_str(), &st) == 0 && st.st_size == size && loadSegmentState(state, size, ranges))
+        fd = ::open(scratch.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ranges.clear();
+        const curl_off_t step = (size + ctx.segments - 1) / ctx.segments;
+        for (curl_off_t off = 0; off < size; off += step)
+            ranges.emplace_back(off, std::min(off + step, size));
+        fd = ::open(scratch.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return downloadWithCurl(url, outPath, ctx);
+        // Ranges arrive interleaved; reserving the space up front keeps the
+        // file contiguous and turns ENOSPC into an early failure
+        if (int err = ::posix_fallocate(fd, 0, size); err != 0 && (err != EOPNOTSUPP || ::ftruncate(fd, size) != 0)) {
+            ::close(fd);
+            discard();
+            return downloadWithCurl(url, outPath, ctx);
         }
-        fflush(stdout);
     }
 
-    curl_easy_cleanup(curl);
-    fclose(f);
+    curl_off_t missing = 0;
+    for (auto& [next, end] : ranges) missing += end - next;
+    std::atomic<curl_off_t> received{size - missing};
+    std::vector<DownloadSegment> segs;
+    for (auto& [next, end] : ranges)
+        segs.push_back({url, fd, next, end, &ctx, &received, size});
+
+    std::vector<std::future<CURLcode>> results;
+    for (auto& seg : segs)
+        results.push_back(std::async(std::launch::async, [&seg] { return fetchSegment(seg); }));
+    CURLcode res = CURLE_OK;
+    for (auto& r : results) {
+        if (CURLcode c = r.get(); c != CURLE_OK && res == CURLE_OK) res = c;
+    }
+    const bool flushed = ::close(fd) == 0;
+    if (!flushed && res == CURLE_OK) res = CURLE_WRITE_ERROR;
+
+    if (std::ranges::any_of(segs, [](auto& s) { return s.noRanges; })) {
+        discard();
+        ctx.segments = 1;
+        return downloadWithCurl(url, outPath, ctx);
+    }
+    if (res == CURLE_OK) {
+        if (::rename(scratch.c_str(), outPath.c_str()) != 0) res = CURLE_WRITE_ERROR;
+        ::unlink(state.c_str());
+    } else if (!flushed || !saveSegmentState(state, size, segs)) {
+        // What was written cannot be trusted, or not found again
+        discard();
+    }
+    finishProgress(ctx, res);
     return res == CURLE_OK;
 }
 
@@ -0,0 +1,35 @@
+// include/Durability.h
+
+#ifndef DURABILITY_H
+#define DURABILITY_H
+
+#include <string>
+#include <vector>
+
+namespace gradient {
+
+    /// How installed files are made to survive a crash before the database
+    /// commit that claims them.
+    class Durability {
+    public:
+        enum class Mode {
+            None,     // leave it to the kernel's writeback
+            Syncfs,   // one syncfs() of the root per transaction
+            File      // write-behind on every file, then fdatasync each
+        };
+
+        /// "none", "syncfs" or "file".
+        static bool parse(const std::string& name, Mode& out);
+
+        /// Flush `files` (absolute paths) and the directories holding them,
+        /// per `mode`. Call before committing the transaction that records
+        /// them; false means nothing should be committed.
+        static bool barrier(Mode mode, const std::string& rootDir,
+                            const std::vector<std::string>& files);
+
+        static bool syncFilesystem(const std::string& path);
+    };
+
+} // namespace gradient
+
+#endif //DURABILITY_H
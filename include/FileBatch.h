@@ -0,0 +1,88 @@
+// include/FileBatch.h
+
+#ifndef FILEBATCH_H
+#define FILEBATCH_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace gradient {
+
+    class IoRing;
+
+    /// Writes many small files out of one source (an archive) with few
+    /// syscalls. Each file becomes a linked io_uring chain - read from the
+    /// source, open a scratch name as a direct descriptor, write, close -
+    /// run up to `depth` files at a time; ownership, mode and mtime are then
+    /// set on the scratch name and it is renamed into place, so a file never
+    /// shows under its own name half done. Parent directories are opened
+    /// once and addressed by fd.
+    ///
+    /// Files whose chain fails (and all of them when io_uring is missing)
+    /// go to `fallback`, which writes them with plain syscalls.
+    class FileBatch {
+    public:
+        struct File {
+            std::string dest;
+            std::uint64_t offset = 0;   // of the data in the source
+            std::uint64_t size = 0;
+            std::uint32_t mode = 0644;
+            std::int64_t mtime = 0;
+            bool own = false;           // give the file to uid:gid (root only)
+            std::uint32_t uid = 0, gid = 0;
+        };
+        using Fallback = std::function<bool(const File&)>;
+
+        /// Largest file worth batching: its data is staged in memory.
+        static constexpr std::uint64_t kMaxSize = 64 * 1024;
+
+        FileBatch(int source, Fallback fallback, unsigned depth = 64);
+        ~FileBatch();
+        FileBatch(const FileBatch&) = delete;
+        FileBatch& operator=(const FileBatch&) = delete;
+
+        /// Whether files are really batched; false means add() just calls
+        /// the fallback.
+        [[nodiscard]] bool usable() const;
+        /// Queue `file`, running the queue first if it is full. False when a
+        /// file could not be written even by the fallback.
+        bool add(File file);
+        /// Whether `dest` is queued and not yet written.
+        [[nodiscard]] bool pending(const std::string& dest) const;
+        /// Write everything queued.
+        bool flush();
+
+    private:
+        struct Dir {
+            int fd = -1;
+            std::uint32_t gid = 0;    // what new files inherit under setgid
+            bool setgid = false;
+        };
+        const Dir* dir(const std::string& path);
+
+        struct Slot {
+            File file;
+            const Dir* dir = nullptr;
+            std::string name, tmp;
+            std::vector<char> data;
+            int error = 0;
+        };
+
+        int source_;
+        Fallback fallback_;
+        unsigned depth_;
+        std::unique_ptr<IoRing> ring_;
+        bool usable_ = false;
+        std::vector<Slot> slots_;
+        std::unordered_set<std::string> pending_;
+        std::unordered_map<std::string, Dir> dirs_;
+    };
+
+} // namespace gradient
+
+#endif //FILEBATCH_H
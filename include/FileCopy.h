@@ -0,0 +1,31 @@
+// include/FileCopy.h
+
+#ifndef FILECOPY_H
+#define FILECOPY_H
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+namespace gradient {
+
+    /// Moves file data with the cheapest mechanism the filesystem offers:
+    /// a reflink (FICLONE / FICLONERANGE) shares extents without copying,
+    /// copy_file_range() copies inside the kernel (or server-side), and a
+    /// pread/write loop works everywhere else.
+    class FileCopy {
+    public:
+        enum class Method { Clone, CopyRange, ReadWrite };
+
+        /// Copy `len` bytes at `offset` in `in` to the current position of
+        /// `out`. Ranges are cloned only when block-aligned, as the kernel
+        /// requires; tar members, for one, usually are not.
+        static bool range(int in, off_t offset, int out, std::uint64_t len, Method* how = nullptr);
+
+        /// Copy all of `in` to the empty file `out`.
+        static bool whole(int in, int out, Method* how = nullptr);
+    };
+
+} // namespace gradient
+
+#endif //FILECOPY_H
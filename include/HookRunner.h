@@ -0,0 +1,65 @@
+// include/HookRunner.h
+
+#ifndef HOOKRUNNER_H
+#define HOOKRUNNER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "HookWorker.h"
+
+namespace gradient {
+
+    /// One deferred package hook.
+    struct HookJob {
+        std::string package;
+        std::vector<std::string> provides;   // bare names
+        std::vector<std::string> deps;       // bare names
+        std::string script;                  // absolute path on the host
+        std::string hook;                    // post_install, post_upgrade, post_remove
+        bool discardScript = false;          // delete `script` afterwards (removals)
+    };
+
+    /// Runs the hooks of a transaction after its packages are in place.
+    ///
+    /// Hooks are ordered into waves by the dependencies between the packages
+    /// of the batch: a package's install hook runs only after the hooks of
+    /// everything it depends on, and its post_remove hook before theirs (all
+    /// removals go first). Hooks within a wave share no dependency and run
+    /// concurrently, up to `jobs` at a time. Each hook's output is collected
+    /// and printed in one piece when it finishes.
+    ///
+    /// Inside a bootstrap root the hooks go to one HookWorker, started on
+    /// first use and kept for the runner's lifetime (one transaction), so the
+    /// chroot and shell startup are paid once rather than per hook.
+    class HookRunner {
+    public:
+        explicit HookRunner(std::string rootDir, unsigned jobs = 0);
+
+        void add(HookJob job);
+        [[nodiscard]] bool empty() const { return jobs_.empty(); }
+
+        /// Run everything queued and empty the queue.
+        void run();
+
+    private:
+        std::vector<std::vector<size_t>> waves(const std::vector<size_t>& subset) const;
+        void runWave(const std::vector<size_t>& wave);
+        /// Run a wave through the worker; indexes it could not run are
+        /// left in `wave` for the caller.
+        bool runWaveInWorker(std::vector<size_t>& wave);
+        void runOne(const HookJob& job) const;
+        static void report(const HookJob& job, const std::string& output, int rc, bool present);
+        static void discard(const HookJob& job, bool present);
+
+        std::string rootDir_;
+        unsigned limit_;
+        std::vector<HookJob> jobs_;
+        std::unique_ptr<HookWorker> worker_;
+        bool useWorker_;
+    };
+
+} // namespace gradient
+
+#endif //HOOKRUNNER_H
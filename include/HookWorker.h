@@ -0,0 +1,49 @@
+// include/HookWorker.h
+
+#ifndef HOOKWORKER_H
+#define HOOKWORKER_H
+
+#include <cstdio>
+#include <string>
+
+namespace gradient {
+
+    /// A long-lived /bin/sh inside the target root that runs hooks on request.
+    ///
+    /// Entering the chroot and starting the shell happen once; each hook is
+    /// then a subshell forked by that shell, which sources the package script
+    /// with `set -e` exactly as a standalone hook would. Requests go in on
+    /// the worker's stdin and "<id> <status>" lines come back on its stdout
+    /// as hooks finish, in any order. Each hook's output goes to its own file
+    /// in a scratch directory under <root>/var/lib/gradient.
+    class HookWorker {
+    public:
+        explicit HookWorker(std::string rootDir);
+        ~HookWorker();
+        HookWorker(const HookWorker&) = delete;
+        HookWorker& operator=(const HookWorker&) = delete;
+
+        bool start();
+
+        /// Queue a hook; `script` is the host path. Returns its id, or -1 if
+        /// the worker is gone.
+        int submit(const std::string& script, const std::string& hook);
+        /// Block for the next finished hook. False if the worker died.
+        bool next(int& id, int& status);
+        /// Collected stdout/stderr of a finished hook (removes the file).
+        std::string takeOutput(int id);
+
+    private:
+        void stop();
+
+        std::string rootDir_;
+        std::string outDir_;     // host path of the scratch directory
+        int toWorker_ = -1;
+        FILE* fromWorker_ = nullptr;
+        int pid_ = -1;
+        int nextId_ = 0;
+    };
+
+} // namespace gradient
+
+#endif //HOOKWORKER_H
@@ -0,0 +1,44 @@
+// include/ImageExporter.h
+
+#ifndef IMAGEEXPORTER_H
+#define IMAGEEXPORTER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace gradient {
+
+    /// Streams a package set into a root filesystem image without unpacking
+    /// anything to disk (`gradient export-image`).
+    ///
+    /// Payload members are copied header by header from each .apkg into the
+    /// output tar, followed by the install scripts and a gradient.db
+    /// describing the set, so the image behaves as if the packages had been
+    /// installed into it. Packages are written in the given order and members
+    /// in archive order; mtimes are clamped to SOURCE_DATE_EPOCH when set,
+    /// so the same inputs always give the same bytes.
+    ///
+    /// Hooks and triggers need a live root to run in and are not run; the
+    /// packages that have them are listed instead.
+    class ImageExporter {
+    public:
+        /// Called as each package has been written.
+        using ExportedFn = std::function<void(const std::string& label, size_t done, size_t total)>;
+
+        /// `out` is a tar file ("-" for stdout), or with `layers` a directory
+        /// that receives one tar per package, named NNN-<name>-<version>.tar,
+        /// plus a last layer with the database.
+        ImageExporter(std::string out, bool layers = false, bool force = false);
+
+        bool run(const std::vector<std::string>& archives, const ExportedFn& onExported = {});
+
+    private:
+        std::string out_;
+        bool layers_;
+        bool force_;
+    };
+
+} // namespace gradient
+
+#endif //IMAGEEXPORTER_H
@@ -7,10 +7,16 @@
 
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include "Database.h"
 #include "Repository.h"
 #include "DependencyResolver.h"
+#include "DiskThrottle.h"
+#include "Durability.h"
+#include "HookRunner.h"
+#include "ObjectStore.h"
+#include "TriggerQueue.h"
 #include <regex>
 
 namespace gradient {
@@ -25,12 +31,33 @@ namespace gradient {
 
         // Install a standalone .apkg archive
         bool installArchive(const std::string& archivePath);
+        // Install a package Staging unpacked into `slot`, moving its files
+        // into place instead of extracting them
+        bool applyStaged(const std::string& slot);
 
         // Repo-based operations
         bool installPackage(const std::string& name, const std::string& version);
-        bool removePackage(const std::string& name) const;
+        bool removePackage(const std::string& name);
         bool updatePackage(const std::string& name);
 
+        // Run the hooks deferred by installArchive/removePackage, then the
+        // triggers they fired; once at the end of each transaction.
+        void finish();
+        // Hooks of unrelated packages run concurrently, up to `jobs` at once
+        // (0 = one per CPU).
+        void setHookJobs(unsigned jobs);
+        // Install regular files from `store` (hard links or reflinks)
+        // instead of writing fresh copies; nullptr turns it off.
+        void setStore(const ObjectStore* store);
+        // How installed files are flushed before each commit (default: syncfs).
+        void setDurability(Durability::Mode mode);
+        // Drop each package's archive and files from the page cache once
+        // it is installed.
+        void setGentle(bool gentle);
+        // Wait for the disk to calm down before each package and, where
+        // files are written directly, each file; nullptr turns it off.
+        void setThrottle(DiskThrottle* throttle);
+
     private:
         // Core dependencies
         Database& db_;
@@ -42,11 +69,21 @@ namespace gradient {
         std::string rootDir_;
 
         // Internal state
-        bool warnings_;
+        unsigned warnings_;   // Broken:: reasons forced past
+        TriggerQueue triggers_;
+        HookRunner hooks_;
+        const ObjectStore* store_ = nullptr;
+        Durability::Mode durability_ = Durability::Mode::Syncfs;
+        bool gentle_ = false;
+        DiskThrottle* throttle_ = nullptr;
 
         // Helpers
+        bool install(const std::string& archivePath, const std::string& slot);
         static std::string detectHostArch();
         static std::string makeTempDir();
+        static bool storable(const std::filesystem::path& pkgRoot);
+        bool materializeTree(const std::filesystem::path& pkgRoot,
+                             const std::vector<std::string>& backup) const;
         std::unordered_set<std::string> staged_;
     };
 
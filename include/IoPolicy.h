@@ -0,0 +1,29 @@
+// include/IoPolicy.h
+
+#ifndef IOPOLICY_H
+#define IOPOLICY_H
+
+#include <string>
+#include <vector>
+
+namespace gradient {
+
+    /// Keeps package operations from getting in the way of whatever else
+    /// the host is running.
+    class IoPolicy {
+    public:
+        /// Nice 10 and the lowest best-effort I/O priority for the calling
+        /// thread, or with `idle` nice 19 and the idle I/O class (disk time
+        /// only when nobody else wants it). Threads and processes it starts
+        /// afterwards inherit both.
+        static void lowerPriority(bool idle = false);
+
+        /// Write `files` back and drop them from the page cache, so an
+        /// install does not evict the working set of other services.
+        /// Missing files and symlinks are skipped.
+        static void dropCache(const std::vector<std::string>& files);
+    };
+
+} // namespace gradient
+
+#endif //IOPOLICY_H
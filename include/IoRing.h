@@ -0,0 +1,59 @@
+// include/IoRing.h
+
+#ifndef IORING_H
+#define IORING_H
+
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <initializer_list>
+
+namespace gradient {
+
+    /// Minimal io_uring instance driven through the raw syscalls (no
+    /// liburing). A ring that cannot be set up - old kernel, seccomp,
+    /// kernel.io_uring_disabled - reports !ok() and callers keep to plain
+    /// syscalls.
+    class IoRing {
+    public:
+        explicit IoRing(unsigned entries);
+        ~IoRing();
+        IoRing(const IoRing&) = delete;
+        IoRing& operator=(const IoRing&) = delete;
+
+        [[nodiscard]] bool ok() const { return fd_ >= 0; }
+        /// Whether the kernel implements every opcode in `ops`.
+        bool supports(std::initializer_list<int> ops) const;
+        /// Reserve `n` empty fixed-file slots for direct descriptors.
+        bool registerFiles(unsigned n);
+
+        /// Free submission slots.
+        [[nodiscard]] unsigned space() const;
+        /// Next zeroed SQE, or nullptr when the queue is full.
+        io_uring_sqe* sqe();
+        /// Submit everything queued and wait for `wait` completions.
+        bool submit(unsigned wait);
+        /// Pop one completion; false when none is ready.
+        bool reap(io_uring_cqe& cqe);
+        /// Pop one completion, blocking until there is one; false only when
+        /// the ring itself fails.
+        bool wait(io_uring_cqe& cqe);
+
+    private:
+        int fd_ = -1;
+        void* sqMap_ = nullptr;
+        void* cqMap_ = nullptr;
+        std::size_t sqMapLen_ = 0, cqMapLen_ = 0;
+        io_uring_sqe* sqes_ = nullptr;
+        std::size_t sqesLen_ = 0;
+
+        unsigned *sqHead_ = nullptr, *sqTail_ = nullptr, *sqMask_ = nullptr, *sqArray_ = nullptr;
+        unsigned *cqHead_ = nullptr, *cqTail_ = nullptr, *cqMask_ = nullptr;
+        io_uring_cqe* cqes_ = nullptr;
+        unsigned entries_ = 0;
+        unsigned queued_ = 0;   // SQEs filled since the last submit
+    };
+
+} // namespace gradient
+
+#endif //IORING_H
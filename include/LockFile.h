@@ -0,0 +1,37 @@
+// include/LockFile.h
+
+#ifndef LOCKFILE_H
+#define LOCKFILE_H
+
+#include <chrono>
+#include <string>
+
+namespace gradient {
+
+    /// The writer lock: an exclusive flock() on <stateDir>/lock that holds the
+    /// owner's pid. Only mutating transactions take it; readers rely on WAL
+    /// snapshots and never wait on it. The kernel drops the lock if the holder
+    /// dies, so a stale file never blocks anyone.
+    class LockFile {
+    public:
+        explicit LockFile(std::string path);
+        ~LockFile();
+        LockFile(const LockFile&) = delete;
+        LockFile& operator=(const LockFile&) = delete;
+
+        /// Wait up to `timeout` for the lock, telling the user once who holds
+        /// it. Fails with an error naming the holder on timeout.
+        bool acquire(std::chrono::seconds timeout);
+        void release();
+
+    private:
+        /// "pid 1234 (gradient install foo)", or "" if unknown
+        std::string describeHolder() const;
+
+        std::string path_;
+        int fd_ = -1;
+    };
+
+} // namespace gradient
+
+#endif //LOCKFILE_H
@@ -0,0 +1,71 @@
+// include/ObjectStore.h
+
+#ifndef OBJECTSTORE_H
+#define OBJECTSTORE_H
+
+#include <cstdint>
+#include <string>
+
+namespace gradient {
+
+    /// Content-addressed file store shared by every root on the host
+    /// (`gradient --store ...`), normally /var/lib/gradient/store.
+    ///
+    /// Objects live at objects/<2 hex>/<sha256 rest>-<mode>-<uid>-<gid>,
+    /// followed by -x<digest> for files with extended attributes: hard links
+    /// share an inode, so files that differ only in ownership, permissions,
+    /// capabilities or ACLs are separate objects. Installed files are hard links to
+    /// their object when root and store share a filesystem, reflinks where
+    /// the filesystem supports them, plain copies otherwise. Files are always
+    /// replaced by rename, never rewritten in place, so a linked object is
+    /// never modified through a root by gradient itself. Configuration,
+    /// which others do edit in place, never enters the store (copy()), and
+    /// an object found changed is re-ingested rather than linked again.
+    ///
+    /// An object whose link count is back to one is referenced by no root
+    /// and is removed by gc().
+    class ObjectStore {
+    public:
+        static constexpr const char* kDefaultDir = "/var/lib/gradient/store";
+
+        enum class Method { Hardlink, Reflink, Copy };
+
+        struct GcStats {
+            size_t removed = 0;
+            std::uint64_t bytes = 0;
+            size_t kept = 0;
+        };
+
+        explicit ObjectStore(std::string dir);
+
+        /// Create the store layout if needed.
+        bool open();
+        [[nodiscard]] const std::string& dir() const { return dir_; }
+
+        /// Scratch directory on the store's filesystem. Packages unpacked
+        /// here enter the store by link(), without copying a byte.
+        [[nodiscard]] std::string makeTempDir() const;
+
+        /// Add the regular file `src` to the store (or find its object) and
+        /// make `dest` that file, atomically replacing whatever is there.
+        bool materialize(const std::string& src, const std::string& dest, Method* how = nullptr) const;
+        /// Make `dest` a copy of `src` of its own (a reflink where possible),
+        /// for files that are edited in place.
+        bool copy(const std::string& src, const std::string& dest, Method* how = nullptr) const;
+
+        /// Remove every object no root links to, and scratch directories
+        /// left behind by interrupted installs.
+        GcStats gc() const;
+
+        /// SHA-256 of the file at `path` as lowercase hex.
+        static bool hashFile(const std::string& path, std::string& hex);
+
+    private:
+        bool ingest(const std::string& src, const std::string& object, const std::string& hex) const;
+
+        std::string dir_;
+    };
+
+} // namespace gradient
+
+#endif //OBJECTSTORE_H
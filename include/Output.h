@@ -0,0 +1,33 @@
+// include/Output.h
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Database.h"
+#include "RepoIndex.h"
+
+namespace gradient {
+
+    /// Formatting for the read-only commands, shared by the CLI and gradientd
+    /// so both produce byte-identical output.
+    class Output {
+    public:
+        static void packageList(std::ostream& out, const std::vector<PackageInfo>& pkgs, bool parse);
+        static void packageInfo(std::ostream& out, const PackageInfo& pkg, bool parse);
+        static void notInstalled(std::ostream& err, const std::string& name);
+        static void owners(std::ostream& out,
+                           const std::vector<std::string>& paths,
+                           const std::vector<std::pair<std::string, std::string>>& owners,
+                           bool parse);
+        static void query(std::ostream& out, std::ostream& err,
+                          const RepoIndex& index, const std::string& pattern, bool parse);
+    };
+
+} // namespace gradient
+
+#endif //OUTPUT_H
@@ -9,14 +9,28 @@
 #include <vector>
 
 namespace gradient {
+    struct ArchiveIndex;
+
     class Package {
     public:
+        /// A post-transaction action run once however many packages fire it.
+        struct Trigger {
+            std::string name;
+            std::vector<std::string> paths;   // fnmatch patterns on installed paths
+            std::string exec;                 // shell command, run inside the root
+        };
         struct Metadata {
             std::string name, version, arch, description;
             std::vector<std::string> deps, makedepends, conflicts, replaces, provides;
+            std::vector<Trigger> triggers;
+            std::vector<std::string> activates;   // trigger names fired explicitly
+            std::vector<std::string> backup;      // config files edited in place
         };
         explicit Package(const std::string& archivePath);
         bool loadMetadata();
+        /// Read metadata, payload layout and install script (empty if none)
+        /// in one sequential pass over the archive, without extracting it.
+        bool inspect(ArchiveIndex& index, std::string& script);
         [[nodiscard]] const Metadata& metadata() const;
     private:
         std::string archivePath_;
@@ -0,0 +1,69 @@
+// include/PackageSet.h
+
+#ifndef PACKAGESET_H
+#define PACKAGESET_H
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Database.h"
+#include "Package.h"
+#include "TarHandler.h"
+
+namespace gradient {
+
+    /// Run fn(0..n-1) on up to `limit` threads.
+    template <typename Fn>
+    void parallelFor(size_t n, size_t limit, Fn fn) {
+        const size_t workers = std::min(limit, n);
+        if (workers <= 1) {
+            for (size_t i = 0; i < n; ++i) fn(i);
+            return;
+        }
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> pool;
+        for (size_t w = 0; w < workers; ++w) {
+            pool.emplace_back([&] {
+                for (size_t k; (k = next++) < n; ) fn(k);
+            });
+        }
+        for (auto& t : pool) t.join();
+    }
+
+    /// A batch of archives handled as one unit of work (bootstrap,
+    /// export-image) rather than package by package through Installer.
+    /// Everything is read from the archives' tables of contents.
+    class PackageSet {
+    public:
+        struct Member {
+            std::string archive;
+            ArchiveIndex idx;
+            Package::Metadata meta;
+            std::string script;          // install.anemonix contents
+            bool installed = false;      // already installed at this version
+            unsigned broken = 0;         // Broken:: reasons forced past
+        };
+
+        /// Read every archive, `jobs` at a time.
+        bool read(const std::vector<std::string>& archives, size_t jobs);
+
+        /// Installer's checks for the whole set at once, against `db` and
+        /// each other: arch, dependencies, package conflicts and file
+        /// conflicts. With `force` a failed check marks the member broken;
+        /// `overlapping` tells whether payloads overwrite each other. A
+        /// package installed at another version is always refused (sets only
+        /// add packages) and `replaces:` is not honoured.
+        bool check(const Database& db, bool force, bool& overlapping);
+
+        std::vector<Member>& members() { return members_; }
+
+    private:
+        std::vector<Member> members_;
+    };
+
+} // namespace gradient
+
+#endif //PACKAGESET_H
@@ -0,0 +1,36 @@
+// include/PayloadWriter.h
+
+#ifndef PAYLOADWRITER_H
+#define PAYLOADWRITER_H
+
+#include <string>
+
+#include "TarHandler.h"
+
+namespace gradient {
+
+    class DiskThrottle;
+
+    /// Unpacks the payload of an uncompressed .apkg without tar(1): file
+    /// data goes straight from the archive into the root with FileCopy, so
+    /// on a reflink-capable filesystem nothing is copied, and elsewhere the
+    /// copy stays in the kernel.
+    class PayloadWriter {
+    public:
+        /// Whether `archive` can be unpacked here: it must be a plain tar
+        /// (compressed data cannot be addressed by offset) and hold nothing
+        /// only tar restores, such as POSIX ACLs or sparse files.
+        static bool supports(const std::string& archive);
+
+        /// Same result as TarHandler::extractPayload(). Each file is written
+        /// under a scratch name and renamed into place once complete. With a
+        /// `throttle`, every member waits for the disk to be uncongested.
+        /// Members and hard link targets that would leave the payload fail the
+        /// extraction; absolute and ".." symlinks are created last.
+        static bool extract(const std::string& archive, const ArchiveIndex& idx,
+                            const std::string& rootDir, DiskThrottle* throttle = nullptr);
+    };
+
+} // namespace gradient
+
+#endif //PAYLOADWRITER_H
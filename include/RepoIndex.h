@@ -0,0 +1,62 @@
+// include/RepoIndex.h
+
+#ifndef REPOINDEX_H
+#define REPOINDEX_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DeltaHandler.h"
+
+namespace gradient {
+
+    /// One installable entry from a synced repo index.
+    struct RepoPkg {
+        std::string pkgname, pkgver, arch, filename, repoUrl, description;
+        std::string sha256;   // of `filename`, when the index publishes it
+        std::uint64_t size{}; // of `filename` in bytes, when published (0 = unknown)
+        std::vector<std::string> depends;
+        std::vector<std::string> provides;
+        std::vector<DeltaInfo> deltas;
+        int priority{};
+        std::string repoName;
+    };
+    using PkgMap = std::unordered_map<std::string, std::vector<RepoPkg>>;
+
+    /// All synced repositories under a repos directory
+    /// (<name>.json descriptors plus <name>/repo.json indexes), parsed once.
+    class RepoIndex {
+    public:
+        struct Repo {
+            std::string name;
+            bool synced = false;
+            std::vector<RepoPkg> packages;   // in index order
+        };
+
+        explicit RepoIndex(std::filesystem::path repoBase);
+
+        /// (Re)parse every descriptor and synced index.
+        bool load();
+        /// True if any descriptor or index changed on disk since load().
+        [[nodiscard]] bool stale() const;
+
+        /// Entries indexed by real name and by every provided name.
+        [[nodiscard]] const PkgMap& packages() const { return pkgMap_; }
+        [[nodiscard]] const std::vector<Repo>& repos() const { return repos_; }
+
+        /// Highest-priority, then newest, entry among `candidates`
+        static const RepoPkg& pickBest(std::vector<RepoPkg>& candidates);
+
+    private:
+        std::filesystem::path repoBase_;
+        std::vector<Repo> repos_;
+        PkgMap pkgMap_;
+        std::unordered_map<std::string, std::filesystem::file_time_type> mtimes_;
+    };
+
+} // namespace gradient
+
+#endif //REPOINDEX_H
@@ -6,6 +6,7 @@
 #define SCRIPTEXECUTOR_H
 
 #include <string>
+#include <vector>
 
 namespace gradient {
 
@@ -17,6 +18,32 @@ namespace gradient {
         static void runScript(const std::string& scriptPath,
                           const std::string& hookName,
                           const std::string& chrootDir = "");
+
+        // Runs a single shell command inside chrootDir (or the host when
+        // empty or "/"); `what` names it in the failure warning.
+        static void runCommand(const std::string& command,
+                               const std::string& chrootDir,
+                               const std::string& what);
+
+        // Sources scriptPath and runs post_common plus hookName, collecting
+        // stdout and stderr into `output`. Returns the exit status.
+        static int runHook(const std::string& scriptPath,
+                           const std::string& hookName,
+                           const std::string& chrootDir,
+                           std::string& output);
+
+        // Where a host path under chrootDir appears from inside it
+        static std::string pathInRoot(const std::string& path,
+                                      const std::string& chrootDir);
+
+        // fork/exec argv[0] with a fixed, minimal environment, entering
+        // chrootDir first when it is set and not "/". No shell is involved
+        // unless argv asks for one. stdin is /dev/null; stdout and stderr are
+        // collected into `output`. Returns the exit status, 128 + signal
+        // when killed, or -1 if the process could not be started.
+        static int execute(const std::vector<std::string>& argv,
+                           const std::string& chrootDir,
+                           std::string& output);
     };
 
 } // namespace anemo
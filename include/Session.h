@@ -0,0 +1,193 @@
+// include/Session.h
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "Database.h"
+#include "Durability.h"
+#include "LockFile.h"
+#include "RepoIndex.h"
+#include "Repository.h"
+
+namespace gradient {
+
+    /// Where a Session works and how it behaves.
+    struct SessionOptions {
+        /// Root packages are installed into ("/" for the running system).
+        std::string root = "/";
+        /// Directory holding gradient.db; defaults to <root>/var/lib/gradient.
+        std::string stateDir;
+        /// Directory holding repo descriptors; defaults to <stateDir>/repos.
+        std::string repoDir;
+        /// Ignore conflicts and reverse dependencies, like `gradient -f`.
+        bool force = false;
+        /// Parallelism for package hooks (0 = one per CPU).
+        unsigned jobs = 0;
+        /// How long a mutating operation waits for another writer to finish.
+        std::chrono::seconds lockTimeout{300};
+        /// Content-addressed store to install files from (see ObjectStore);
+        /// empty installs fresh copies. One store serves every root on the
+        /// host, normally /var/lib/gradient/store.
+        std::string storeDir;
+        /// Where downloaded archives are kept, verified, for later operations
+        /// to reuse without the network; defaults to <root>/var/cache/gradient/pkgs.
+        std::string cacheDir;
+        /// How installed files are flushed before the commit recording them.
+        Durability::Mode durability = Durability::Mode::Syncfs;
+        /// Run at low CPU and I/O priority and keep installed packages out
+        /// of the page cache, for upgrades on busy production hosts.
+        bool gentle = false;
+        /// Idle I/O class and nice 19 instead, and extraction that backs off
+        /// whenever the root's disk shows rising latency.
+        bool background = false;
+        /// Cap on the combined download rate in bytes/s (0 = none).
+        std::uint64_t maxDownloadRate = 0;
+        /// Parallel connections for each archive of 32 MiB or more, on
+        /// servers that take byte ranges (1 = one stream per archive).
+        unsigned downloadSegments = 4;
+        /// Draw download progress bars on stdout. Embedders normally turn this
+        /// off and use a ProgressFn instead.
+        bool interactive = true;
+    };
+
+    /// One progress event from a running operation.
+    struct Progress {
+        enum class Stage { Download, Unpack, Install, Remove };
+        Stage stage;
+        std::string package;     // "<name>-<version>" for downloads and installs
+        size_t index = 0;        // 1-based position in the operation
+        size_t total = 0;
+        std::uint64_t bytes = 0;      // Download only: received so far
+        std::uint64_t totalBytes = 0; // Download only: 0 while unknown
+    };
+    /// Download events arrive from the transfer threads, possibly concurrently.
+    using ProgressFn = std::function<void(const Progress&)>;
+
+    /// A resolved install: the packages to fetch and install, in order.
+    struct Plan {
+        std::vector<RepoPkg> packages;
+        /// Requested entries that are already installed at that version.
+        std::vector<RepoPkg> skipped;
+    };
+
+    /// The embeddable gradient API: one database plus the synced repos.
+    ///
+    /// Every operation returns a std::future and runs on its own thread;
+    /// operations on one Session are serialized, so callers may issue them
+    /// from anywhere. Errors are reported on stderr exactly as the CLI reports
+    /// them and surface to the caller as an empty optional or `false`.
+    class Session {
+    public:
+        explicit Session(SessionOptions options = {});
+
+        /// Create the state directories and open the database for writing.
+        /// This or openReadOnly() must succeed before any database call;
+        /// search() only needs the repos.
+        bool open();
+        /// Open the database for queries only: no directories are created, no
+        /// DDL runs and the connection cannot write. Falls back to open() when
+        /// the on-disk schema still needs migrating.
+        bool openReadOnly();
+        /// Open an empty in-memory database, so resolve() treats nothing as
+        /// installed; for building images from scratch.
+        bool openScratch();
+
+        /// Direct access for synchronous callers; not safe while an
+        /// operation started from this Session is still running.
+        Database& database() { return *db_; }
+        const SessionOptions& options() const { return opts_; }
+
+        /// Take the writer lock for direct writes through database().
+        /// install, installArchives and remove take it themselves. Returns
+        /// nullptr if another writer kept it past the lock timeout.
+        std::unique_ptr<LockFile> lock();
+
+        /// Resolve `requests` ("name", "name>=1.2", ...) and their missing
+        /// dependencies against the repos.
+        std::future<std::optional<Plan>> resolve(std::vector<std::string> requests);
+        /// Every installed package with a newer build, plus anything new those
+        /// builds depend on.
+        std::future<std::optional<Plan>> resolveUpgrades();
+
+        /// Download `plan` into `dir`, preferring deltas against installed
+        /// versions. Yields one archive per plan entry, in order. Archives
+        /// already in `dir` are reused, and a download only lands there once
+        /// verified, so fetching into the cache directory ahead of time lets a
+        /// later install run without the network. Nothing installed changes.
+        std::future<std::optional<std::vector<std::filesystem::path>>>
+            fetch(Plan plan, std::filesystem::path dir, ProgressFn progress = {});
+
+        /// Fetch `plan`, check it for file conflicts and install it in order.
+        std::future<bool> install(Plan plan, ProgressFn progress = {});
+        /// Fetch `plan` and unpack it into <stateDir>/staged (see Staging),
+        /// replacing whatever was staged before. Neither the root nor the
+        /// database changes.
+        std::future<bool> stage(Plan plan, ProgressFn progress = {});
+        /// Install what stage() unpacked, moving files into place instead of
+        /// extracting them, unless a staged package's installed version has
+        /// changed since. The staged set is used up either way once started.
+        std::future<bool> apply(ProgressFn progress = {});
+        /// Install local .apkg archives in the given order.
+        std::future<bool> installArchives(std::vector<std::string> archives, ProgressFn progress = {});
+        /// Fetch `plan` and add it to a bootstrap root as one unit of work
+        /// (see Bootstrapper): parallel unpacking, one database write and one
+        /// sync for the whole set. Install progress is reported as each
+        /// payload lands, in completion order.
+        std::future<bool> bootstrap(Plan plan, ProgressFn progress = {});
+        /// The same for local .apkg archives.
+        std::future<bool> bootstrapArchives(std::vector<std::string> archives, ProgressFn progress = {});
+        /// Fetch `plan` and stream it into a root filesystem image at `out`
+        /// (see ImageExporter); nothing is unpacked and no state is touched.
+        std::future<bool> exportImage(Plan plan, std::string out, bool layers = false,
+                                      ProgressFn progress = {});
+        /// The same for local .apkg archives.
+        std::future<bool> exportArchives(std::vector<std::string> archives, std::string out,
+                                         bool layers = false, ProgressFn progress = {});
+        /// Remove installed packages by name.
+        std::future<bool> remove(std::vector<std::string> names, ProgressFn progress = {});
+
+        /// Installed packages.
+        std::future<std::vector<PackageInfo>> query();
+        /// One installed package, or nothing if it is not installed.
+        std::future<std::optional<PackageInfo>> info(std::string name);
+        /// Repo entries whose name contains `pattern` (case-insensitive).
+        std::future<std::vector<RepoPkg>> search(std::string pattern);
+
+    private:
+        template <typename F>
+        auto run(F&& fn) -> std::future<decltype(fn())>;
+
+        const RepoIndex* repos();
+        Repository& repository();
+        bool resolveInto(const std::vector<std::string>& requests, std::vector<RepoPkg>& order);
+        std::optional<std::vector<std::filesystem::path>>
+            fetchLocked(const Plan& plan, const std::filesystem::path& dir, const ProgressFn& progress);
+        bool checkConflicts(const std::vector<std::string>& archives);
+        bool installLocked(const std::vector<std::string>& archives,
+                           const std::vector<std::string>& labels,
+                           const std::unordered_set<std::string>& staged,
+                           const ProgressFn& progress);
+        bool bootstrapLocked(const std::vector<std::string>& archives, const ProgressFn& progress);
+
+        SessionOptions opts_;
+        std::unique_ptr<Database> db_;
+        std::unique_ptr<Repository> repo_;
+        std::unique_ptr<RepoIndex> index_;
+        std::mutex mtx_;
+    };
+
+} // namespace gradient
+
+#endif //SESSION_H
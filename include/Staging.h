@@ -0,0 +1,57 @@
+// include/Staging.h
+
+#ifndef STAGING_H
+#define STAGING_H
+
+#include <string>
+#include <vector>
+
+namespace gradient {
+
+    /// Packages unpacked ahead of time, so that the part of an upgrade
+    /// that changes the system comes down to renames and database writes.
+    ///
+    /// The staging directory holds one slot per package, in install order,
+    /// laid out like an unpacked archive (anemonix.yaml, install.anemonix,
+    /// package/), and a manifest written last: without one, the directory
+    /// is an interrupted stage and nothing in it is applied. The manifest
+    /// records the version each package had when it was staged, so apply
+    /// can refuse to run on a system that changed since.
+    class Staging {
+    public:
+        struct Entry {
+            std::string name, version;
+            std::string from;   // installed version when staged; empty if none
+            std::string slot;   // directory name under the staging directory
+        };
+
+        explicit Staging(std::string dir);
+
+        /// Remove whatever is staged, complete or not.
+        bool reset();
+        /// Unpack `archive` into the next slot. The payload gets the owners,
+        /// modes, xattrs and hard links an install would give it.
+        bool add(const std::string& archive, const std::string& from);
+        /// Flush the slots and write the manifest, making them applicable.
+        bool commit() const;
+        /// Read the manifest; false if nothing complete is staged.
+        bool load();
+
+        [[nodiscard]] const std::vector<Entry>& entries() const { return entries_; }
+        [[nodiscard]] std::string slotPath(const Entry& e) const;
+
+        /// Move the tree under `payload` into `rootDir` with rename(2). A
+        /// directory the root lacks moves in one rename; one it has is merged
+        /// entry by entry and takes the staged mode and owner. Fails with
+        /// errno EXDEV at the first entry on another filesystem, leaving it
+        /// and everything not yet moved under `payload` for the caller to copy.
+        static bool move(const std::string& payload, const std::string& rootDir);
+
+    private:
+        std::string dir_;
+        std::vector<Entry> entries_;
+    };
+
+} // namespace gradient
+
+#endif //STAGING_H
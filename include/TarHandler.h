@@ -6,12 +6,30 @@
 #define TARHANDLER_H
 
 #include <string>
+#include <vector>
 namespace gradient {
+    // Layout of an .apkg, read from its table of contents alone
+    struct ArchiveIndex {
+        std::string metaMember;      // anemonix.yaml, as named in the archive
+        std::string scriptMember;    // install.anemonix, or empty
+        std::string payloadMember;   // the package/ directory, without trailing '/'
+        std::vector<std::string> paths;   // payload files and symlinks, absolute
+    };
+
     class TarHandler {
     public:
+        // Unpack everything into dest (perms, ACLs, xattrs kept)
         static bool extract(const std::string& archive, const std::string& dest);
         static bool create(const std::string& sourceDir, const std::string& archive);
         static bool extractMember(const std::string& archive, const std::string& member, const std::string& destDir);
+        // Table of contents, as printed by `tar -tf` (directories keep their trailing '/')
+        static bool list(const std::string& archive, std::vector<std::string>& members);
+        // Contents of a single member, without touching disk
+        static bool readMember(const std::string& archive, const std::string& member, std::string& out);
+        static bool index(const std::string& archive, ArchiveIndex& out);
+        // Unpack only the payload, straight into rootDir (perms, ACLs, xattrs kept)
+        static bool extractPayload(const std::string& archive, const ArchiveIndex& idx,
+                                   const std::string& rootDir);
     };
 } // namespace anemo
 
@@ -0,0 +1,97 @@
+// include/TarStream.h
+
+#ifndef TARSTREAM_H
+#define TARSTREAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gradient {
+
+    /// One archive member, with pax / GNU long names already folded in.
+    struct TarEntry {
+        std::string path;
+        std::string linkpath;    // symlink target or hard link member
+        std::string uname, gname;
+        char type = '0';         // ustar typeflag: '0' file, '1' link, '2' symlink, '5' dir, ...
+        std::uint32_t mode = 0644;
+        std::uint64_t uid = 0, gid = 0;
+        std::uint64_t size = 0;
+        std::int64_t mtime = 0;
+        std::uint32_t devmajor = 0, devminor = 0;
+        /// SCHILY.xattr.* pax records, as GNU tar --xattrs writes them
+        std::vector<std::pair<std::string, std::string>> xattrs;
+        /// Data only tar itself knows how to restore: POSIX ACLs (kept as
+        /// text) and sparse files
+        bool acl = false;
+        bool sparse = false;
+    };
+
+    /// Sequential reader over a tar archive, plain or compressed (gzip, xz,
+    /// zstd and bzip2 are piped through their decompressor).
+    class TarReader {
+    public:
+        explicit TarReader(std::string archive);
+        ~TarReader();
+        TarReader(const TarReader&) = delete;
+        TarReader& operator=(const TarReader&) = delete;
+
+        bool open();
+        /// Advance to the next member, skipping whatever is left of the
+        /// current one. False at the end of the archive or on error.
+        bool next(TarEntry& entry);
+        /// Stream the current member's data to `sink` in chunks.
+        bool read(const std::function<bool(const char*, size_t)>& sink);
+        [[nodiscard]] bool failed() const { return failed_; }
+
+        /// Uncompressed archive read straight from the file: members are
+        /// skipped by seeking, and the current member's data can be taken
+        /// from fd() at dataOffset() without going through read().
+        [[nodiscard]] bool seekable() const { return !pipe_; }
+        [[nodiscard]] int fd() const;
+        [[nodiscard]] std::uint64_t dataOffset() const { return offset_; }
+
+    private:
+        bool readBlock(char* block);
+        bool skip(std::uint64_t bytes);
+        bool readAll(std::uint64_t size, std::string& out);
+
+        std::string archive_;
+        FILE* in_ = nullptr;
+        bool pipe_ = false;
+        bool failed_ = false;
+        std::uint64_t remaining_ = 0;   // data of the current member still unread
+        std::uint64_t padding_ = 0;     // then this much up to the block boundary
+        std::uint64_t offset_ = 0;      // archive offset of the next unread byte
+    };
+
+    /// Writes a POSIX (pax) tar stream. Fields that do not fit ustar, and
+    /// extended attributes, go into a per-entry pax header; no timestamps
+    /// besides mtime are written, so equal input gives byte-identical output.
+    class TarWriter {
+    public:
+        explicit TarWriter(FILE* out);
+
+        /// Write `entry`'s header; exactly entry.size bytes of data must follow.
+        bool begin(const TarEntry& entry);
+        bool write(const char* data, size_t n);
+        /// Pad the member's data to the block size.
+        bool end();
+        bool add(const TarEntry& entry, const std::string& data);
+        /// Write the end-of-archive marker and flush.
+        bool finish();
+
+    private:
+        bool header(const TarEntry& entry, const std::string& name, const std::string& link);
+
+        FILE* out_;
+        std::uint64_t written_ = 0;
+    };
+
+} // namespace gradient
+
+#endif //TARSTREAM_H
@@ -0,0 +1,58 @@
+// include/TriggerQueue.h
+
+#ifndef TRIGGERQUEUE_H
+#define TRIGGERQUEUE_H
+
+#include <string>
+#include <vector>
+
+#include "Database.h"
+
+namespace gradient {
+
+    /// Collects the triggers fired during a transaction and runs each once.
+    ///
+    /// Packages declare triggers in anemonix.yaml:
+    ///
+    ///     triggers:
+    ///       - name: ldconfig
+    ///         paths: ["/usr/lib/*.so*", "/lib/*.so*"]
+    ///         exec: ldconfig
+    ///     activates: [fontcache]
+    ///
+    /// A trigger fires when a package in the transaction installs or removes
+    /// a path matching one of its patterns (fnmatch, `*` crosses '/'), or
+    /// lists its name under `activates:`. Triggers sharing a name are one
+    /// action; the first registration by package name supplies the command.
+    ///
+    /// Paths are matched when the queue runs, against the triggers installed
+    /// at the end of the transaction: fonts installed before fontconfig in the
+    /// same transaction still fire fontconfig's trigger.
+    class TriggerQueue {
+    public:
+        explicit TriggerQueue(const Database& db);
+
+        /// Record `paths` as installed or removed by the transaction.
+        void pathsChanged(const std::vector<std::string>& paths);
+        /// Fire a trigger by name.
+        void activate(const std::string& name);
+
+        /// Match the recorded paths against the triggers registered now, run
+        /// every fired trigger once inside `rootDir`, in firing order, and
+        /// empty the queue. Triggers whose package is gone are skipped.
+        void run(const std::string& rootDir);
+
+    private:
+        /// One pathsChanged() batch (empty `name`) or one activate().
+        struct Event {
+            std::string name;
+            std::vector<std::string> paths;
+        };
+
+        const Database& db_;
+        std::vector<Event> events_;
+    };
+
+} // namespace gradient
+
+#endif //TRIGGERQUEUE_H
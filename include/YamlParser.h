@@ -13,6 +13,7 @@ namespace gradient {
     class YamlParser {
     public:
         static bool parseMetadata(const std::string& yamlPath, Package::Metadata& outMeta);
+        static bool parseMetadataText(const std::string& content, Package::Metadata& outMeta);
     };
 
 } // namespace anemo
@@ -4,6 +4,7 @@
 
 #ifndef TOOLS_H
 #define TOOLS_H
+#include <filesystem>
 #include <regex>
 
 class Tools {
@@ -25,6 +26,14 @@ static Constraint parseConstraint(const std::string& s) {
     return { s, "", "" };
 }
 
+/// Package names of a deps/provides list, constraints dropped
+static std::vector<std::string> bareNames(const std::vector<std::string>& raws) {
+    std::vector<std::string> out;
+    out.reserve(raws.size());
+    for (auto& r : raws) out.push_back(parseConstraint(r).name);
+    return out;
+}
+
 /// Compare two version strings a and b:
 /// - Splits on '.', '-', '+'
 /// - Compares numeric segments numerically, other segments lexicographically
@@ -100,6 +109,16 @@ static int versionCompare(const std::string& a, const std::string& b) {
 }
 
 
+/// Absolute, lexically normal form of a path as recorded in the files table
+/// ("usr//bin/../bin/foo/" run from "/" -> "/usr/bin/foo")
+static std::string normalizePath(const std::string& raw) {
+    std::filesystem::path p(raw);
+    if (!p.is_absolute()) p = std::filesystem::absolute(p);
+    std::string s = p.lexically_normal().string();
+    while (s.size() > 1 && s.back() == '/') s.pop_back();
+    return s;
+}
+
 /// Test an installed version vs. a constraint
 static bool evalConstraint(const std::string& instVer, const Constraint& c) {
     if (c.op.empty()) return true;
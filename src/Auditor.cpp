@@ -0,0 +1,96 @@
+// src/Auditor.cpp
+
+#include "Auditor.h"
+#include "tools.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace gradient {
+
+    Auditor::Auditor(const Database& db, std::string rootDir)
+        : db_(db), rootDir_(std::move(rootDir)) {}
+
+    AuditReport Auditor::run(const bool checkFiles) const {
+        AuditReport report;
+
+        // 1) Installed set: name -> version
+        std::unordered_map<std::string, std::string> installed;
+        for (auto& p : db_.listPackages()) {
+            installed.emplace(p.name, p.version);
+        }
+
+        // 2) Provides index: provided name -> versions offered ("" = unversioned)
+        std::unordered_map<std::string, std::vector<std::string>> provided;
+        for (auto& row : db_.getAllProvides()) {
+            provided[row.constraint.name].push_back(row.constraint.version);
+        }
+
+        auto satisfied = [&](const Tools::Constraint& c) {
+            if (auto it = installed.find(c.name);
+                it != installed.end() && Tools::evalConstraint(it->second, c))
+                return true;
+            if (auto it = provided.find(c.name); it != provided.end()) {
+                for (auto& ver : it->second) {
+                    if (c.op.empty() || Tools::evalConstraint(ver, c))
+                        return true;
+                }
+            }
+            return false;
+        };
+
+        // 3) Dependencies, with parsed constraints and provides
+        std::unordered_set<std::string> unhealthy;
+        for (auto& [pkg, raw, c] : db_.getAllDependencies()) {
+            // SONAMEs are not tracked as packages
+            if (c.name.find(".so") != std::string::npos) continue;
+            if (!satisfied(c)) {
+                report.unsatisfied.push_back({pkg, raw});
+                unhealthy.insert(pkg);
+            }
+        }
+
+        // 4) Conflicts against what is actually installed
+        for (auto& [pkg, raw, c] : db_.getAllConflicts()) {
+            if (c.name == pkg) continue;
+            if (auto it = installed.find(c.name);
+                it != installed.end() && Tools::evalConstraint(it->second, c))
+            {
+                report.conflicts.push_back({pkg, c.name + "-" + it->second});
+                unhealthy.insert(pkg);
+            }
+        }
+
+        // 5) Files recorded in the DB but gone from disk
+        if (checkFiles) {
+            int rootFd = open(rootDir_.empty() ? "/" : rootDir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (rootFd >= 0) {
+                struct stat st{};
+                for (auto& [pkg, path] : db_.getAllFiles()) {
+                    const char* rel = path.c_str();
+                    while (*rel == '/') ++rel;
+                    if (fstatat(rootFd, rel, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                        report.missingFiles.push_back({pkg, path});
+                        unhealthy.insert(pkg);
+                    }
+                }
+                close(rootFd);
+            }
+        }
+
+        // 6) broken_packages rows that no longer mean anything: only those
+        // whose every reason was re-checked above (overwritten files cannot
+        // be). Rows of removed packages go away with them via ON DELETE CASCADE
+        for (auto& [name, reasons] : db_.getBrokenReasons()) {
+            if (!(reasons & ~Broken::Rechecked) && !unhealthy.contains(name))
+                report.staleBroken.push_back(name);
+        }
+
+        return report;
+    }
+
+} // namespace gradient
@@ -0,0 +1,174 @@
+// src/Bootstrapper.cpp
+
+#include "Bootstrapper.h"
+#include "Database.h"
+#include "PayloadWriter.h"
+#include "HookRunner.h"
+#include "PackageSet.h"
+#include "TriggerQueue.h"
+#include "tools.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    Bootstrapper::Bootstrapper(std::string rootDir, std::string dbPath,
+                               unsigned jobs, bool force, Durability::Mode durability)
+        : rootDir_(std::move(rootDir))
+        , dbPath_(std::move(dbPath))
+        , jobs_(jobs)
+        , force_(force)
+        , durability_(durability)
+    {}
+
+    bool Bootstrapper::run(const std::vector<std::string>& archives, const ExtractedFn& onExtracted) {
+        const size_t limit = jobs_ ? jobs_ : std::max(1u, std::thread::hardware_concurrency());
+
+        // 1) Table of contents, metadata and script of every archive; nothing is unpacked
+        PackageSet set;
+        if (!set.read(archives, limit))
+            return false;
+
+        // 2) Work on an in-memory copy of the database
+        Database db(":memory:");
+        if (!db.open()) {
+            std::cerr << "\033[31merror:\033[0m Unable to open in-memory database.\n";
+            return false;
+        }
+        if (std::error_code ec; fs::exists(dbPath_, ec) && !db.loadFrom(dbPath_))
+            return false;
+        if (!db.initSchema()) {
+            std::cerr << "\033[31merror:\033[0m Unable to initialize database.\n";
+            return false;
+        }
+
+        // 3) Every check Installer makes, for the whole set at once
+        bool overlapping = false;
+        if (!set.check(db, force_, overlapping))
+            return false;
+
+        std::vector<PackageSet::Member*> todo;
+        for (auto& m : set.members()) {
+            if (!m.installed) todo.push_back(&m);
+        }
+
+        // 4) Install scripts, then every payload straight into the root.
+        //    Overlapping payloads are unpacked in order so the last one wins,
+        //    as it would across separate installs.
+        fs::path scriptsDir = fs::path(rootDir_) / "var/lib/gradient/scripts";
+        std::error_code ec;
+        fs::create_directories(scriptsDir, ec);
+        std::vector<std::string> scriptPaths(todo.size());
+        for (size_t i = 0; i < todo.size(); ++i) {
+            const auto* e = todo[i];
+            if (e->idx.scriptMember.empty()) continue;
+            fs::path dst = scriptsDir / (e->meta.name + "-" + e->meta.version + ".anemonix");
+            std::ofstream out(dst, std::ios::binary | std::ios::trunc);
+            out << e->script;
+            if (!out) {
+                std::cerr << "\033[31merror:\033[0m Failed to write '" << dst.string() << "'.\n";
+                return false;
+            }
+            scriptPaths[i] = dst.string();
+        }
+
+        std::atomic<size_t> done{0};
+        std::vector<char> extracted(todo.size(), 0);
+        parallelFor(todo.size(), overlapping ? 1 : limit, [&](size_t i) {
+            const auto& e = *todo[i];
+            if (throttle_) throttle_->pace();
+            extracted[i] = PayloadWriter::supports(e.archive)
+                ? PayloadWriter::extract(e.archive, e.idx, rootDir_, throttle_)
+                : TarHandler::extractPayload(e.archive, e.idx, rootDir_);
+            if (onExtracted)
+                onExtracted(e.meta.name + "-" + e.meta.version, ++done, todo.size());
+        });
+        for (size_t i = 0; i < todo.size(); ++i) {
+            if (!extracted[i]) {
+                std::cerr << "\033[31merror:\033[0m Failed to unpack '" << todo[i]->archive
+                          << "'; the root is incomplete and should be rebuilt.\n";
+                return false;
+            }
+        }
+
+        // 5) Every record in one transaction
+        if (!db.beginTransaction()) {
+            std::cerr << "\033[31merror:\033[0m Failed to begin DB transaction.\n";
+            return false;
+        }
+        for (size_t i = 0; i < todo.size(); ++i) {
+            const auto* e = todo[i];
+            bool ok = db.addPackage(e->meta, scriptPaths[i]);
+            for (size_t k = 0; ok && k < e->idx.paths.size(); ++k)
+                ok = db.logFile(e->meta.name, e->idx.paths[k]);
+            if (ok && e->broken) {
+                std::cout << "\033[33mwarning:\033[0m '" << e->meta.name
+                          << "' installed with warnings; marking as broken.\n";
+                ok = db.markBroken(e->meta.name, e->broken);
+            }
+            if (!ok) {
+                std::cerr << "\033[31merror:\033[0m Failed to record '" << e->meta.name << "'.\n";
+                db.rollbackTransaction();
+                return false;
+            }
+        }
+        if (!db.commitTransaction()) {
+            std::cerr << "\033[31merror:\033[0m Failed to commit DB transaction.\n";
+            return false;
+        }
+
+        // 6) Write the database once, before any hook runs: a hook or trigger
+        //    that queries or calls gradient inside the root sees the packages
+        fs::path dbFile(dbPath_);
+        fs::create_directories(dbFile.parent_path(), ec);
+        if (!db.saveTo(dbPath_))
+            return false;
+
+        // 7) Hooks in dependency waves, then each fired trigger once
+        HookRunner hooks(rootDir_, jobs_);
+        TriggerQueue triggers(db);
+        for (size_t i = 0; i < todo.size(); ++i) {
+            const auto* e = todo[i];
+            if (!scriptPaths[i].empty() && !e->broken) {
+                hooks.add({e->meta.name, Tools::bareNames(e->meta.provides),
+                           Tools::bareNames(e->meta.deps), scriptPaths[i], "post_install"});
+            }
+            triggers.pathsChanged(e->idx.paths);
+            for (auto& name : e->meta.activates) triggers.activate(name);
+        }
+        hooks.run();
+        triggers.run(rootDir_);
+
+        // 8) Make everything durable with one sync
+        if (durability_ == Durability::Mode::None)
+            return true;
+        bool synced = Durability::syncFilesystem(rootDir_);
+        struct stat rootSt{}, dbSt{};
+        if (::stat(rootDir_.c_str(), &rootSt) == 0
+            && ::stat(dbFile.parent_path().c_str(), &dbSt) == 0
+            && rootSt.st_dev != dbSt.st_dev)
+        {
+            synced = Durability::syncFilesystem(dbFile.parent_path().string()) && synced;
+        }
+        if (!synced) {
+            std::cerr << "\033[33mwarning:\033[0m syncfs on '" << rootDir_ << "' failed: "
+                      << std::strerror(errno) << "\n";
+        }
+        return true;
+    }
+
+} // namespace gradient
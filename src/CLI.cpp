@@ -2,22 +2,26 @@
 // Created by cv2 on 6/12/25.
 
 #include "CLI.h"
-#include "Installer.h"
-#include "Repository.h"
+#include "Auditor.h"
+#include "Daemon.h"
+#include "IoPolicy.h"
+#include "ObjectStore.h"
 #include "Database.h"
+#include "Output.h"
+#include "RepoIndex.h"
+#include "Session.h"
 #include "cxxopts.h"
 
+#include <algorithm>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
-#include <future>
 #include <yaml-cpp/yaml.h>
 #include <yaml-cpp/exceptions.h>
 #include <yaml-cpp/node/node.h>
 #include <yaml-cpp/node/parse.h>
 
 #include "tools.h"
-#include "DownloadHelper.h"
 
 namespace fs = std::filesystem;
 
@@ -30,6 +34,33 @@ CLI::CLI(int argc, char* argv[])
     , parseOutput_(false)
 {}
 
+namespace {
+    /// "500K", "2M", "1048576": bytes per second, 1024-based suffixes.
+    bool parseRate(const std::string& text, std::uint64_t& out) {
+        size_t used = 0;
+        try {
+            out = std::stoull(text, &used);
+        } catch (const std::exception&) {
+            return false;
+        }
+        const std::string unit = text.substr(used);
+        if (unit == "K" || unit == "k") out <<= 10;
+        else if (unit == "M" || unit == "m") out <<= 20;
+        else if (unit == "G" || unit == "g") out <<= 30;
+        else if (!unit.empty()) return false;
+        return out > 0;
+    }
+
+    /// Commands that change the system, its repos or the store. Checked
+    /// before the session opens anything, so a refused user leaves no trace.
+    bool requiresRoot(const std::string& cmd) {
+        return cmd == "install-bin" || cmd == "install" || cmd == "bootstrap"
+            || cmd == "remove" || cmd == "system-update" || cmd == "fetch"
+            || cmd == "stage" || cmd == "apply" || cmd == "audit" || cmd == "store-gc"
+            || cmd == "add-repo" || cmd == "sync-repo" || cmd == "remove-repo";
+    }
+}
+
 void checkUID() {
     if (geteuid() != 0) {
         std::cerr << "\033[31merror:\033[0m this operation requires root privileges\n";\
@@ -48,6 +79,17 @@ void CLI::run() {
         ("f,force",     "Force action (ignore warnings)",   cxxopts::value<bool>(force_))
         ("b,bootstrap", "Bootstrap directory prefix",       cxxopts::value<std::string>(bootstrapDir_))
         ("p,parse",     "Parseable output",                 cxxopts::value<bool>(parseOutput_))
+        ("j,jobs",      "Parallel jobs (0 = one per CPU)",  cxxopts::value<unsigned>(jobs_))
+        ("lock-timeout", "Seconds to wait for another writer", cxxopts::value<int>(lockTimeout_))
+        ("layers",      "export-image: one tar per package", cxxopts::value<bool>(layers_))
+        ("store",       "Install files from the shared content-addressed store", cxxopts::value<bool>(store_))
+        ("durability",  "Flush before commit: none, syncfs (default) or file", cxxopts::value<std::string>(durability_))
+        ("gentle",      "Low CPU/IO priority; keep installs out of the page cache", cxxopts::value<bool>(gentle_))
+        ("background",  "Idle priority, capped downloads, back off when the disk is busy", cxxopts::value<bool>(background_))
+        ("limit-rate",  "Download rate cap in bytes/s, K/M/G suffixes (default 1M with --background)",
+                        cxxopts::value<std::string>(limitRate_))
+        ("segments",    "Parallel connections per large download (1 = single stream)",
+                        cxxopts::value<unsigned>(segments_))
         ("h,help",      "Print help");
 
     // Parse
@@ -66,354 +108,172 @@ void CLI::run() {
     std::string cmd = unmatched[0];
     std::vector<std::string> args(unmatched.begin() + 1, unmatched.end());
 
-    // Prepare bootstrap paths
-    std::string rootPrefix = bootstrapDir_.empty() ? "" : bootstrapDir_;
-    // if (!rootPrefix.empty()) {
-    //     rootPrefix.pop_back();
-    // }
-    fs::path dbDir = fs::path(rootPrefix).string() + "/var/lib/gradient/";
-    std::error_code ec;
-    if (!fs::exists(dbDir)) {
-        fs::create_directories(dbDir, ec);
-        if (ec) {
-            std::cerr << "\033[31merror:\033[0m cannot create directory '"
-                      << dbDir << "': " << ec.message() << "\n";
-            return;
+    // owns takes its batch from stdin when no paths are given
+    if (cmd == "owns") {
+        if (args.empty()) {
+            for (std::string line; std::getline(std::cin, line); ) {
+                if (!line.empty()) args.push_back(line);
+            }
         }
+        for (auto& a : args) a = Tools::normalizePath(a);
     }
-    fs::path dbPath = dbDir / "gradient.db";
 
-    fs::path repoDir = fs::path(rootPrefix).string() + "/var/lib/gradient/repos";
-    if (!fs::exists(repoDir)) {
-        fs::create_directories(repoDir, ec);
-        if (ec) {
-            std::cerr << "\033[31merror:\033[0m cannot create directory '"
-                      << repoDir << "': " << ec.message() << "\n";
+    if (requiresRoot(cmd)) checkUID();
+
+    // Read-only commands go to gradientd when it is running
+    if (bootstrapDir_.empty() && Daemon::isReadCommand(cmd) && !std::getenv("GRADIENT_NO_DAEMON")) {
+        if (Daemon::forward(Daemon::kDefaultSocket, cmd, args, parseOutput_))
             return;
-        }
     }
 
-    // Open DB and Repo
-    Database db(dbPath.string());
-    if (!db.open() || !db.initSchema()) {
-        std::cerr << "\033[31merror:\033[0m Unable to open or initialize database at "
-                  << dbPath << "\n";
+    // Open the database and repos through the library.
+    // Installs always resolve against the host's repos, even when bootstrapping.
+    SessionOptions sopts;
+    sopts.root = bootstrapDir_.empty() ? "/" : bootstrapDir_;
+    sopts.force = force_;
+    sopts.jobs = jobs_;
+    sopts.lockTimeout = std::chrono::seconds(lockTimeout_);
+    sopts.gentle = gentle_ || background_;
+    sopts.background = background_;
+    sopts.downloadSegments = segments_;
+    if (!limitRate_.empty() || background_) {
+        if (!parseRate(limitRate_.empty() ? "1M" : limitRate_, sopts.maxDownloadRate)) {
+            std::cerr << "\033[31merror:\033[0m invalid rate '" << limitRate_ << "'\n";
+            return;
+        }
+    }
+    // fetch and stage plan against the same repos as the command they prepare for
+    const bool prepares = cmd == "fetch" || cmd == "stage";
+    const bool planUpgrades = prepares && args.size() == 1 && args[0] == "--system-update";
+    if (cmd == "install" || cmd == "bootstrap" || (prepares && !planUpgrades))
+        sopts.repoDir = "/var/lib/gradient/repos";
+    // Archives come from the host's repos, so they are cached on the host too
+    sopts.cacheDir = "/var/cache/gradient/pkgs";
+    // The store is the host's, shared by every root
+    if (store_) sopts.storeDir = ObjectStore::kDefaultDir;
+    if (!Durability::parse(durability_, sopts.durability)) {
+        std::cerr << "\033[31merror:\033[0m unknown durability '" << durability_
+                  << "' (expected none, syncfs or file)\n";
         return;
     }
-    Repository repo(/* url */"", repoDir.string());
+    // An image on stdout must not share it with progress output
+    const bool toStdout = cmd == "export-image" && !args.empty() && args[0] == "-";
+    if (toStdout) sopts.interactive = false;
+    Session session(sopts);
+
+    // Open only what the command needs: repo-only commands and store-gc never
+    // touch the database, and read commands open it read-only without running DDL.
+    const bool repoOnly = cmd == "add-repo" || cmd == "sync-repo"
+                       || cmd == "remove-repo" || cmd == "query" || cmd == "store-gc";
+    if (cmd == "export-image") {
+        // Images start empty: resolve as if nothing were installed
+        if (!session.openScratch())
+            return;
+    } else if (!repoOnly) {
+        // fetch only reads the database to plan against what is installed
+        const bool readOnly = Daemon::isReadCommand(cmd) || cmd == "fetch";
+        if (!(readOnly ? session.openReadOnly() : session.open()))
+            return;
+    }
+
+    // Print a header as each package of a resolved plan is installed
+    auto announce = [](const Progress& p) {
+        if (p.stage == Progress::Stage::Install) {
+            std::cout << "\n\033[1;34m📦 Installing \033[1m"
+                      << p.package << "\033[0m\n";
+        }
+    };
 
     // Dispatch commands
     if (cmd == "install-bin") {
-        checkUID();
         if (args.empty()) {
             std::cerr << "\033[31merror:\033[0m 'install' requires at least one .apkg path\n";
             return;
         }
-        std::string installRoot = rootPrefix.empty() ? "/" : rootPrefix;
-        Installer inst(db, repo, force_, installRoot);
-        for (auto& pkg : args) {
-            if (!inst.installArchive(pkg)) {
-                std::cerr << "\033[31merror:\033[0m Failed to install '" << pkg << "'\n";
-            }
-        }
+        session.installArchives(args).get();
     }
     else if (cmd == "install") {
-        checkUID();
-        static std::mutex cout_mtx;
-        // 1) Locate repos base directory
-        fs::path repoBase = fs::path("/var/lib/gradient/repos");
-        if (!fs::exists(repoBase) || !fs::is_directory(repoBase)) {
-            std::cerr << "\033[31merror:\033[0m system repos directory '"
-                      << repoBase << "' does not exist\n";
+        // 1) Resolve the request and its missing dependencies
+        auto plan = session.resolve(args).get();
+        if (!plan)
             return;
-        }
 
-        if (!fs::exists(repoBase) || !fs::is_directory(repoBase)) {
-            std::cerr << "\033[31merror:\033[0m repos directory '"
-                      << repoBase << "' does not exist\n";
-            return;
+        for (auto const& p : plan->skipped) {
+            std::cout << "\033[32minfo:\033[0m "
+                      << p.pkgname << "-" << p.pkgver
+                      << " already installed; skipping\n";
         }
-
-        // 2) Build a mapping of package name -> list of available repo entries
-        struct RepoPkg {
-            std::string pkgname, pkgver, arch, filename, repoUrl;
-            std::vector<std::string> depends;
-            std::vector<std::string> provides;
-            int priority{};
-            std::string repoName;
-        };
-        std::unordered_map<std::string, std::vector<RepoPkg>> pkgMap;
-
-        for (auto& entry : fs::directory_iterator(repoBase)) {
-            if (entry.path().extension() != ".json") continue;
-            std::string repoName = entry.path().stem();
-            // Load the repo descriptor (name/url/priority)
-            YAML::Node desc;
-            try { desc = YAML::LoadFile(entry.path().string()); }
-            catch (const YAML::Exception& e) {
-                std::cerr << "\033[31merror:\033[0m parsing " << entry.path().filename()
-                          << ": " << e.what() << "\n";
-                continue;
-            }
-            auto url             = desc["url"].as<std::string>();
-            int priority         = desc["priority"].as<int>();
-
-            // Load the remote index we synced earlier
-            fs::path indexFile = repoBase / repoName / "repo.json";
-            if (!fs::exists(indexFile)) continue;
-
-            YAML::Node idx;
-            try { idx = YAML::LoadFile(indexFile.string()); }
-            catch (const YAML::Exception& e) {
-                std::cerr << "\033[31merror:\033[0m parsing " << indexFile.filename()
-                          << ": " << e.what() << "\n";
-                continue;
-            }
-            auto packages = idx["packages"];
-            if (!packages || !packages.IsSequence()) continue;
-
-            for (const auto& node : packages) {
-                RepoPkg rp;
-                rp.pkgname   = node["pkgname"].as<std::string>();
-                rp.pkgver    = node["pkgver"].as<std::string>();
-                rp.arch      = node["arch"].as<std::string>();
-                rp.filename  = node["filename"].as<std::string>();
-                rp.repoUrl   = url;
-                rp.priority  = priority;
-                rp.repoName  = repoName;
-
-                // Dependencies
-                if (node["depends"]) {
-                    for (const auto& dnode : node["depends"])
-                        rp.depends.push_back(dnode.as<std::string>());
-                }
-
-                // Provides (strip version suffix after '=')
-                if (node["provides"]) {
-                    for (const auto& pnode : node["provides"]) {
-                        auto prov = pnode.as<std::string>();
-                        if (auto eq = prov.find('='); eq != std::string::npos)
-                            prov.resize(eq);
-                        rp.provides.push_back(prov);
-                    }
-                }
-
-                // 1) Always index under its real name
-                pkgMap[rp.pkgname].push_back(rp);
-
-                // 2) Also index under each provided name, but skip the case prov==pkgname
-                for (const auto& prov : rp.provides) {
-                    if (prov == rp.pkgname)
-                        continue;    // <-- this line avoids self‐cycle on "libcap"
-                    pkgMap[prov].push_back(rp);
-                }
-            }
-        }
-
-        // 3) Resolve dependencies (DFS, picking highest-priority entries)
-        std::vector<RepoPkg> installOrder;
-    std::unordered_set<std::string> visited, inStack;
-
-    auto dfs = [&](auto& self, const std::string& raw_req) -> bool {
-    // 1) Parse name + optional version operator
-    const Tools::Constraint c = Tools::parseConstraint(raw_req);
-    const std::string& name = c.name;
-
-    // 2) If we've already visited or the package is installed and satisfies the version, skip it
-    if (visited.contains(name))
-        return true;
-
-    if (std::string instVer; db.getPackageVersion(name, instVer) &&
-                             (c.op.empty() || Tools::evalConstraint(instVer, c)))
-    {
-        visited.insert(name);
-        return true;
-    }
-
-    // 3) Lookup candidates by base name
-    auto it = pkgMap.find(name);
-    if (it == pkgMap.end()) {
-        std::cerr << "\033[31merror:\033[0m package '"
-                  << raw_req << "' not found in any repo\n";
-        return false;
-    }
-
-    // 4) Filter by version constraint
-    std::vector<RepoPkg> candidates;
-    for (auto& rp : it->second) {
-        if (c.op.empty() || Tools::evalConstraint(rp.pkgver, c)) {
-            candidates.push_back(rp);
-        }
-    }
-    if (candidates.empty()) {
-        std::cerr << "\033[31merror:\033[0m no candidate for '"
-                  << raw_req << "'\n";
-        return false;
-    }
-
-    // 5) Prefer real pkgname == name over pure providers
-    std::vector<RepoPkg> realOnly;
-    for (auto& rp : candidates) {
-        if (rp.pkgname == name) realOnly.push_back(rp);
-    }
-    if (!realOnly.empty()) candidates = std::move(realOnly);
-
-    // 6) Sort by priority, then version
-    std::sort(candidates.begin(), candidates.end(),
-        [](auto const& a, auto const& b) {
-            if (a.priority != b.priority)
-                return a.priority > b.priority;
-            return Tools::versionCompare(a.pkgver, b.pkgver) > 0;
-        });
-    const RepoPkg& best = candidates[0];
-
-    // 7) Cycle detection
-    if (inStack.count(name)) {
-        std::lock_guard<std::mutex> lk(cout_mtx);
-        std::cout << "  \033[33mwarning:\033[0m cycle on '" << name
-                  << "', skipping\n";
-        visited.insert(name);
-        return true;
-    }
-    inStack.insert(name);
-
-    // 8) Recurse into its dependencies (passing raw strings so version matters)
-    for (auto const& raw_dep : best.depends) {
-        Tools::Constraint dc = Tools::parseConstraint(raw_dep);
-        const std::string& dn = dc.name;
-
-        // skip SONAMEs
-        if (dn.find(".so") != std::string::npos) continue;
-        // skip self‐depend
-        if (dn == name) continue;
-        // installed & matching version?
-        std::string dv;
-        if (db.getPackageVersion(dn, dv) &&
-            (dc.op.empty() || Tools::evalConstraint(dv, dc)))
-        {
-            continue;
-        }
-
-        if (!self(self, raw_dep))
-            return false;
-    }
-
-    // 9) Done with this package
-    inStack.erase(name);
-    visited.insert(name);
-    installOrder.push_back(best);
-    return true;
-};
-
-// Kick it off with raw args (which may include version qualifiers)
-for (auto const& r : args) {
-    if (!dfs(dfs, r))
-        return;
-}
-
-        std::vector<RepoPkg> toInstall;
-        toInstall.reserve(installOrder.size());
-
-        for (auto const& p : installOrder) {
-            std::string instVer;
-            bool already = db.getPackageVersion(p.pkgname, instVer)
-                           && instVer == p.pkgver;
-            if (already) {
-                // Inform the user (optional)
-                std::cout << "\033[32minfo:\033[0m "
-                          << p.pkgname << "-" << p.pkgver
-                          << " already installed; skipping\n";
-            } else {
-                toInstall.push_back(p);
-            }
-        }
-
-        // Swap back into installOrder
-        installOrder.swap(toInstall);
-
-        if (installOrder.empty()) {
+        if (plan->packages.empty()) {
             std::cout << "\033[32minfo:\033[0m all requested packages are already installed\n";
             return;
         }
 
-
-        fs::path tmp = fs::temp_directory_path() / "grad_pkgs";
-        if (!fs::exists(tmp)) {
-            fs::create_directory(tmp);
+        // 2) Download (preferring deltas) and install in order
+        if (session.install(std::move(*plan), announce).get())
+            std::cout << "\033[32msuccess:\033[0m All packages installed.\n";
+    }
+    else if (cmd == "bootstrap") {
+        // Usage: gradient -b <root> bootstrap <package|file.apkg>...
+        if (bootstrapDir_.empty()) {
+            std::cerr << "\033[31merror:\033[0m 'bootstrap' needs a root; pass it with -b <dir>\n";
+            return;
         }
-
-        // Initialize curl once
-        curl_global_init(CURL_GLOBAL_DEFAULT);
-
-        // We'll collect futures here
-        std::vector<std::future<bool>> futures;
-        futures.reserve(installOrder.size());
-
-        // A mutex to serialize progress‐bar prints
-        static std::mutex printMutex;
-
-        // Launch one download task per package
-        for (size_t i = 0; i < installOrder.size(); ++i) {
-            const auto& p = installOrder[i];
-            std::string url = p.repoUrl + "/" + p.filename;
-            fs::path out   = tmp / p.filename;
-
-            // Copy the context by value so each thread has its own
-            DownloadContext ctx{
-                int(i+1),
-                int(installOrder.size()),
-                p.pkgname + "-" + p.pkgver,
-                &printMutex
-            };
-
-            // async launch
-            futures.push_back(std::async(std::launch::async,
-                [url, out, ctx]() mutable {
-                    return downloadWithCurl(url, out.string(), ctx);
-                }
-            ));
+        if (args.empty()) {
+            std::cerr << "\033[31merror:\033[0m 'bootstrap' requires at least one package\n";
+            return;
         }
-
-        // Wait for all to finish
-        bool allOk = true;
-        for (auto& fut : futures) {
-            if (!fut.get()) {
-                allOk = false;
-                break;
+        bool ok;
+        if (std::ranges::all_of(args, [](auto& a) { return a.ends_with(".apkg"); })) {
+            ok = session.bootstrapArchives(args, announce).get();
+        } else {
+            auto plan = session.resolve(args).get();
+            if (!plan)
+                return;
+            if (plan->packages.empty()) {
+                std::cout << "\033[32minfo:\033[0m all requested packages are already installed\n";
+                return;
             }
+            ok = session.bootstrap(std::move(*plan), announce).get();
         }
-
-        curl_global_cleanup();
-
-        if (!allOk) {
-            std::cerr << "\n\033[31merror:\033[0m one or more downloads failed; aborting install\n";
+        if (ok)
+            std::cout << "\033[32msuccess:\033[0m Bootstrap of '" << bootstrapDir_ << "' complete.\n";
+    }
+    else if (cmd == "export-image") {
+        // Usage: gradient export-image [--layers] <out.tar|-|dir> <package|file.apkg>...
+        if (args.size() < 2) {
+            std::cerr << "\033[31merror:\033[0m 'export-image' requires an output and at least one package\n";
             return;
         }
-
-        std::unordered_set<std::string> staged;
-        for (auto const& p : installOrder)
-            staged.insert(p.pkgname);
-
-        // 5) Install each downloaded archive in order
-        std::string installRoot = bootstrapDir_.empty() ? "/" : bootstrapDir_;
-        Installer inst(db, repo, force_, installRoot, staged);
-
-        for (auto const& p : installOrder) {
-            fs::path pkgPath = tmp / p.filename;
-            std::cout << "\n\033[1;34m📦 Installing \033[1m"
-                      << p.pkgname << "-" << p.pkgver << "\033[0m\n";
-            if (!inst.installArchive(pkgPath.string())) {
-                std::cerr << "\033[31merror:\033[0m Failed to install '"
-                          << p.pkgname << "'\n";
+        const std::string out = args[0];
+        std::vector<std::string> pkgs(args.begin() + 1, args.end());
+        ProgressFn progress = toStdout ? ProgressFn{} : ProgressFn{[](const Progress& p) {
+            if (p.stage == Progress::Stage::Install)
+                std::cout << "\033[1;34m📦 Exported \033[1m" << p.package << "\033[0m\n";
+        }};
+        bool ok;
+        if (std::ranges::all_of(pkgs, [](auto& a) { return a.ends_with(".apkg"); })) {
+            ok = session.exportArchives(pkgs, out, layers_, progress).get();
+        } else {
+            auto plan = session.resolve(pkgs).get();
+            if (!plan)
                 return;
-            }
+            ok = session.exportImage(std::move(*plan), out, layers_, progress).get();
         }
-
-        std::cout << "\033[32msuccess:\033[0m All packages installed.\n";
-
+        if (ok && !toStdout)
+            std::cout << "\033[32msuccess:\033[0m Image written to '" << out << "'.\n";
+    }
+    else if (cmd == "store-gc") {
+        // Usage: gradient store-gc   (drop store objects no root links to)
+        ObjectStore store(ObjectStore::kDefaultDir);
+        if (!fs::exists(store.dir())) {
+            std::cout << "\033[32minfo:\033[0m no store at '" << store.dir() << "'\n";
+            return;
+        }
+        auto stats = store.gc();
+        std::cout << "\033[32msuccess:\033[0m removed " << stats.removed << " objects ("
+                  << stats.bytes / 1024 << " KiB), " << stats.kept << " still in use.\n";
     }
     else if (cmd == "remove") {
-        checkUID();
         if (!bootstrapDir_.empty()) {
             std::cerr << "\033[31merror:\033[0m Cannot remove packages when bootstrapping.\n";
             return;
@@ -422,15 +282,9 @@ for (auto const& r : args) {
             std::cerr << "\033[31merror:\033[0m 'remove' requires at least one package name\n";
             return;
         }
-        Installer inst(db, repo, force_, /*rootDir=*/"/");
-        for (auto& pkg : args) {
-            if (!inst.removePackage(pkg)) {
-                std::cerr << "\033[31merror:\033[0m Failed to remove '" << pkg << "'\n";
-            }
-        }
+        session.remove(args).get();
     }
     else if (cmd == "add-repo") {
-        checkUID();
         // Usage: gradient add-repo <name> <url> [priority]
         if (args.size() < 2) {
             std::cerr << "\033[31merror:\033[0m 'add-repo' requires a <name> and a <url>\n";
@@ -490,7 +344,8 @@ for (auto const& r : args) {
                   << priority << "\n";
     }
     else if (cmd == "sync-repo") {
-        checkUID();
+        // Runs here rather than in the session; curl inherits the priority
+        if (background_) IoPolicy::lowerPriority(true);
         // Determine the repos directory
     fs::path repoBase = bootstrapDir_.empty()
         ? fs::path("/var/lib/gradient/repos")
@@ -541,6 +396,8 @@ for (auto const& r : args) {
 
         std::string command = "curl -fsSL '" + remoteIndexUrl +
                           "' -o '" + indexFile.string() + "'";
+        if (sopts.maxDownloadRate)
+            command += " --limit-rate " + std::to_string(sopts.maxDownloadRate);
         if (int rc = std::system(command.c_str()); rc != 0) {
             std::cout << "\033[31m✖ failed\033[0m\n";
         } else {
@@ -551,7 +408,6 @@ for (auto const& r : args) {
     std::cout << "\033[1;34m🔄 Sync complete.\033[0m\n";
     }
     else if (cmd == "remove-repo") {
-        checkUID();
         // Usage: gradient remove-repo <name>
         if (args.empty()) {
             std::cerr << "\033[31merror:\033[0m 'remove-repo' requires a repository name\n";
@@ -606,43 +462,110 @@ for (auto const& r : args) {
         std::cout << "\033[32msuccess:\033[0m repository '" << name << "' removed\n";
     }
     else if (cmd == "system-update") {
-        checkUID();
-        std::cout << "\033[32minfo:\033[0m system-update command invoked\n";
+        auto plan = session.resolveUpgrades().get();
+        if (!plan)
+            return;
+        if (plan->packages.empty()) {
+            std::cout << "\033[32minfo:\033[0m system is up to date\n";
+            return;
+        }
+
+        std::cout << "\033[1;34m🔄 Upgrading " << plan->packages.size() << " package(s)\033[0m\n";
+        if (session.install(std::move(*plan), announce).get())
+            std::cout << "\033[32msuccess:\033[0m All packages installed.\n";
     }
-    else if (cmd == "audit") {
-        checkUID();
-        // 1) Fetch broken packages
-        auto broken = db.getBrokenPackages();
-        if (broken.empty()) {
-            std::cout << "\033[32minfo:\033[0m No broken packages found.\n";
+    else if (cmd == "fetch") {
+        // Usage: gradient fetch <package>... | --system-update
+        // Downloads what install / system-update would, into the cache only
+        if (args.empty()) {
+            std::cerr << "\033[31merror:\033[0m 'fetch' requires packages or --system-update\n";
+            return;
+        }
+        auto plan = planUpgrades ? session.resolveUpgrades().get() : session.resolve(args).get();
+        if (!plan)
+            return;
+        if (plan->packages.empty()) {
+            std::cout << "\033[32minfo:\033[0m nothing to fetch\n";
             return;
         }
 
-        // 2) Display them
-        std::cout << "\033[31mbroken packages:\033[0m\n";
-        for (auto& pkg : broken) {
-            std::cout << "  - " << pkg << "\n";
+        std::cout << "\033[1;34m📥 Fetching " << plan->packages.size() << " package(s) into "
+                  << sopts.cacheDir << "\033[0m\n";
+        if (session.fetch(std::move(*plan), sopts.cacheDir).get())
+            std::cout << "\033[32msuccess:\033[0m All packages fetched.\n";
+        else
+            std::cerr << "\n\033[31merror:\033[0m one or more downloads failed\n";
+    }
+    else if (cmd == "stage") {
+        // Usage: gradient stage <package>... | --system-update
+        // Unpacks what install / system-update would, for a later 'apply'
+        if (args.empty()) {
+            std::cerr << "\033[31merror:\033[0m 'stage' requires packages or --system-update\n";
+            return;
+        }
+        auto plan = planUpgrades ? session.resolveUpgrades().get() : session.resolve(args).get();
+        if (!plan)
+            return;
+        if (plan->packages.empty()) {
+            std::cout << "\033[32minfo:\033[0m nothing to stage\n";
+            return;
         }
 
-        // 3) Re-check dependencies & clear fixed ones
+        auto unpacking = [](const Progress& p) {
+            if (p.stage == Progress::Stage::Unpack)
+                std::cout << "\033[1;34m📂 Staging \033[1m" << p.package << "\033[0m\n";
+        };
+        if (session.stage(std::move(*plan), unpacking).get())
+            std::cout << "\033[32msuccess:\033[0m Staged; run 'gradient apply' to install.\n";
+    }
+    else if (cmd == "apply") {
+        if (session.apply(announce).get())
+            std::cout << "\033[32msuccess:\033[0m All packages installed.\n";
+    }
+    else if (cmd == "audit") {
+        // 1) Check the whole installed graph in one pass
+        std::string auditRoot = bootstrapDir_.empty() ? "/" : bootstrapDir_;
+        Auditor auditor(session.database(), auditRoot);
+        auto report = auditor.run();
+
+        // 2) Clear broken_packages rows that no longer apply
         std::vector<std::string> fixed;
-        for (auto& pkg : broken) {
-            auto deps = db.getDependencies(pkg);
-            bool allOk = true;
-            for (auto& dep : deps) {
-                if (!db.isInstalled(dep, "")) {
-                    allOk = false;
-                    break;
-                }
-            }
-            if (allOk) {
-                if (db.removeBroken(pkg)) {
-                    fixed.push_back(pkg);
-                }
+        if (!report.staleBroken.empty()) {
+            auto guard = session.lock();
+            if (!guard) return;
+            for (auto& pkg : report.staleBroken) {
+                if (session.database().removeBroken(pkg)) fixed.push_back(pkg);
             }
         }
 
-        // 4) Show results
+        // 3) Show results
+        if (parseOutput_) {
+            // kind|package|detail
+            for (auto& p : report.unsatisfied)  std::cout << "unsatisfied|" << p.package << '|' << p.detail << "\n";
+            for (auto& p : report.conflicts)    std::cout << "conflict|"    << p.package << '|' << p.detail << "\n";
+            for (auto& p : report.missingFiles) std::cout << "missing|"     << p.package << '|' << p.detail << "\n";
+            for (auto& pkg : fixed)             std::cout << "fixed|"       << pkg << "|\n";
+            return;
+        }
+
+        if (report.unsatisfied.empty() && report.conflicts.empty() && report.missingFiles.empty()) {
+            std::cout << "\033[32minfo:\033[0m No problems found.\n";
+        }
+        if (!report.unsatisfied.empty()) {
+            std::cout << "\033[31munsatisfied dependencies:\033[0m\n";
+            for (auto& p : report.unsatisfied)
+                std::cout << "  - " << p.package << " needs " << p.detail << "\n";
+        }
+        if (!report.conflicts.empty()) {
+            std::cout << "\033[31mconflicts:\033[0m\n";
+            for (auto& p : report.conflicts)
+                std::cout << "  - " << p.package << " conflicts with " << p.detail << "\n";
+        }
+        if (!report.missingFiles.empty()) {
+            std::cout << "\033[31mmissing files:\033[0m\n";
+            for (auto& p : report.missingFiles)
+                std::cout << "  - " << p.package << ": " << p.detail << "\n";
+        }
         if (!fixed.empty()) {
             std::cout << "\033[32minfo:\033[0m Packages now fixed:\n";
             for (auto& pkg : fixed) {
@@ -656,31 +579,14 @@ for (auto const& r : args) {
             return;
             }
 
-        // Index installed packages by name
-        auto pkgs = db.listPackages();
-        std::unordered_map<std::string, PackageInfo> idx;
-        for (auto& p : pkgs) idx[p.name] = p;
-
+        // One point lookup per name
         for (auto& name : args) {
-            auto it = idx.find(name);
-            if (it == idx.end()) {
-                std::cerr << "\033[31merror:\033[0m Package '"
-                << name << "' is not installed\n";
+            PackageInfo pkg;
+            if (!session.database().getPackage(name, pkg)) {
+                Output::notInstalled(std::cerr, name);
                 continue;
                 }
-            auto& pkg = it->second;
-            if (parseOutput_) {
-                // name|version|arch
-                std::cout
-                << pkg.name    << '|'
-                << pkg.version << '|'
-                << pkg.arch    << "\n";
-                } else {
-                    std::cout << "\n"
-                    << "\033[1;36m📄 Package:\033[0m \033[1m" << pkg.name << "\033[0m\n"
-                    << "  \033[1mVersion:\033[0m " << pkg.version << "\n"
-                    << "  \033[1mArch:\033[0m    " << pkg.arch << "\n";
-                    }
+            Output::packageInfo(std::cout, pkg, parseOutput_);
             }
         }
     else if (cmd == "query") {
@@ -689,8 +595,6 @@ for (auto const& r : args) {
         std::cerr << "\033[31merror:\033[0m 'query' requires a search pattern\n";
         return;
     }
-    std::string pattern = args[0];
-    std::transform(pattern.begin(), pattern.end(), pattern.begin(), ::tolower);
 
     // Find repos directory
     fs::path repoBase = bootstrapDir_.empty()
@@ -703,118 +607,21 @@ for (auto const& r : args) {
         return;
     }
 
-    bool anyMatch = false;
-    // Iterate over each repo descriptor (<name>.json)
-    for (auto& entry : fs::directory_iterator(repoBase)) {
-        if (entry.path().extension() != ".json")
-            continue;
-
-        std::string repoName = entry.path().stem();
-        fs::path indexPath = repoBase / repoName / "repo.json";
-
-        if (!fs::exists(indexPath)) {
-            if (!parseOutput_) {
-                std::cerr << "\033[33minfo:\033[0m repo '"
-                          << repoName << "' not synced; skipping\n";
-            }
-            continue;
-        }
-
-        // Load the remote index (JSON is valid YAML)
-        YAML::Node idx;
-        try {
-            idx = YAML::LoadFile(indexPath.string());
-        } catch (const YAML::Exception& e) {
-            std::cerr << "\033[31merror:\033[0m failed to parse '"
-                      << indexPath.filename() << "': " << e.what() << "\n";
-            continue;
-        }
-
-        auto packages = idx["packages"];
-        if (!packages || !packages.IsSequence())
-            continue;
-
-        bool printedHeader = false;
-        for (const auto& pkg : packages) {
-            auto name    = pkg["pkgname"].as<std::string>();
-            std::string lowName = name;
-            std::ranges::transform(lowName, lowName.begin(), ::tolower);
-
-            if (lowName.find(pattern) == std::string::npos)
-                continue;
-
-            anyMatch = true;
-            auto ver   = pkg["pkgver"].as<std::string>();
-            auto arch  = pkg["arch"].as<std::string>();
-            auto file  = pkg["filename"].as<std::string>();
-            auto desc  = pkg["description"].as<std::string>();
-
-            if (parseOutput_) {
-                // repo|name|version|arch|filename
-                std::cout
-                  << repoName << '|'
-                  << name     << '|'
-                  << ver      << '|'
-                  << arch     << '|'
-                  << file     << "\n";
-            } else {
-                if (!printedHeader) {
-                    std::cout << "\033[1;35mRepository:\033[0m \033[1m"
-                              << repoName << "\033[0m\n";
-                    printedHeader = true;
-                }
-                std::cout
-                  << "  \033[32m•\033[0m " << name
-                  << " \033[90m" << ver << "\033[0m"
-                  << " [" << arch << "]\n"
-                  << "      " << desc << "\n";
-            }
-        }
+    RepoIndex index(repoBase);
+    index.load();
+    Output::query(std::cout, std::cerr, index, args[0], parseOutput_);
     }
-
-    if (!anyMatch && !parseOutput_) {
-        std::cout << "\033[33minfo:\033[0m no packages matching '"
-                  << args[0] << "' found in any repo\n";
-    }
-
+    else if (cmd == "owns") {
+        // Usage: gradient owns <path>...   (no paths: read one per line from stdin)
+        Output::owners(std::cout, args, session.database().getOwners(args), parseOutput_);
     }
     else if (cmd == "list") {
         // Fetch all installed packages (with broken flag)
-        auto pkgs = db.listPackages();
-
-        if (parseOutput_) {
-            // machine‐friendly: name|version|arch|broken
-            for (auto& p : pkgs) {
-                std::cout
-                  << p.name    << '|'
-                  << p.version << '|'
-                  << p.arch    << '|'
-                  << (p.broken ? '1' : '0')
-                  << "\n";
-            }
-        } else {
-            // human‐friendly
-            std::cout << "\n\033[1;34m📦 Installed Packages\033[0m\n\n";
-            for (auto& p : pkgs) {
-                // green check or yellow warning
-                const char* sym   = p.broken ? "⚠" : "✔";
-                const char* color = p.broken ? "\033[33m" : "\033[32m";
-
-                std::cout
-                  << "  "
-                  << color << sym << " "
-                  << "\033[1m" << p.name << "\033[0m"
-                  << " \033[90m" << p.version << "\033[0m"
-                  << " (" << p.arch << ")"
-                  << "\033[0m\n";
-            }
-            std::cout << "\n";
-        }
+        Output::packageList(std::cout, session.database().listPackages(), parseOutput_);
     }
     else if (cmd == "count") {
-        // Fetch and print the count
-        auto pkgs = db.listPackages();
-        std::cout << pkgs.size() << "\n";
+        // Aggregate in SQL instead of loading every row
+        std::cout << session.database().countPackages() << "\n";
     }
     else {
         std::cerr << "\033[31merror:\033[0m Unknown command '" << cmd << "'\n";
@@ -0,0 +1,63 @@
+// src/ConflictChecker.cpp
+
+#include "ConflictChecker.h"
+#include "Package.h"
+#include "TarHandler.h"
+#include "tools.h"
+
+#include <iostream>
+
+namespace gradient {
+
+    ConflictChecker::ConflictChecker(const Database& db)
+        : db_(db) {}
+
+    bool ConflictChecker::addArchive(const std::string& archivePath) {
+        Package pkg(archivePath);
+        ArchiveIndex idx;
+        std::string script;
+        if (!pkg.inspect(idx, script)) return false;
+        addPackage(pkg.metadata().name, idx.paths, pkg.metadata().replaces);
+        return true;
+    }
+
+    void ConflictChecker::addPackage(const std::string& name,
+                                     const std::vector<std::string>& paths,
+                                     const std::vector<std::string>& replaces) {
+        auto& mayTake = replaces_[name];
+        mayTake.insert(name);
+        for (auto& r : replaces) mayTake.insert(Tools::parseConstraint(r).name);
+
+        for (auto& p : paths) {
+            auto [it, fresh] = incoming_.try_emplace(p, name);
+            if (!fresh && it->second != name) {
+                internal_.push_back({p, name, it->second, true});
+            } else if (fresh) {
+                order_.push_back(p);
+            }
+        }
+    }
+
+    std::vector<FileConflict> ConflictChecker::check() const {
+        std::vector<FileConflict> out = internal_;
+
+        // One batched probe of the ownership index for the whole transaction.
+        // A file may change hands only to a new version of its owner or to
+        // a package that replaces it, not to anyone else in the transaction.
+        for (auto& [path, owner] : db_.getOwners(order_)) {
+            const std::string& incoming = incoming_.at(path);
+            if (replaces_.at(incoming).contains(owner)) continue;
+            out.push_back({path, incoming, owner, false});
+        }
+        return out;
+    }
+
+    void ConflictChecker::report(const std::vector<FileConflict>& conflicts) {
+        for (auto& c : conflicts) {
+            std::cerr << "\033[33mwarning:\033[0m " << c.incoming << ": '" << c.path
+                      << "' is already " << (c.inTransaction ? "shipped by " : "owned by ")
+                      << c.owner << "\n";
+        }
+    }
+
+} // namespace gradient
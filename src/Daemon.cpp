@@ -0,0 +1,255 @@
+// src/Daemon.cpp
+
+#include "Daemon.h"
+#include "Output.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+        constexpr Clock::time_point kNoDeadline = Clock::time_point::max();
+
+        /// Largest request gradientd reads, all frames together, and how long
+        /// a client gets to send it and to take the answer: the socket is
+        /// open to every local user and one connection is served at a time.
+        constexpr size_t kMaxRequest = 1u << 20;
+        constexpr std::chrono::seconds kRequestTime{2}, kResponseTime{5};
+        /// How long the CLI waits on a daemon before running in-process.
+        constexpr timeval kClientTimeout{5, 0};
+
+        /// Wait for `events` on `fd` until `deadline`.
+        bool ready(int fd, short events, Clock::time_point deadline) {
+            if (deadline == kNoDeadline) return true;
+            for (;;) {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - Clock::now()).count();
+                if (left <= 0) return false;
+                pollfd p{fd, events, 0};
+                int n = ::poll(&p, 1, static_cast<int>(left));
+                if (n < 0 && errno == EINTR) continue;
+                return n > 0;
+            }
+        }
+
+        bool writeAll(int fd, const void* data, size_t len, Clock::time_point deadline = kNoDeadline) {
+            auto p = static_cast<const char*>(data);
+            while (len > 0) {
+                if (!ready(fd, POLLOUT, deadline)) return false;
+                ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                p += n;
+                len -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        bool readAll(int fd, void* data, size_t len, Clock::time_point deadline = kNoDeadline) {
+            auto p = static_cast<char*>(data);
+            while (len > 0) {
+                if (!ready(fd, POLLIN, deadline)) return false;
+                ssize_t n = ::recv(fd, p, len, 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                p += n;
+                len -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        bool writeString(int fd, const std::string& s, Clock::time_point deadline = kNoDeadline) {
+            auto len = static_cast<uint32_t>(s.size());
+            return writeAll(fd, &len, sizeof len, deadline) && writeAll(fd, s.data(), s.size(), deadline);
+        }
+
+        /// Read one frame of at most `budget` bytes, which it uses up.
+        bool readString(int fd, std::string& s, size_t& budget,
+                        Clock::time_point deadline = kNoDeadline) {
+            uint32_t len = 0;
+            if (!readAll(fd, &len, sizeof len, deadline) || len > budget) return false;
+            budget -= len;
+            s.resize(len);
+            return readAll(fd, s.data(), len, deadline);
+        }
+
+        sockaddr_un socketAddress(const std::string& path) {
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            return addr;
+        }
+    }
+
+    Daemon::Daemon(std::string rootPrefix, std::string socketPath)
+        : rootPrefix_(std::move(rootPrefix))
+        , socketPath_(std::move(socketPath))
+        , repos_(fs::path(rootPrefix_ + "/var/lib/gradient/repos"))
+    {}
+
+    Daemon::~Daemon() {
+        if (listenFd_ >= 0) {
+            close(listenFd_);
+            unlink(socketPath_.c_str());
+        }
+    }
+
+    bool Daemon::isReadCommand(const std::string& cmd) {
+        return cmd == "list" || cmd == "count" || cmd == "info"
+            || cmd == "owns" || cmd == "query";
+    }
+
+    void Daemon::refresh() {
+        // Another connection committed: rebuild the installed snapshot
+        if (int v = db_->dataVersion(); v != dataVersion_) {
+            installed_ = db_->listPackages();
+            byName_.clear();
+            for (size_t i = 0; i < installed_.size(); ++i) byName_.emplace(installed_[i].name, i);
+            dataVersion_ = v;
+        }
+        if (repos_.stale()) repos_.load();
+    }
+
+    std::string Daemon::handle(const std::vector<std::string>& request, std::string& err) {
+        std::ostringstream out, errs;
+        const bool parse = request[0] == "1";
+        const std::string& cmd = request[1];
+        const std::vector<std::string> args(request.begin() + 2, request.end());
+
+        refresh();
+        if (cmd == "list") {
+            Output::packageList(out, installed_, parse);
+        } else if (cmd == "count") {
+            out << installed_.size() << "\n";
+        } else if (cmd == "info") {
+            if (args.empty())
+                errs << "\033[31merror:\033[0m 'info' requires a package name\n";
+            for (auto& name : args) {
+                if (auto it = byName_.find(name); it != byName_.end())
+                    Output::packageInfo(out, installed_[it->second], parse);
+                else
+                    Output::notInstalled(errs, name);
+            }
+        } else if (cmd == "owns") {
+            // paths arrive normalized by the client
+            Output::owners(out, args, db_->getOwners(args), parse);
+        } else if (cmd == "query") {
+            if (args.empty())
+                errs << "\033[31merror:\033[0m 'query' requires a search pattern\n";
+            else
+                Output::query(out, errs, repos_, args[0], parse);
+        }
+        err = errs.str();
+        return out.str();
+    }
+
+    int Daemon::serve() {
+        fs::path dbPath = rootPrefix_ + "/var/lib/gradient/gradient.db";
+        // Only serves reads: creating or migrating the schema is left to
+        // gradient, which holds the writer lock while it does
+        db_ = std::make_unique<Database>(dbPath.string());
+        if (!db_->open(/*readOnly=*/true) || !db_->schemaCurrent()) {
+            std::cerr << "\033[31merror:\033[0m database at " << dbPath
+                      << " is missing or needs migrating; run gradient once to set it up\n";
+            return 1;
+        }
+        refresh();
+
+        signal(SIGPIPE, SIG_IGN);
+        listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd_ < 0) {
+            std::cerr << "\033[31merror:\033[0m socket: " << strerror(errno) << "\n";
+            return 1;
+        }
+        unlink(socketPath_.c_str());
+        auto addr = socketAddress(socketPath_);
+        if (bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0
+            || listen(listenFd_, 64) != 0) {
+            std::cerr << "\033[31merror:\033[0m cannot listen on '" << socketPath_
+                      << "': " << strerror(errno) << "\n";
+            return 1;
+        }
+        // read-only queries are open to every local user, like the CLI itself
+        chmod(socketPath_.c_str(), 0666);
+
+        std::cout << "\033[32minfo:\033[0m gradientd serving " << installed_.size()
+                  << " packages on " << socketPath_ << "\n" << std::flush;
+
+        for (;;) {
+            int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "\033[31merror:\033[0m accept: " << strerror(errno) << "\n";
+                return 1;
+            }
+
+            // The whole request within one deadline and size budget, so a
+            // slow or oversized client cannot hold the daemon up
+            const auto deadline = Clock::now() + kRequestTime;
+            size_t budget = kMaxRequest;
+            uint32_t count = 0;
+            std::vector<std::string> request;
+            bool ok = readAll(fd, &count, sizeof count, deadline) && count >= 2
+                   && count <= budget / sizeof(uint32_t);
+            if (ok) budget -= count * sizeof(uint32_t);
+            for (uint32_t i = 0; ok && i < count; ++i) {
+                ok = readString(fd, request.emplace_back(), budget, deadline);
+            }
+            if (ok && isReadCommand(request[1])) {
+                std::string err;
+                std::string out = handle(request, err);
+                const auto sendBy = Clock::now() + kResponseTime;
+                writeString(fd, out, sendBy) && writeString(fd, err, sendBy);
+            }
+            close(fd);
+        }
+    }
+
+    bool Daemon::forward(const std::string& socketPath,
+                         const std::string& cmd,
+                         const std::vector<std::string>& args,
+                         const bool parse) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+        // A stuck daemon must not hang the CLI: any failure runs in-process
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &kClientTimeout, sizeof kClientTimeout);
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &kClientTimeout, sizeof kClientTimeout);
+        auto addr = socketAddress(socketPath);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+            close(fd);
+            return false;
+        }
+
+        auto count = static_cast<uint32_t>(args.size() + 2);
+        bool ok = writeAll(fd, &count, sizeof count)
+               && writeString(fd, parse ? "1" : "0")
+               && writeString(fd, cmd);
+        for (auto& a : args) ok = ok && writeString(fd, a);
+
+        std::string out, err;
+        size_t budget = SIZE_MAX;
+        ok = ok && readString(fd, out, budget) && readString(fd, err, budget);
+        close(fd);
+        if (!ok) return false;
+
+        std::cout << out << std::flush;
+        std::cerr << err << std::flush;
+        return true;
+    }
+
+} // namespace gradient
@@ -12,12 +12,69 @@ namespace gradient {
       : db_(nullptr), path_(std::move(path)) {}
 
     Database::~Database() {
+        sqlite3_finalize(logFileStmt_);
         if (db_) sqlite3_close(db_);
     }
 
-    bool Database::open() {
-        return sqlite3_open(path_.c_str(), &db_) == SQLITE_OK;
+    bool Database::open(const bool readOnly) {
+        const int flags = readOnly ? SQLITE_OPEN_READONLY
+                                   : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+        if (sqlite3_open_v2(path_.c_str(), &db_, flags, nullptr) != SQLITE_OK)
+            return false;
+
+        // Writers are serialized by the lock file; this only covers the short
+        // windows (checkpoints, WAL recovery) where SQLite itself is busy.
+        sqlite3_busy_timeout(db_, 5000);
+        if (readOnly) return true;
+
+        // WAL lets readers keep a consistent snapshot while an install
+        // transaction is open. Keep the -wal/-shm files around after close so
+        // read-only connections can always attach to them.
+        // The mode is persistent; if another connection is mid-transaction
+        // the switch simply happens on a later open.
+        int persist = 1;
+        sqlite3_file_control(db_, "main", SQLITE_FCNTL_PERSIST_WAL, &persist);
+        sqlite3_exec(db_, "PRAGMA journal_mode = WAL;", nullptr, nullptr, nullptr);
+        return true;
+    }
+    bool Database::copy(sqlite3* from, sqlite3* to) {
+        sqlite3_backup* b = sqlite3_backup_init(to, "main", from, "main");
+        if (!b) return false;
+        int rc = sqlite3_backup_step(b, -1);
+        sqlite3_backup_finish(b);
+        return rc == SQLITE_DONE;
+    }
+
+    bool Database::loadFrom(const std::string& path) const {
+        sqlite3* src = nullptr;
+        bool ok = sqlite3_open_v2(path.c_str(), &src, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK;
+        if (ok) {
+            sqlite3_busy_timeout(src, 5000);
+            ok = copy(src, db_);
+        }
+        if (!ok)
+            std::cerr << "\033[31merror:\033[0m cannot load '" << path << "': "
+                      << sqlite3_errmsg(src ? src : db_) << "\n";
+        sqlite3_close(src);
+        dirCache_.clear();
+        return ok;
     }
+
+    bool Database::saveTo(const std::string& path) const {
+        sqlite3* dst = nullptr;
+        bool ok = sqlite3_open_v2(path.c_str(), &dst,
+                                  SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) == SQLITE_OK;
+        if (ok) {
+            sqlite3_busy_timeout(dst, 5000);
+            ok = copy(db_, dst);
+        }
+        if (!ok)
+            std::cerr << "\033[31merror:\033[0m cannot write '" << path << "': "
+                      << sqlite3_errmsg(dst ? dst : db_) << "\n";
+        sqlite3_close(dst);
+        return ok;
+    }
+
     bool Database::beginTransaction() const {
         char* err = nullptr;
         if (sqlite3_exec(db_, "BEGIN;", nullptr, nullptr, &err) != SQLITE_OK) {
@@ -54,6 +111,8 @@ namespace gradient {
     }
 
     bool Database::rollbackTransaction() const {
+        // directories interned in this transaction are gone again
+        dirCache_.clear();
         char* err = nullptr;
         if (sqlite3_exec(db_, "ROLLBACK;", nullptr, nullptr, &err) != SQLITE_OK) {
             sqlite3_free(err);
@@ -62,55 +121,321 @@ namespace gradient {
         return true;
     }
 
+    int Database::dataVersion() const {
+        sqlite3_stmt* stmt = nullptr;
+        int v = -1;
+        if (sqlite3_prepare_v2(db_, "PRAGMA data_version;", -1, &stmt, nullptr) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) v = sqlite3_column_int(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+        return v;
+    }
+
+    // Bumped whenever the on-disk layout changes; see migrate().
+    //  1: parsed name/op/version columns on dependencies/provides/conflicts
+    //  2: integer package ids, files stored as (pkg_id, dir_id, basename)
+    //  3: (dir_id, basename) ownership index on files
+    //  4: triggers table
+    //  5: reasons column on broken_packages
+    static constexpr int kSchemaVersion = 5;
+
+    namespace {
+        /// "/usr/bin/foo" -> {"/usr/bin", "foo"}; "/foo" -> {"/", "foo"}
+        std::pair<std::string, std::string> splitPath(const std::string& path) {
+            const auto slash = path.find_last_of('/');
+            if (slash == std::string::npos) return {"/", path};
+            return {slash == 0 ? std::string("/") : path.substr(0, slash), path.substr(slash + 1)};
+        }
+
+        std::string joinPath(const char* dir, const char* base) {
+            std::string out(dir ? dir : "/");
+            if (out.empty() || out.back() != '/') out += '/';
+            return out + (base ? base : "");
+        }
+    }
+
+    int Database::schemaVersion() const {
+        sqlite3_stmt* stmt = nullptr;
+        int v = 0;
+        if (sqlite3_prepare_v2(db_, "PRAGMA user_version;", -1, &stmt, nullptr) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) v = sqlite3_column_int(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+        return v;
+    }
+
+    bool Database::schemaCurrent() const {
+        return schemaVersion() == kSchemaVersion;
+    }
+
     bool Database::initSchema() const {
+        // Already at this layout: only the per-connection pragma is needed
+        if (schemaCurrent())
+            return sqlite3_exec(db_, "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr) == SQLITE_OK;
+
         const auto sql = R"(
         PRAGMA foreign_keys = ON;
 
         CREATE TABLE IF NOT EXISTS packages (
-          name           TEXT PRIMARY KEY,
+          id             INTEGER PRIMARY KEY,
+          name           TEXT NOT NULL UNIQUE,
           version        TEXT NOT NULL,
           arch           TEXT NOT NULL,
           install_script TEXT
         );
 
         CREATE TABLE IF NOT EXISTS dependencies (
-          package    TEXT NOT NULL,
+          pkg_id     INTEGER NOT NULL REFERENCES packages(id) ON DELETE CASCADE,
           dependency TEXT NOT NULL,
-          FOREIGN KEY(package) REFERENCES packages(name) ON DELETE CASCADE
+          name       TEXT NOT NULL DEFAULT '',
+          op         TEXT NOT NULL DEFAULT '',
+          version    TEXT NOT NULL DEFAULT ''
         );
+        CREATE INDEX IF NOT EXISTS idx_dependencies_name    ON dependencies(name);
+        CREATE INDEX IF NOT EXISTS idx_dependencies_package ON dependencies(pkg_id);
 
         CREATE TABLE IF NOT EXISTS provides (
-          package  TEXT NOT NULL,
+          pkg_id   INTEGER NOT NULL REFERENCES packages(id) ON DELETE CASCADE,
           provided TEXT NOT NULL,
-          FOREIGN KEY(package) REFERENCES packages(name) ON DELETE CASCADE
+          name     TEXT NOT NULL DEFAULT '',
+          op       TEXT NOT NULL DEFAULT '',
+          version  TEXT NOT NULL DEFAULT ''
+        );
+        CREATE INDEX IF NOT EXISTS idx_provides_name    ON provides(name);
+        CREATE INDEX IF NOT EXISTS idx_provides_package ON provides(pkg_id);
+
+        CREATE TABLE IF NOT EXISTS conflicts (
+          pkg_id   INTEGER NOT NULL REFERENCES packages(id) ON DELETE CASCADE,
+          conflict TEXT NOT NULL,
+          name     TEXT NOT NULL DEFAULT '',
+          op       TEXT NOT NULL DEFAULT '',
+          version  TEXT NOT NULL DEFAULT ''
+        );
+        CREATE INDEX IF NOT EXISTS idx_conflicts_name    ON conflicts(name);
+        CREATE INDEX IF NOT EXISTS idx_conflicts_package ON conflicts(pkg_id);
+
+        CREATE TABLE IF NOT EXISTS dirs (
+          id   INTEGER PRIMARY KEY,
+          path TEXT NOT NULL UNIQUE
         );
 
         CREATE TABLE IF NOT EXISTS files (
-          package  TEXT NOT NULL,
-          filepath TEXT NOT NULL,
-          FOREIGN KEY(package) REFERENCES packages(name) ON DELETE CASCADE
+          pkg_id   INTEGER NOT NULL REFERENCES packages(id) ON DELETE CASCADE,
+          dir_id   INTEGER NOT NULL REFERENCES dirs(id),
+          basename TEXT NOT NULL
         );
+        CREATE INDEX IF NOT EXISTS idx_files_package ON files(pkg_id);
+        CREATE INDEX IF NOT EXISTS idx_files_owner   ON files(dir_id, basename);
 
         CREATE TABLE IF NOT EXISTS broken_packages (
-          name TEXT PRIMARY KEY
+          pkg_id  INTEGER PRIMARY KEY REFERENCES packages(id) ON DELETE CASCADE,
+          reasons INTEGER NOT NULL DEFAULT 1   -- Broken:: bits
         );
+
+        CREATE TABLE IF NOT EXISTS triggers (
+          pkg_id INTEGER NOT NULL REFERENCES packages(id) ON DELETE CASCADE,
+          name   TEXT NOT NULL,
+          paths  TEXT NOT NULL DEFAULT '',   -- newline-separated patterns
+          exec   TEXT NOT NULL
+        );
+        CREATE INDEX IF NOT EXISTS idx_triggers_package ON triggers(pkg_id);
         )";
+
+        // Text-keyed layouts (user_version 0/1) are converted before the DDL,
+        // whose indexes refer to columns the old tables do not have.
+        if (!migrate()) return false;
+
         char* err = nullptr;
         const bool ok = sqlite3_exec(db_, sql, nullptr, nullptr, &err) == SQLITE_OK;
         if (!ok) {
             std::cerr << "DB schema error: " << err << "\n";
             sqlite3_free(err);
+            return false;
         }
-        return ok;
+        const std::string ver = "PRAGMA user_version = " + std::to_string(kSchemaVersion) + ";";
+        return sqlite3_exec(db_, ver.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    }
+
+    bool Database::migrate() const {
+        sqlite3_stmt* stmt = nullptr;
+        const int current = schemaVersion();
+        if (current >= kSchemaVersion) return true;
+
+        auto exec = [&](const std::string& sql) {
+            char* err = nullptr;
+            if (sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
+                std::cerr << "DB migration error: " << err << "\n";
+                sqlite3_free(err);
+                return false;
+            }
+            return true;
+        };
+        auto hasColumn = [&](const std::string& table, const std::string& column) {
+            bool found = false;
+            const std::string sql = "PRAGMA table_info(" + table + ");";
+            if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    if (const auto txt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                        txt && column == txt) found = true;
+                }
+                sqlite3_finalize(stmt);
+            }
+            return found;
+        };
+        auto hasTable = [&](const std::string& table) {
+            bool found = false;
+            if (sqlite3_prepare_v2(db_, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?;",
+                                   -1, &stmt, nullptr) == SQLITE_OK) {
+                sqlite3_bind_text(stmt, 1, table.c_str(), -1, SQLITE_TRANSIENT);
+                found = sqlite3_step(stmt) == SQLITE_ROW;
+                sqlite3_finalize(stmt);
+            }
+            return found;
+        };
+
+        // v2-4 marks carry no reason; audit leaves them alone
+        if (hasTable("broken_packages") && hasColumn("packages", "id")
+            && !hasColumn("broken_packages", "reasons")
+            && !exec("ALTER TABLE broken_packages ADD COLUMN reasons INTEGER NOT NULL DEFAULT 1;"))
+            return false;
+
+        // Fresh database, or already integer-keyed: nothing to convert
+        if (!hasTable("packages") || hasColumn("packages", "id")) return true;
+
+        std::cout << "\033[32minfo:\033[0m migrating package database to schema v"
+                  << kSchemaVersion << "...\n";
+
+        // Foreign keys cannot be toggled inside a transaction
+        exec("PRAGMA foreign_keys = OFF;");
+        if (!exec("BEGIN;")) return false;
+        auto abort = [&]() {
+            exec("ROLLBACK;");
+            exec("PRAGMA foreign_keys = ON;");
+            return false;
+        };
+
+        // 1) Move the text-keyed tables aside
+        const std::vector<std::string> legacy = {"packages", "dependencies", "provides",
+                                                 "conflicts", "files", "broken_packages"};
+        for (auto& t : legacy) {
+            if (hasTable(t) && !exec("ALTER TABLE " + t + " RENAME TO legacy_" + t + ";"))
+                return abort();
+        }
+
+        // 2) Create the integer-keyed layout (the DDL is idempotent and re-run by initSchema)
+        const auto ddl = R"(
+        CREATE TABLE packages (
+          id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE, version TEXT NOT NULL,
+          arch TEXT NOT NULL, install_script TEXT);
+        CREATE TABLE dependencies (
+          pkg_id INTEGER NOT NULL REFERENCES packages(id) ON DELETE CASCADE, dependency TEXT NOT NULL,
+          name TEXT NOT NULL DEFAULT '', op TEXT NOT NULL DEFAULT '', version TEXT NOT NULL DEFAULT '');
+        CREATE TABLE provides (
+          pkg_id INTEGER NOT NULL REFERENCES packages(id) ON DELETE CASCADE, provided TEXT NOT NULL,
+          name TEXT NOT NULL DEFAULT '', op TEXT NOT NULL DEFAULT '', version TEXT NOT NULL DEFAULT '');
+        CREATE TABLE conflicts (
+          pkg_id INTEGER NOT NULL REFERENCES packages(id) ON DELETE CASCADE, conflict TEXT NOT NULL,
+          name TEXT NOT NULL DEFAULT '', op TEXT NOT NULL DEFAULT '', version TEXT NOT NULL DEFAULT '');
+        CREATE TABLE dirs (id INTEGER PRIMARY KEY, path TEXT NOT NULL UNIQUE);
+        CREATE TABLE files (
+          pkg_id INTEGER NOT NULL REFERENCES packages(id) ON DELETE CASCADE,
+          dir_id INTEGER NOT NULL REFERENCES dirs(id), basename TEXT NOT NULL);
+        CREATE TABLE broken_packages (
+          pkg_id INTEGER PRIMARY KEY REFERENCES packages(id) ON DELETE CASCADE,
+          reasons INTEGER NOT NULL DEFAULT 1);
+        )";
+        if (!exec(ddl)) return abort();
+
+        // 3) Copy packages and their relations over, resolving names to ids
+        if (!exec("INSERT INTO packages(name, version, arch, install_script) "
+                  "SELECT name, version, arch, install_script FROM legacy_packages ORDER BY name;"))
+            return abort();
+        for (auto [table, raw] : {std::pair{"dependencies", "dependency"},
+                                  std::pair{"provides", "provided"},
+                                  std::pair{"conflicts", "conflict"}}) {
+            const std::string t(table), r(raw);
+            if (!hasTable("legacy_" + t)) continue;   // conflicts did not exist in v0
+            if (!exec("INSERT INTO " + t + "(pkg_id, " + r + ") SELECT p.id, l." + r
+                      + " FROM legacy_" + t + " l JOIN packages p ON p.name = l.package"
+                      + " WHERE l." + r + " IS NOT NULL;"))
+                return abort();
+
+            // v0 rows were never parsed; split them now
+            std::vector<std::pair<sqlite3_int64, std::string>> rows;
+            const std::string sel = "SELECT rowid, " + r + " FROM " + t + " WHERE name = '';";
+            if (sqlite3_prepare_v2(db_, sel.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    if (const auto txt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)))
+                        rows.emplace_back(sqlite3_column_int64(stmt, 0), txt);
+                }
+                sqlite3_finalize(stmt);
+            }
+            const std::string upd = "UPDATE " + t + " SET name = ?, op = ?, version = ? WHERE rowid = ?;";
+            if (sqlite3_prepare_v2(db_, upd.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+                return abort();
+            for (auto& [rowid, value] : rows) {
+                auto c = Tools::parseConstraint(value);
+                sqlite3_bind_text(stmt, 1, c.name.c_str(),    -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 2, c.op.c_str(),      -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 3, c.version.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int64(stmt, 4, rowid);
+                sqlite3_step(stmt);
+                sqlite3_reset(stmt);
+            }
+            sqlite3_finalize(stmt);
+        }
+        if (hasTable("legacy_broken_packages") &&
+            !exec("INSERT OR IGNORE INTO broken_packages(pkg_id) SELECT p.id FROM legacy_broken_packages b "
+                  "JOIN packages p ON p.name = b.name;"))
+            return abort();
+
+        // 4) Intern directories while copying file rows. Rows of packages
+        //    that are gone (the old layout had no foreign keys) are dropped
+        //    like the JOINs above drop them, rather than fail the migration
+        {
+            std::vector<std::pair<std::string, std::string>> rows;
+            std::size_t orphans = 0;
+            if (sqlite3_prepare_v2(db_, "SELECT l.package, l.filepath, p.id FROM legacy_files l "
+                                        "LEFT JOIN packages p ON p.name = l.package "
+                                        "WHERE l.filepath IS NOT NULL;",
+                                   -1, &stmt, nullptr) == SQLITE_OK) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    const auto a = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                    const auto b = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                    if (sqlite3_column_type(stmt, 2) == SQLITE_NULL) ++orphans;
+                    else if (a && b) rows.emplace_back(a, b);
+                }
+                sqlite3_finalize(stmt);
+            }
+            if (orphans)
+                std::cerr << "\033[33mwarning:\033[0m skipping " << orphans
+                          << " file record(s) of packages that are no longer installed\n";
+            dirCache_.clear();
+            for (auto& [pkg, path] : rows) {
+                if (!logFile(pkg, path)) return abort();
+            }
+        }
+
+        // 5) Drop the old tables
+        for (auto& t : legacy) {
+            if (!exec("DROP TABLE IF EXISTS legacy_" + t + ";")) return abort();
+        }
+        if (!exec("COMMIT;")) return abort();
+        exec("PRAGMA foreign_keys = ON;");
+
+        // Give the space back; the new layout is several times smaller
+        exec("VACUUM;");
+        return true;
     }
 
     bool Database::addPackage(const Package::Metadata& meta,
                               const std::string& installScriptPath) const {
-        std::cout << path_ << "\n";
         // 1) Insert/replace into packages
+        // (upsert keeps the row id, so dependent rows stay attached)
         const auto sql_pkg =
-          "INSERT OR REPLACE INTO packages(name,version,arch,install_script) "
-          "VALUES(?,?,?,?);";
+          "INSERT INTO packages(name,version,arch,install_script) VALUES(?,?,?,?) "
+          "ON CONFLICT(name) DO UPDATE SET version = excluded.version, "
+          "arch = excluded.arch, install_script = excluded.install_script;";
         sqlite3_stmt* stmt = nullptr;
         if (sqlite3_prepare_v2(db_, sql_pkg, -1, &stmt, nullptr) != SQLITE_OK)
             return false;
@@ -126,58 +451,118 @@ namespace gradient {
         if (!ok) return false;
 
         // 2) Refresh dependencies
-        if (const auto sql_del = "DELETE FROM dependencies WHERE package = ?;";
-            sqlite3_prepare_v2(db_, sql_del, -1, &stmt, nullptr) != SQLITE_OK)
-            return false;
-        sqlite3_bind_text(stmt,1,meta.name.c_str(),-1,nullptr);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-
-        for (auto& d : meta.deps) {
-            const auto sql_ins =
-                    "INSERT INTO dependencies(package,dependency) VALUES(?,?);";
-            if (sqlite3_prepare_v2(db_, sql_ins, -1, &stmt, nullptr) != SQLITE_OK)
-                continue;
-            sqlite3_bind_text(stmt,1,meta.name.c_str(),-1,nullptr);
-            sqlite3_bind_text(stmt,2,d.c_str(),-1,nullptr);
-            sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
-        }
+        if (!replaceConstraints("dependencies", "dependency", meta.name, meta.deps)) return false;
         if (!addProvides(meta)) return false;
+        if (!addConflicts(meta)) return false;
+        if (!addTriggers(meta)) return false;
         return true;
     }
 
-    bool Database::addProvides(const Package::Metadata& meta) const {
+    bool Database::addTriggers(const Package::Metadata& meta) const {
         sqlite3_stmt* stmt = nullptr;
-        // 1) delete old provides for this package
         if (sqlite3_prepare_v2(db_,
-              "DELETE FROM provides WHERE package = ?;", -1, &stmt, nullptr) != SQLITE_OK)
+              "DELETE FROM triggers WHERE pkg_id = (SELECT id FROM packages WHERE name = ?);",
+              -1, &stmt, nullptr) != SQLITE_OK)
             return false;
         sqlite3_bind_text(stmt, 1, meta.name.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_step(stmt);
         sqlite3_finalize(stmt);
 
-        // 2) insert each provided name
-        for (auto const& prov : meta.provides) {
-            if (const auto sql = "INSERT INTO provides(package, provided) VALUES(?,?);";
-                sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK)
-                return false;
+        if (sqlite3_prepare_v2(db_,
+              "INSERT INTO triggers(pkg_id, name, paths, exec) "
+              "VALUES((SELECT id FROM packages WHERE name = ?),?,?,?);",
+              -1, &stmt, nullptr) != SQLITE_OK)
+            return false;
+        bool ok = true;
+        for (auto const& t : meta.triggers) {
+            std::string paths;
+            for (auto const& p : t.paths) paths += (paths.empty() ? "" : "\n") + p;
             sqlite3_bind_text(stmt, 1, meta.name.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 2, prov.c_str(),       -1, SQLITE_TRANSIENT);
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                sqlite3_finalize(stmt);
-                return false;
+            sqlite3_bind_text(stmt, 2, t.name.c_str(),    -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 3, paths.c_str(),     -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 4, t.exec.c_str(),    -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) != SQLITE_DONE) { ok = false; break; }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+        return ok;
+    }
+
+    std::vector<TriggerRow> Database::getAllTriggers() const {
+        std::vector<TriggerRow> out;
+        const auto sql = "SELECT p.name, t.name, t.paths, t.exec FROM triggers t "
+                         "JOIN packages p ON p.id = t.pkg_id ORDER BY p.name, t.rowid;";
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "DB error: " << sqlite3_errmsg(db_) << "\n";
+            return out;
+        }
+        auto col = [&](int i) {
+            const auto txt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+            return txt ? std::string(txt) : std::string{};
+        };
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            TriggerRow row{col(0), {col(1), {}, col(3)}};
+            std::string paths = col(2);
+            for (size_t pos = 0; pos < paths.size(); ) {
+                size_t nl = paths.find('\n', pos);
+                if (nl == std::string::npos) nl = paths.size();
+                if (nl > pos) row.trigger.paths.push_back(paths.substr(pos, nl - pos));
+                pos = nl + 1;
             }
-            sqlite3_finalize(stmt);
+            out.push_back(std::move(row));
         }
-        return true;
+        sqlite3_finalize(stmt);
+        return out;
+    }
+
+    bool Database::addConflicts(const Package::Metadata& meta) const {
+        return replaceConstraints("conflicts", "conflict", meta.name, meta.conflicts);
+    }
+
+    bool Database::addProvides(const Package::Metadata& meta) const {
+        return replaceConstraints("provides", "provided", meta.name, meta.provides);
+    }
+
+    bool Database::replaceConstraints(const char* table,
+                                      const char* rawColumn,
+                                      const std::string& packageName,
+                                      const std::vector<std::string>& raws) const {
+        sqlite3_stmt* stmt = nullptr;
+        // 1) delete old rows for this package
+        const std::string del = std::string("DELETE FROM ") + table
+                              + " WHERE pkg_id = (SELECT id FROM packages WHERE name = ?);";
+        if (sqlite3_prepare_v2(db_, del.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            return false;
+        sqlite3_bind_text(stmt, 1, packageName.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+
+        // 2) insert each entry, parsed once here so lookups never re-parse
+        const std::string ins = std::string("INSERT INTO ") + table + "(pkg_id, " + rawColumn
+                              + ", name, op, version) VALUES((SELECT id FROM packages WHERE name = ?),?,?,?,?);";
+        if (sqlite3_prepare_v2(db_, ins.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            return false;
+        bool ok = true;
+        for (auto const& raw : raws) {
+            const auto c = Tools::parseConstraint(raw);
+            sqlite3_bind_text(stmt, 1, packageName.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, raw.c_str(),         -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 3, c.name.c_str(),      -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 4, c.op.c_str(),        -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 5, c.version.c_str(),   -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) != SQLITE_DONE) { ok = false; break; }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+        return ok;
     }
 
     bool Database::isProvided(const std::string& name) const {
     sqlite3_stmt* stmt = nullptr;
     bool result = false;
     if (sqlite3_prepare_v2(db_,
-          "SELECT 1 FROM provides WHERE provided = ? LIMIT 1;", -1, &stmt, nullptr)
+          "SELECT 1 FROM provides WHERE name = ? LIMIT 1;", -1, &stmt, nullptr)
         == SQLITE_OK)
     {
         sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
@@ -191,8 +576,20 @@ namespace gradient {
 
     std::vector<std::string> Database::getReverseDependencies(const std::string& packageName) const {
         std::vector<std::string> result;
-        const auto sql =
-          "SELECT package FROM dependencies WHERE dependency = ?;";
+        // Dependents on the package itself, or on something only it provides
+        const auto sql = R"(
+        WITH self(id) AS (SELECT id FROM packages WHERE name = ?1)
+        SELECT DISTINCT pk.name FROM dependencies d
+        JOIN packages pk ON pk.id = d.pkg_id
+        WHERE d.pkg_id <> (SELECT id FROM self)
+          AND (d.name = ?1
+               OR d.name IN (SELECT p.name FROM provides p
+                             WHERE p.pkg_id = (SELECT id FROM self)
+                               AND NOT EXISTS (SELECT 1 FROM provides o
+                                               WHERE o.name = p.name AND o.pkg_id <> p.pkg_id)
+                               AND NOT EXISTS (SELECT 1 FROM packages k
+                                               WHERE k.name = p.name AND k.id <> p.pkg_id)));
+        )";
         sqlite3_stmt* stmt = nullptr;
         if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
             sqlite3_bind_text(stmt,1,packageName.c_str(),-1,nullptr);
@@ -207,12 +604,14 @@ namespace gradient {
     std::vector<std::string> Database::getFiles(const std::string& packageName) const {
         std::vector<std::string> result;
         const auto sql =
-          "SELECT filepath FROM files WHERE package = ?;";
+          "SELECT d.path, f.basename FROM files f JOIN dirs d ON d.id = f.dir_id "
+          "WHERE f.pkg_id = (SELECT id FROM packages WHERE name = ?);";
         sqlite3_stmt* stmt = nullptr;
         if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
             sqlite3_bind_text(stmt,1,packageName.c_str(),-1,nullptr);
             while (sqlite3_step(stmt) == SQLITE_ROW) {
-                if (auto txt = reinterpret_cast<const char*>(sqlite3_column_text(stmt,0))) result.emplace_back(txt);
+                result.push_back(joinPath(reinterpret_cast<const char*>(sqlite3_column_text(stmt,0)),
+                                          reinterpret_cast<const char*>(sqlite3_column_text(stmt,1))));
             }
             sqlite3_finalize(stmt);
         }
@@ -237,7 +636,7 @@ namespace gradient {
     bool Database::removeFiles(const std::string& packageName) const {
         sqlite3_stmt* stmt = nullptr;
 
-        if (const auto sql = "DELETE FROM files WHERE package = ?;";
+        if (const auto sql = "DELETE FROM files WHERE pkg_id = (SELECT id FROM packages WHERE name = ?);";
             sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK)
             return false;
 
@@ -262,13 +661,15 @@ namespace gradient {
         return ok;
     }
 
-    bool Database::markBroken(const std::string& packageName) const {
+    bool Database::markBroken(const std::string& packageName, unsigned reasons) const {
         const auto sql =
-          "INSERT OR IGNORE INTO broken_packages(name) VALUES(?);";
+          "INSERT INTO broken_packages(pkg_id, reasons) SELECT id, ? FROM packages WHERE name = ? "
+          "ON CONFLICT(pkg_id) DO UPDATE SET reasons = reasons | excluded.reasons;";
         sqlite3_stmt* stmt = nullptr;
         if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK)
             return false;
-        sqlite3_bind_text(stmt,1,packageName.c_str(),-1,nullptr);
+        sqlite3_bind_int64(stmt, 1, reasons);
+        sqlite3_bind_text(stmt, 2, packageName.c_str(), -1, nullptr);
         const bool ok = sqlite3_step(stmt) == SQLITE_DONE;
         sqlite3_finalize(stmt);
         return ok;
@@ -287,37 +688,66 @@ namespace gradient {
     }
 
     bool Database::logFile(const std::string& pkg, const std::string& path) const {
-        // Note: our table columns are "package" and "filepath"
-        const auto sql =
-          "INSERT INTO files(package, filepath) VALUES(?,?);";
+        auto [dir, base] = splitPath(path);
+
+        // 1) Intern the directory; ids are cached for the rest of the transaction
+        sqlite3_int64 dirId = 0;
+        if (auto it = dirCache_.find(dir); it != dirCache_.end()) {
+            dirId = it->second;
+        } else {
+            sqlite3_stmt* stmt = nullptr;
+            for (const auto sql : {"INSERT OR IGNORE INTO dirs(path) VALUES(?);",
+                                   "SELECT id FROM dirs WHERE path = ?;"}) {
+                if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+                    std::cerr << "\033[31mDB error:\033[0m failed to prepare dir lookup: "
+                              << sqlite3_errmsg(db_) << "\n";
+                    return false;
+                }
+                sqlite3_bind_text(stmt, 1, dir.c_str(), -1, SQLITE_TRANSIENT);
+                if (sqlite3_step(stmt) == SQLITE_ROW) dirId = sqlite3_column_int64(stmt, 0);
+                sqlite3_finalize(stmt);
+            }
+            if (dirId == 0) {
+                std::cerr << "\033[31mDB error:\033[0m failed to intern directory '" << dir << "': "
+                          << sqlite3_errmsg(db_) << "\n";
+                return false;
+            }
+            dirCache_.emplace(dir, dirId);
+        }
 
-        sqlite3_stmt* stmt = nullptr;
-        int rc = sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr);
-        if (rc != SQLITE_OK) {
-            std::cerr << "\033[31mDB error:\033[0m failed to prepare logFile statement: "
-                      << sqlite3_errmsg(db_) << "\n";
-            return false;
+        // 2) Record (pkg_id, dir_id, basename); the statement is prepared
+        //    once per connection, since a package logs thousands of rows
+        if (!logFileStmt_) {
+            const auto sql =
+              "INSERT INTO files(pkg_id, dir_id, basename) "
+              "VALUES((SELECT id FROM packages WHERE name = ?),?,?);";
+            if (sqlite3_prepare_v2(db_, sql, -1, &logFileStmt_, nullptr) != SQLITE_OK) {
+                std::cerr << "\033[31mDB error:\033[0m failed to prepare logFile statement: "
+                          << sqlite3_errmsg(db_) << "\n";
+                logFileStmt_ = nullptr;
+                return false;
+            }
         }
+        sqlite3_stmt* stmt = logFileStmt_;
 
         sqlite3_bind_text(stmt, 1, pkg.c_str(),  -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, path.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, dirId);
+        sqlite3_bind_text(stmt, 3, base.c_str(), -1, SQLITE_TRANSIENT);
 
-        rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
+        const bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        if (!ok) {
             std::cerr << "\033[31mDB error:\033[0m failed to execute logFile INSERT: "
                       << sqlite3_errmsg(db_) << "\n";
-            sqlite3_finalize(stmt);
-            return false;
         }
-
-        sqlite3_finalize(stmt);
-        return true;
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        return ok;
     }
 
     std::vector<std::string> Database::getBrokenPackages() const {
         std::vector<std::string> result;
         sqlite3_stmt* stmt = nullptr;
-        if (const auto sql = "SELECT name FROM broken_packages;";
+        if (const auto sql = "SELECT p.name FROM broken_packages b JOIN packages p ON p.id = b.pkg_id;";
             sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
             while (sqlite3_step(stmt) == SQLITE_ROW) {
                 if (auto txt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))) result.emplace_back(txt);
@@ -327,10 +757,24 @@ namespace gradient {
         return result;
     }
 
+    std::vector<std::pair<std::string, unsigned>> Database::getBrokenReasons() const {
+        std::vector<std::pair<std::string, unsigned>> result;
+        sqlite3_stmt* stmt = nullptr;
+        if (const auto sql = "SELECT p.name, b.reasons FROM broken_packages b JOIN packages p ON p.id = b.pkg_id;";
+            sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                if (auto txt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)))
+                    result.emplace_back(txt, static_cast<unsigned>(sqlite3_column_int64(stmt, 1)));
+            }
+        }
+        sqlite3_finalize(stmt);
+        return result;
+    }
+
     std::vector<std::string> Database::getDependencies(const std::string& packageName) const {
         std::vector<std::string> result;
         const auto sql =
-          "SELECT dependency FROM dependencies WHERE package = ?;";
+          "SELECT dependency FROM dependencies WHERE pkg_id = (SELECT id FROM packages WHERE name = ?);";
         sqlite3_stmt* stmt = nullptr;
         if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) == SQLITE_OK) {
             sqlite3_bind_text(stmt, 1, packageName.c_str(), -1, SQLITE_TRANSIENT);
@@ -344,7 +788,7 @@ namespace gradient {
 
     bool Database::removeBroken(const std::string& packageName) const {
         sqlite3_stmt* stmt = nullptr;
-        if (const auto sql = "DELETE FROM broken_packages WHERE name = ?;";
+        if (const auto sql = "DELETE FROM broken_packages WHERE pkg_id = (SELECT id FROM packages WHERE name = ?);";
             sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
             std::cerr << "DB error: failed to prepare removeBroken: "
                       << sqlite3_errmsg(db_) << "\n";
@@ -363,9 +807,9 @@ namespace gradient {
     std::vector<PackageInfo> Database::listPackages() const {
         std::vector<PackageInfo> out;
         const auto sql = R"(
-        SELECT p.name, p.version, p.arch, (b.name IS NOT NULL) AS broken FROM packages p
+        SELECT p.name, p.version, p.arch, (b.pkg_id IS NOT NULL) AS broken FROM packages p
         LEFT JOIN broken_packages b
-              ON p.name = b.name
+              ON p.id = b.pkg_id
         ORDER BY p.name;
         )";
         sqlite3_stmt* stmt = nullptr;
@@ -386,33 +830,149 @@ namespace gradient {
         return out;
     }
 
+    bool Database::getPackage(const std::string& name, PackageInfo& out) const {
+        const auto sql = R"(
+        SELECT p.name, p.version, p.arch, (b.pkg_id IS NOT NULL) AS broken FROM packages p
+        LEFT JOIN broken_packages b
+              ON p.id = b.pkg_id
+        WHERE p.name = ?;
+        )";
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "DB error: getPackage prepare failed: "
+                      << sqlite3_errmsg(db_) << "\n";
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+        bool found = false;
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            out.name    = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            out.version = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            out.arch    = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            out.broken  = sqlite3_column_int(stmt, 3) != 0;
+            found = true;
+        }
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    size_t Database::countPackages() const {
+        sqlite3_stmt* stmt = nullptr;
+        size_t n = 0;
+        if (sqlite3_prepare_v2(db_, "SELECT COUNT(*) FROM packages;", -1, &stmt, nullptr) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) n = static_cast<size_t>(sqlite3_column_int64(stmt, 0));
+            sqlite3_finalize(stmt);
+        }
+        return n;
+    }
+
+    std::vector<ConstraintRow> Database::selectConstraints(const char* table, const char* rawColumn) const {
+        std::vector<ConstraintRow> out;
+        const std::string sql = std::string("SELECT p.name, t.") + rawColumn
+                              + ", t.name, t.op, t.version FROM " + table
+                              + " t JOIN packages p ON p.id = t.pkg_id;";
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "DB error: " << sqlite3_errmsg(db_) << "\n";
+            return out;
+        }
+        auto col = [&](int i) {
+            const auto txt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+            return txt ? std::string(txt) : std::string{};
+        };
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            out.push_back({col(0), col(1), {col(2), col(3), col(4)}});
+        }
+        sqlite3_finalize(stmt);
+        return out;
+    }
+
+    std::vector<ConstraintRow> Database::getAllDependencies() const {
+        return selectConstraints("dependencies", "dependency");
+    }
+
+    std::vector<ConstraintRow> Database::getAllProvides() const {
+        return selectConstraints("provides", "provided");
+    }
+
+    std::vector<ConstraintRow> Database::getAllConflicts() const {
+        return selectConstraints("conflicts", "conflict");
+    }
+
+    std::vector<std::pair<std::string, std::string>> Database::getAllFiles() const {
+        std::vector<std::pair<std::string, std::string>> out;
+        sqlite3_stmt* stmt = nullptr;
+        const auto sql = "SELECT p.name, d.path, f.basename FROM files f "
+                         "JOIN packages p ON p.id = f.pkg_id JOIN dirs d ON d.id = f.dir_id;";
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "DB error: " << sqlite3_errmsg(db_) << "\n";
+            return out;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const auto name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            out.emplace_back(name ? name : "",
+                             joinPath(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                                      reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2))));
+        }
+        sqlite3_finalize(stmt);
+        return out;
+    }
+
+    std::vector<std::string> Database::getOwners(const std::string& path) const {
+        std::vector<std::string> result;
+        for (auto& [p, owner] : getOwners(std::vector{path})) {
+            result.push_back(std::move(owner));
+        }
+        return result;
+    }
+
+    std::vector<std::pair<std::string, std::string>>
+    Database::getOwners(const std::vector<std::string>& paths) const {
+        std::vector<std::pair<std::string, std::string>> out;
+        const auto sql =
+          "SELECT p.name FROM dirs d "
+          "JOIN files f    ON f.dir_id = d.id "
+          "JOIN packages p ON p.id = f.pkg_id "
+          "WHERE d.path = ? AND f.basename = ?;";
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "DB error: getOwners prepare failed: "
+                      << sqlite3_errmsg(db_) << "\n";
+            return out;
+        }
+        // One prepared statement for the whole batch: two index probes per path
+        for (auto& path : paths) {
+            auto [dir, base] = splitPath(path);
+            sqlite3_bind_text(stmt, 1, dir.c_str(),  -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, base.c_str(), -1, SQLITE_TRANSIENT);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                if (const auto txt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)))
+                    out.emplace_back(path, txt);
+            }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+        return out;
+    }
+
     bool Database::providesSatisfies(const Tools::Constraint& c) const {
-        // find any row whose "provided" raw string starts with c.name
-        // e.g. "sdl2" matches "sdl2=2.32.56"
+        // exact name match through idx_provides_name; only the (few) rows for
+        // that name need a version comparison
         const auto sql =
-          "SELECT provided FROM provides WHERE provided LIKE ?;";
+          "SELECT version FROM provides WHERE name = ?;";
         sqlite3_stmt* stmt = nullptr;
         if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
             std::cerr << "DB error: providesSatisfies prepare failed: "
                       << sqlite3_errmsg(db_) << "\n";
             return false;
         }
-
-        // bind "sdl2%" to catch both "sdl2" and "sdl2=1.2"
-        const std::string like = c.name + "%";
-        sqlite3_bind_text(stmt, 1, like.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 1, c.name.c_str(), -1, SQLITE_TRANSIENT);
 
         bool ok = false;
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             const auto txt = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
-            if (!txt) continue;
-            std::string rawProv(txt);
-            // parse it, e.g. rawProv="sdl2=2.32.56" → pc.name="sdl2", pc.op="=", pc.ver="2.32.56"
-            Tools::Constraint pc = Tools::parseConstraint(rawProv);
-            if (pc.name != c.name)
-                continue;   // e.g. "sdl23" won't match "sdl2"
             // if no op on the dependency, any provider works
-            if (c.op.empty() || Tools::evalConstraint(pc.version, c)) {
+            if (c.op.empty() || Tools::evalConstraint(txt ? txt : "", c)) {
                 ok = true;
                 break;
             }
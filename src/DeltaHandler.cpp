@@ -0,0 +1,181 @@
+// src/DeltaHandler.cpp
+
+#include "DeltaHandler.h"
+#include "ObjectStore.h"
+#include "TarHandler.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <yaml-cpp/yaml.h>
+#include <filesystem>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        /// Give `dst` the owner and mode of the installed `src`, which are
+        /// what the old archive gave it, and its mtime when `times` is set;
+        /// fs::copy keeps only the mode.
+        void copyAttributes(const fs::path& src, const fs::path& dst, bool times) {
+            struct stat st{};
+            if (::lstat(src.c_str(), &st) != 0) return;
+            ::lchown(dst.c_str(), st.st_uid, st.st_gid);
+            if (!S_ISLNK(st.st_mode)) ::chmod(dst.c_str(), st.st_mode & 07777);
+            if (!times) return;
+            const timespec ts[2] = {st.st_atim, st.st_mtim};
+            ::utimensat(AT_FDCWD, dst.c_str(), ts, AT_SYMLINK_NOFOLLOW);
+        }
+
+        std::map<std::string, std::string> stringMap(const YAML::Node& node) {
+            std::map<std::string, std::string> out;
+            if (node && node.IsMap()) {
+                for (const auto& kv : node)
+                    out.emplace(kv.first.as<std::string>(), kv.second.as<std::string>());
+            }
+            return out;
+        }
+    }
+
+    bool DeltaHandler::snapshotBase(const Database& db, const std::string& name, Base& out) {
+        out.name = name;
+        if (!db.getPackageVersion(name, out.version))
+            return false;
+        out.files = db.getFiles(name);
+        return true;
+    }
+
+    bool DeltaHandler::reconstruct(const std::string& deltaPath,
+                                   const Base& base,
+                                   const std::string& rootDir,
+                                   const std::string& outArchive)
+    {
+        char tmpl[] = "/tmp/gradient_deltaXXXXXX";
+        char* tmpC = mkdtemp(tmpl);
+        if (!tmpC) {
+            std::cerr << "\033[31merror:\033[0m could not create temp dir for delta\n";
+            return false;
+        }
+        fs::path tmp(tmpC);
+        auto fail = [&](const std::string& why) {
+            std::cerr << "\033[33mwarning:\033[0m delta for '" << base.name
+                      << "' unusable: " << why << "\n";
+            std::error_code ec;
+            fs::remove_all(tmp, ec);
+            return false;
+        };
+
+        // 1) Unpack the delta
+        if (!TarHandler::extract(deltaPath, tmp.string()))
+            return fail("failed to extract '" + deltaPath + "'");
+
+        // 2) Check it was made against exactly what is installed
+        YAML::Node desc;
+        try { desc = YAML::LoadFile((tmp / "delta.yaml").string()); }
+        catch (const YAML::Exception& e) { return fail(std::string("delta.yaml: ") + e.what()); }
+
+        auto from = desc["from"] ? desc["from"].as<std::string>() : std::string{};
+        if (from.empty() || from != base.version)
+            return fail("made against '" + from + "', installed is '" + base.version + "'");
+
+        const std::unordered_set<std::string> owned(base.files.begin(), base.files.end());
+        fs::path root(rootDir.empty() ? "/" : rootDir);
+        auto installedPath = [&](const std::string& rec) -> fs::path {
+            return root / fs::path(rec).relative_path();
+        };
+        auto verified = [&](const std::string& rec) {
+            if (!owned.contains(rec)) return false;
+            std::error_code ec;
+            auto st = fs::symlink_status(installedPath(rec), ec);
+            return !ec && (fs::is_regular_file(st) || fs::is_symlink(st));
+        };
+
+        fs::path pkgRoot = tmp / "package";
+        std::error_code ec;
+        fs::create_directories(pkgRoot, ec);
+
+        // 3) Copy unchanged files straight from the installed root
+        if (desc["keep"] && desc["keep"].IsSequence()) {
+            for (const auto& node : desc["keep"]) {
+                auto rec = node.as<std::string>();
+                if (!verified(rec))
+                    return fail("base file '" + rec + "' missing or not owned");
+                fs::path dst = pkgRoot / fs::path(rec).relative_path();
+                fs::create_directories(dst.parent_path(), ec);
+                fs::copy(installedPath(rec), dst,
+                         fs::copy_options::copy_symlinks | fs::copy_options::overwrite_existing, ec);
+                if (ec) return fail("copying '" + rec + "': " + ec.message());
+                copyAttributes(installedPath(rec), dst, true);
+            }
+        }
+
+        // 4) Apply per-file patches against the installed file at the same path
+        fs::path patchRoot = tmp / "patches";
+        if (fs::exists(patchRoot)) {
+            for (auto& entry : fs::recursive_directory_iterator(patchRoot)) {
+                if (!entry.is_regular_file() || entry.path().extension() != ".zst")
+                    continue;
+                auto rel = fs::relative(entry.path(), patchRoot).replace_extension();
+                std::string rec = (fs::path("/") / rel).string();
+                if (!verified(rec))
+                    return fail("patch base '" + rec + "' missing or not owned");
+
+                fs::path dst = pkgRoot / rel;
+                fs::create_directories(dst.parent_path(), ec);
+                std::string cmd =
+                    "zstd -q -d -f --patch-from='" + installedPath(rec).string() + "' '"
+                    + entry.path().string() + "' -o '" + dst.string() + "'";
+                if (std::system(cmd.c_str()) != 0)
+                    return fail("patch for '" + rec + "' did not apply");
+                copyAttributes(installedPath(rec), dst, false);
+            }
+            fs::remove_all(patchRoot, ec);
+        }
+        fs::remove(tmp / "delta.yaml", ec);
+
+        // 5) Every file of the new payload must be exactly what the publisher
+        //    built: a base file edited since it was installed is caught here,
+        //    whether it was kept as is or patched
+        const auto sums = stringMap(desc["sha256"]);
+        const auto links = stringMap(desc["links"]);
+        if (sums.empty() && links.empty())
+            return fail("no per-file hashes published");
+        std::size_t seen = 0;
+        for (auto it = fs::recursive_directory_iterator(pkgRoot, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+        {
+            if (it->is_directory(ec) && !it->is_symlink(ec)) continue;
+            const std::string rec = (fs::path("/") / it->path().lexically_relative(pkgRoot)).string();
+            if (it->is_symlink(ec)) {
+                auto want = links.find(rec);
+                if (want == links.end() || fs::read_symlink(it->path(), ec).string() != want->second)
+                    return fail("symlink '" + rec + "' does not match the published target");
+            } else {
+                auto want = sums.find(rec);
+                std::string hex;
+                if (want == sums.end() || !ObjectStore::hashFile(it->path().string(), hex)
+                    || hex != want->second)
+                    return fail("'" + rec + "' does not match its published checksum");
+            }
+            ++seen;
+        }
+        if (ec) return fail("reading rebuilt payload: " + ec.message());
+        if (seen != sums.size() + links.size())
+            return fail("rebuilt payload is missing files");
+
+        // 6) Repack as a regular .apkg so the normal install path takes over
+        std::string tarCmd = "tar -C '" + tmp.string() + "' -cf '" + outArchive + "' .";
+        if (std::system(tarCmd.c_str()) != 0)
+            return fail("failed to repack archive");
+
+        fs::remove_all(tmp, ec);
+        return true;
+    }
+
+} // namespace gradient
@@ -0,0 +1,98 @@
+// src/DiskThrottle.cpp
+
+#include "DiskThrottle.h"
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        using Clock = std::chrono::steady_clock;
+        constexpr auto kInterval = std::chrono::milliseconds(100);
+        constexpr auto kMaxWait = std::chrono::seconds(5);
+        /// Below this a disk is never considered congested.
+        constexpr double kFloorMs = 5.0;
+
+        /// The whole disk holding `path`; queueing is per disk, not per partition.
+        std::string diskOf(const std::string& path) {
+            struct stat st{};
+            if (::stat(path.c_str(), &st) != 0) return {};
+            const fs::path sys = "/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":"
+                               + std::to_string(minor(st.st_dev));
+            std::error_code ec;
+            fs::path dev = fs::canonical(sys, ec);
+            if (ec) return {};
+            if (fs::exists(dev / "partition", ec)) dev = dev.parent_path();
+            return dev.filename().string();
+        }
+    }
+
+    DiskThrottle::DiskThrottle(const std::string& path) : device_(diskOf(path)) {
+        if (active()) {
+            sample(last_);
+            lastAt_ = Clock::now();
+        }
+    }
+
+    bool DiskThrottle::sample(Sample& out) const {
+        std::ifstream stats("/proc/diskstats");
+        for (std::string line; std::getline(stats, line); ) {
+            std::istringstream in(line);
+            unsigned maj, min;
+            std::string name;
+            std::uint64_t rd, rdMerged, rdSectors, rdMs, wr, wrMerged, wrSectors, wrMs;
+            if (!(in >> maj >> min >> name) || name != device_) continue;
+            if (!(in >> rd >> rdMerged >> rdSectors >> rdMs >> wr >> wrMerged >> wrSectors >> wrMs))
+                return false;
+            out.ios = rd + wr;
+            out.ms = rdMs + wrMs;
+            return true;
+        }
+        return false;
+    }
+
+    double DiskThrottle::latency() {
+        Sample now;
+        if (!sample(now)) return -1;
+        const std::uint64_t ios = now.ios - last_.ios;
+        const std::uint64_t ms = now.ms - last_.ms;
+        last_ = now;
+        lastAt_ = Clock::now();
+        return ios ? static_cast<double>(ms) / static_cast<double>(ios) : -1;
+    }
+
+    void DiskThrottle::pace() {
+        if (!active()) return;
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (Clock::now() - lastAt_ < kInterval) return;
+
+        auto backoff = std::chrono::milliseconds(50);
+        const auto start = Clock::now();
+        for (double lat = latency(); lat >= 0; ) {
+            const bool congested = lat > kFloorMs && baseline_ >= 0 && lat > 2 * baseline_;
+            if (!congested) {
+                baseline_ = baseline_ < 0 ? lat : 0.8 * baseline_ + 0.2 * lat;
+                return;
+            }
+            // Latency that has not come down in this long is the disk's new
+            // normal: take it as the baseline rather than stall every call
+            if (Clock::now() - start >= kMaxWait) {
+                baseline_ = lat;
+                return;
+            }
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min<std::chrono::milliseconds>(backoff * 2, std::chrono::milliseconds(1600));
+            lat = latency();
+        }
+    }
+
+} // namespace gradient
@@ -0,0 +1,103 @@
+// src/Durability.cpp
+
+#include "Durability.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        /// Files flushed per round: writeback of all of them is started
+        /// before waiting on the first, without holding too many fds open.
+        constexpr size_t kWindow = 256;
+
+        bool failed(const std::string& path) {
+            std::cerr << "\033[31merror:\033[0m cannot flush '" << path << "': "
+                      << std::strerror(errno) << "\n";
+            return false;
+        }
+
+        bool syncFiles(const std::vector<std::string>& files) {
+            std::set<std::string> dirs;
+            for (size_t start = 0; start < files.size(); start += kWindow) {
+                const size_t end = std::min(files.size(), start + kWindow);
+                std::vector<std::pair<int, const std::string*>> open;
+                open.reserve(end - start);
+
+                // 1) Start writeback everywhere; sync_file_range(WRITE) does not wait
+                for (size_t i = start; i < end; ++i) {
+                    dirs.insert(fs::path(files[i]).parent_path().string());
+                    // Symlinks live in their directory, flushed below
+                    int fd = ::open(files[i].c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+                    if (fd < 0) {
+                        if (errno == ELOOP || errno == ENOENT) continue;
+                        for (auto& [f, p] : open) ::close(f);
+                        return failed(files[i]);
+                    }
+                    ::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+                    open.emplace_back(fd, &files[i]);
+                }
+
+                // 2) Then wait for it, with the device cache flush fdatasync adds
+                bool ok = true;
+                for (auto& [fd, path] : open) {
+                    if (ok && ::fdatasync(fd) != 0 && errno != EINVAL) ok = failed(*path);
+                    ::close(fd);
+                }
+                if (!ok) return false;
+            }
+
+            // 3) The renames that put the files in place
+            for (auto& dir : dirs) {
+                int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (fd < 0) continue;
+                const bool ok = ::fsync(fd) == 0 || errno == EINVAL;
+                ::close(fd);
+                if (!ok) return failed(dir);
+            }
+            return true;
+        }
+    }
+
+    bool Durability::parse(const std::string& name, Mode& out) {
+        if (name == "none")   { out = Mode::None;   return true; }
+        if (name == "syncfs") { out = Mode::Syncfs; return true; }
+        if (name == "file")   { out = Mode::File;   return true; }
+        return false;
+    }
+
+    bool Durability::barrier(Mode mode, const std::string& rootDir,
+                             const std::vector<std::string>& files) {
+        switch (mode) {
+        case Mode::None:
+            return true;
+        case Mode::Syncfs:
+            if (files.empty() || syncFilesystem(rootDir)) return true;
+            return failed(rootDir);
+        case Mode::File:
+            return syncFiles(files);
+        }
+        return true;
+    }
+
+    bool Durability::syncFilesystem(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return false;
+        bool ok = ::syncfs(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
+
+} // namespace gradient
@@ -0,0 +1,243 @@
+// src/FileBatch.cpp
+
+#include "FileBatch.h"
+#include "IoRing.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        constexpr unsigned kOpsPerFile = 4;   // read, openat, write, close
+
+        /// The process umask, without the umask(2) set-and-restore dance
+        /// that would race with other threads unpacking.
+        mode_t currentUmask() {
+            static const mode_t mask = [] {
+                std::ifstream status("/proc/self/status");
+                for (std::string line; std::getline(status, line); ) {
+                    if (line.starts_with("Umask:"))
+                        return static_cast<mode_t>(std::strtoul(line.c_str() + 6, nullptr, 8));
+                }
+                return static_cast<mode_t>(07777);   // unknown: always chmod
+            }();
+            return mask;
+        }
+
+        /// Direct descriptors (openat/close into fixed slots) are 5.15+;
+        /// the opcode probe alone does not tell.
+        bool directOpenWorks(IoRing& ring) {
+            io_uring_sqe* open = ring.sqe();
+            io_uring_sqe* close = ring.sqe();
+            if (!open || !close) return false;
+            open->opcode = IORING_OP_OPENAT;
+            open->fd = AT_FDCWD;
+            open->addr = reinterpret_cast<__u64>("/");
+            open->open_flags = O_RDONLY | O_DIRECTORY;   // O_CLOEXEC is EINVAL here
+            open->file_index = 1;
+            open->flags = IOSQE_IO_LINK;
+            open->user_data = 0;
+            close->opcode = IORING_OP_CLOSE;
+            close->file_index = 1;
+            close->user_data = 1;
+            if (!ring.submit(2)) return false;
+            // Before 5.15 file_index is ignored and the open returns a plain
+            // descriptor; a direct open returns 0
+            bool ok = true;
+            io_uring_cqe cqe{};
+            for (int i = 0; i < 2; ++i) {
+                if (!ring.wait(cqe)) return false;
+                if (cqe.user_data == 0 && cqe.res > 0) ::close(cqe.res);
+                ok = ok && (cqe.user_data == 0 ? cqe.res == 0 : cqe.res >= 0);
+            }
+            return ok;
+        }
+    }
+
+    FileBatch::FileBatch(int source, Fallback fallback, unsigned depth)
+        : source_(source), fallback_(std::move(fallback)), depth_(depth)
+    {
+        if (std::getenv("GRADIENT_NO_URING")) return;
+        ring_ = std::make_unique<IoRing>(depth_ * kOpsPerFile);
+        usable_ = ring_->ok()
+               && ring_->supports({IORING_OP_READ, IORING_OP_OPENAT, IORING_OP_WRITE,
+                                   IORING_OP_CLOSE})
+               && ring_->registerFiles(depth_)
+               && directOpenWorks(*ring_);
+        if (!usable_) ring_.reset();
+        // Paths and buffers are handed to the kernel by address
+        slots_.reserve(depth_);
+    }
+
+    FileBatch::~FileBatch() {
+        for (auto& [path, d] : dirs_) ::close(d.fd);
+    }
+
+    bool FileBatch::usable() const {
+        return usable_;
+    }
+
+    bool FileBatch::pending(const std::string& dest) const {
+        return pending_.contains(dest);
+    }
+
+    const FileBatch::Dir* FileBatch::dir(const std::string& path) {
+        if (auto it = dirs_.find(path); it != dirs_.end()) return &it->second;
+        Dir d;
+        struct stat st{};
+        d.fd = ::open(path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (d.fd < 0) return nullptr;
+        if (::fstat(d.fd, &st) != 0) {
+            ::close(d.fd);
+            return nullptr;
+        }
+        d.gid = st.st_gid;
+        d.setgid = st.st_mode & S_ISGID;
+        return &dirs_.emplace(path, d).first->second;
+    }
+
+    bool FileBatch::add(File file) {
+        if (!usable_ || file.size > kMaxSize) return fallback_(file);
+        if ((pending_.contains(file.dest) || slots_.size() == depth_) && !flush())
+            return false;
+
+        const fs::path dest(file.dest);
+        const Dir* parent = dir(dest.parent_path().string());
+        if (!parent) return fallback_(file);
+        const int dfd = parent->fd;
+
+        const auto index = static_cast<unsigned>(slots_.size());
+        Slot& s = slots_.emplace_back();
+        s.file = std::move(file);
+        s.dir = parent;
+        s.name = dest.filename().string();
+        s.tmp = s.name + ".gradient-new";
+        s.data.resize(s.file.size);
+        pending_.insert(s.file.dest);
+
+        // Every op of the chain runs only if the previous one did all of its
+        // work; a short read or write cancels the rest.
+        auto next = [&](__u8 op, unsigned step, bool link) {
+            io_uring_sqe* sqe = ring_->sqe();
+            sqe->opcode = op;
+            sqe->user_data = index * kOpsPerFile + step;
+            if (link) sqe->flags |= IOSQE_IO_LINK;
+            return sqe;
+        };
+        io_uring_sqe* sqe = next(IORING_OP_READ, 0, true);
+        sqe->fd = source_;
+        sqe->addr = reinterpret_cast<__u64>(s.data.data());
+        sqe->len = static_cast<__u32>(s.file.size);
+        sqe->off = s.file.offset;
+
+        // Special bits only once the owner is right, in flush()
+        sqe = next(IORING_OP_OPENAT, 1, true);
+        sqe->fd = dfd;
+        sqe->addr = reinterpret_cast<__u64>(s.tmp.c_str());
+        sqe->len = s.file.mode & 0777;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL;   // direct: never in the fd table
+        sqe->file_index = index + 1;
+
+        sqe = next(IORING_OP_WRITE, 2, true);
+        sqe->fd = static_cast<__s32>(index);
+        sqe->flags |= IOSQE_FIXED_FILE;
+        sqe->addr = reinterpret_cast<__u64>(s.data.data());
+        sqe->len = static_cast<__u32>(s.file.size);
+        sqe->off = 0;
+
+        sqe = next(IORING_OP_CLOSE, 3, false);
+        sqe->file_index = index + 1;
+        return true;
+    }
+
+    bool FileBatch::flush() {
+        if (slots_.empty()) return true;
+        const auto total = static_cast<unsigned>(slots_.size()) * kOpsPerFile;
+
+        // Every op completes, cancelled or not, before the buffers and
+        // names it points at may go
+        const bool submitted = ring_->submit(0);
+        unsigned seen = 0;
+        io_uring_cqe cqe{};
+        while (submitted && seen < total && ring_->wait(cqe)) {
+            ++seen;
+            Slot& s = slots_[cqe.user_data / kOpsPerFile];
+            const unsigned step = cqe.user_data % kOpsPerFile;
+            const bool sized = step == 0 || step == 2;
+            if (s.error) continue;
+            if (cqe.res < 0) s.error = -cqe.res;
+            else if (sized && static_cast<std::uint64_t>(cqe.res) != s.file.size) s.error = EIO;
+        }
+        if (seen < total) {
+            // The ring is broken and the kernel may still own some of the
+            // slots: leave them allocated for good and write everything
+            // with plain syscalls from now on
+            std::vector<std::pair<int, std::string>> scratch;
+            std::vector<File> files;
+            for (auto& s : slots_) {
+                scratch.emplace_back(s.dir->fd, s.tmp);
+                files.push_back(s.file);
+            }
+            new std::vector<Slot>(std::move(slots_));
+            static_cast<void>(ring_.release());
+            usable_ = false;
+            slots_ = {};
+            pending_.clear();
+            bool ok = true;
+            for (size_t i = 0; i < files.size(); ++i) {
+                ::unlinkat(scratch[i].first, scratch[i].second.c_str(), 0);
+                ok = fallback_(files[i]) && ok;
+            }
+            return ok;
+        }
+
+        // What io_uring cannot do, all on the scratch name so the file only
+        // appears under its own once complete: chown when it did not come
+        // out owned right, chmod where the umask (or that chown) trimmed
+        // the mode, utimensat, then the rename
+        const mode_t mask = currentUmask();
+        const uid_t euid = ::geteuid();
+        const gid_t egid = ::getegid();
+        bool ok = true;
+        for (auto& s : slots_) {
+            const int dfd = s.dir->fd;
+            if (s.error) {
+                ::unlinkat(dfd, s.tmp.c_str(), 0);
+                ok = fallback_(s.file) && ok;
+                continue;
+            }
+            const gid_t created = s.dir->setgid ? s.dir->gid : egid;
+            const bool chowned = s.file.own && (s.file.uid != euid || s.file.gid != created);
+            const mode_t mode = s.file.mode & 07777;
+            const timespec times[2] = {{0, UTIME_NOW}, {static_cast<time_t>(s.file.mtime), 0}};
+            if ((chowned
+                 && ::fchownat(dfd, s.tmp.c_str(), s.file.uid, s.file.gid, AT_SYMLINK_NOFOLLOW) != 0)
+                || ((chowned || (mode & (mask | 07000))) && ::fchmodat(dfd, s.tmp.c_str(), mode, 0) != 0))
+            {
+                ::unlinkat(dfd, s.tmp.c_str(), 0);
+                ok = fallback_(s.file) && ok;
+                continue;
+            }
+            ::utimensat(dfd, s.tmp.c_str(), times, AT_SYMLINK_NOFOLLOW);
+            if (::renameat(dfd, s.tmp.c_str(), dfd, s.name.c_str()) != 0) {
+                ::unlinkat(dfd, s.tmp.c_str(), 0);
+                ok = fallback_(s.file) && ok;
+            }
+        }
+        slots_.clear();
+        pending_.clear();
+        return ok;
+    }
+
+} // namespace gradient
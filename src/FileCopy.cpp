@@ -0,0 +1,91 @@
+// src/FileCopy.cpp
+
+#include "FileCopy.h"
+
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace gradient {
+
+    namespace {
+        bool readWrite(int in, off_t offset, int out, std::uint64_t len) {
+            char buf[1 << 16];
+            while (len) {
+                ssize_t n = ::pread(in, buf, len < sizeof buf ? len : sizeof buf, offset);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                for (ssize_t off = 0; off < n; ) {
+                    ssize_t w = ::write(out, buf + off, n - off);
+                    if (w < 0) {
+                        if (errno == EINTR) continue;
+                        return false;
+                    }
+                    off += w;
+                }
+                offset += n;
+                len -= static_cast<std::uint64_t>(n);
+            }
+            return true;
+        }
+    }
+
+    bool FileCopy::range(int in, off_t offset, int out, std::uint64_t len, Method* how) {
+        if (how) *how = Method::ReadWrite;
+        if (len == 0) return true;
+
+        // 1) Share extents when the range is block-aligned on both sides
+        struct stat st{};
+        const off_t outPos = ::lseek(out, 0, SEEK_CUR);
+        if (::fstat(in, &st) == 0 && st.st_blksize > 0 && outPos >= 0) {
+            const auto blk = static_cast<std::uint64_t>(st.st_blksize);
+            const bool toEof = static_cast<std::uint64_t>(offset) + len == static_cast<std::uint64_t>(st.st_size);
+            if (offset % blk == 0 && outPos % blk == 0 && (len % blk == 0 || toEof)) {
+                file_clone_range r{in, static_cast<__u64>(offset), len, static_cast<__u64>(outPos)};
+                if (::ioctl(out, FICLONERANGE, &r) == 0) {
+                    ::lseek(out, static_cast<off_t>(outPos + len), SEEK_SET);
+                    if (how) *how = Method::Clone;
+                    return true;
+                }
+            }
+        }
+
+        // 2) Let the kernel copy; it reflinks by itself where it can
+        off_t inOff = offset;
+        std::uint64_t left = len;
+        while (left) {
+            ssize_t n = ::copy_file_range(in, &inOff, out, nullptr, left, 0);
+            if (n > 0) {
+                left -= static_cast<std::uint64_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            // Unsupported here (cross-filesystem on old kernels, procfs...)
+            if (n < 0 && left == len
+                && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL))
+                break;
+            return false;
+        }
+        if (!left) {
+            if (how) *how = Method::CopyRange;
+            return true;
+        }
+
+        // 3) Plain copy
+        return readWrite(in, offset, out, len);
+    }
+
+    bool FileCopy::whole(int in, int out, Method* how) {
+        if (::ioctl(out, FICLONE, in) == 0) {
+            if (how) *how = Method::Clone;
+            return true;
+        }
+        struct stat st{};
+        if (::fstat(in, &st) != 0) return false;
+        return range(in, 0, out, static_cast<std::uint64_t>(st.st_size), how);
+    }
+
+} // namespace gradient
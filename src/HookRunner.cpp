@@ -0,0 +1,195 @@
+// src/HookRunner.cpp
+
+#include "HookRunner.h"
+#include "ScriptExecutor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        std::mutex outputMutex;
+    }
+
+    HookRunner::HookRunner(std::string rootDir, const unsigned jobs)
+        : rootDir_(std::move(rootDir))
+        , limit_(jobs ? jobs : std::max(1u, std::thread::hardware_concurrency()))
+        , useWorker_(!rootDir_.empty() && rootDir_ != "/")
+    {}
+
+    void HookRunner::add(HookJob job) {
+        jobs_.push_back(std::move(job));
+    }
+
+    std::vector<std::vector<size_t>> HookRunner::waves(const std::vector<size_t>& subset) const {
+        // name (or provided name) -> job index, within the subset only
+        std::unordered_map<std::string, size_t> byName;
+        for (auto i : subset) {
+            byName.emplace(jobs_[i].package, i);
+            for (auto& p : jobs_[i].provides) byName.emplace(p, i);
+        }
+
+        // wave = 1 + deepest wave among batch dependencies; cycles are cut
+        std::unordered_map<size_t, int> level;
+        std::unordered_map<size_t, bool> visiting;
+        std::function<int(size_t)> depth = [&](size_t i) -> int {
+            if (auto it = level.find(i); it != level.end()) return it->second;
+            if (visiting[i]) return 0;
+            visiting[i] = true;
+            int d = 0;
+            for (auto& dep : jobs_[i].deps) {
+                auto it = byName.find(dep);
+                if (it != byName.end() && it->second != i)
+                    d = std::max(d, depth(it->second) + 1);
+            }
+            visiting[i] = false;
+            return level[i] = d;
+        };
+
+        std::vector<std::vector<size_t>> out;
+        for (auto i : subset) {
+            auto d = static_cast<size_t>(depth(i));
+            if (out.size() <= d) out.resize(d + 1);
+            out[d].push_back(i);
+        }
+        return out;
+    }
+
+    void HookRunner::report(const HookJob& job, const std::string& output,
+                            const int rc, const bool present) {
+        std::lock_guard<std::mutex> lk(outputMutex);
+        if (!present) {
+            std::cerr << "\033[33minfo:\033[0m script '" << job.script
+                      << "' not found; skipping hooks\n";
+        }
+        std::cout << output << std::flush;
+        if (rc != 0) {
+            std::cerr << "\033[33mwarning:\033[0m hook '" << job.hook
+                      << "' in script '" << job.script
+                      << "' exited with code " << rc << "\n";
+        }
+    }
+
+    void HookRunner::discard(const HookJob& job, const bool present) {
+        if (!job.discardScript) return;
+        std::error_code ec;
+        if (present && !fs::remove(job.script, ec)) {
+            std::lock_guard<std::mutex> lk(outputMutex);
+            std::cerr << "\033[33mwarning:\033[0m Failed to remove script '"
+                      << job.script << "'.\n";
+        }
+    }
+
+    void HookRunner::runOne(const HookJob& job) const {
+        std::string output;
+        int rc = 0;
+        const bool present = fs::exists(job.script);
+        if (present)
+            rc = ScriptExecutor::runHook(job.script, job.hook, rootDir_, output);
+        report(job, output, rc, present);
+        discard(job, present);
+    }
+
+    bool HookRunner::runWaveInWorker(std::vector<size_t>& wave) {
+        if (!worker_) {
+            worker_ = std::make_unique<HookWorker>(rootDir_);
+            if (!worker_->start()) {
+                worker_.reset();
+                useWorker_ = false;
+                return false;
+            }
+        }
+
+        std::unordered_map<int, size_t> inFlight;   // worker id -> job index
+        std::vector<size_t> unfinished;
+        size_t sent = 0;
+        bool alive = true;
+        while (alive && (sent < wave.size() || !inFlight.empty())) {
+            // Keep up to limit_ hooks in flight
+            while (sent < wave.size() && inFlight.size() < limit_) {
+                const size_t i = wave[sent++];
+                const HookJob& job = jobs_[i];
+                if (!fs::exists(job.script)) {
+                    report(job, "", 0, false);
+                    continue;
+                }
+                const int id = worker_->submit(job.script, job.hook);
+                if (id < 0) {
+                    unfinished.push_back(i);
+                    alive = false;
+                    break;
+                }
+                inFlight.emplace(id, i);
+            }
+            if (!alive || inFlight.empty()) break;
+
+            int id = 0, rc = 0;
+            if (!worker_->next(id, rc)) {
+                alive = false;
+                break;
+            }
+            auto it = inFlight.find(id);
+            if (it == inFlight.end()) continue;
+            const HookJob& job = jobs_[it->second];
+            report(job, worker_->takeOutput(id), rc, true);
+            discard(job, true);
+            inFlight.erase(it);
+        }
+        if (alive) return true;
+
+        // The worker died: hand back everything it did not finish
+        for (auto& [id, i] : inFlight) unfinished.push_back(i);
+        unfinished.insert(unfinished.end(), wave.begin() + static_cast<long>(sent), wave.end());
+        std::sort(unfinished.begin(), unfinished.end());
+        wave = std::move(unfinished);
+        worker_.reset();
+        useWorker_ = false;
+        std::cerr << "\033[33mwarning:\033[0m hook worker exited; running remaining hooks one by one\n";
+        return false;
+    }
+
+    void HookRunner::runWave(const std::vector<size_t>& all) {
+        std::vector<size_t> wave = all;
+        if (useWorker_ && runWaveInWorker(wave))
+            return;
+
+        const size_t workers = std::min<size_t>(limit_, wave.size());
+        if (workers <= 1) {
+            for (auto i : wave) runOne(jobs_[i]);
+            return;
+        }
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> pool;
+        for (size_t w = 0; w < workers; ++w) {
+            pool.emplace_back([&] {
+                for (size_t k; (k = next++) < wave.size(); )
+                    runOne(jobs_[wave[k]]);
+            });
+        }
+        for (auto& t : pool) t.join();
+    }
+
+    void HookRunner::run() {
+        std::vector<size_t> removals, installs;
+        for (size_t i = 0; i < jobs_.size(); ++i)
+            (jobs_[i].hook == "post_remove" ? removals : installs).push_back(i);
+
+        // Dependents are torn down before what they depend on...
+        auto down = waves(removals);
+        for (auto it = down.rbegin(); it != down.rend(); ++it) runWave(*it);
+        // ...and set up after it
+        for (auto& wave : waves(installs)) runWave(wave);
+        jobs_.clear();
+    }
+
+} // namespace gradient
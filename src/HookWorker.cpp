@@ -0,0 +1,164 @@
+// src/HookWorker.cpp
+
+#include "HookWorker.h"
+#include "ScriptExecutor.h"
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        // $1 = in-root scratch directory. Three lines per request: id,
+        // script, hook. Each request runs in a background subshell.
+        constexpr const char* kWorkerLoop =
+            "out=$1\n"
+            "while IFS= read -r id && IFS= read -r script && IFS= read -r hook; do\n"
+            "  {\n"
+            "    ( set -e; . \"$script\"\n"
+            "      if command -v post_common >/dev/null 2>&1; then post_common; fi\n"
+            "      if command -v \"$hook\" >/dev/null 2>&1; then \"$hook\"; fi\n"
+            "    ) >\"$out/$id\" 2>&1 </dev/null\n"
+            "    echo \"$id $?\"\n"
+            "  } &\n"
+            "done\n"
+            "wait\n";
+
+        const char* const kWorkerEnv[] = {
+            "PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin",
+            "HOME=/",
+            "SHELL=/bin/sh",
+            "LC_ALL=C",
+            nullptr
+        };
+    }
+
+    HookWorker::HookWorker(std::string rootDir)
+        : rootDir_(std::move(rootDir))
+    {}
+
+    HookWorker::~HookWorker() {
+        stop();
+    }
+
+    bool HookWorker::start() {
+        // Scratch directory for hook output, visible from inside the root
+        fs::path base = fs::path(rootDir_) / "var/lib/gradient";
+        std::error_code ec;
+        fs::create_directories(base, ec);
+        std::string tmpl = (base / "hooks.XXXXXX").string();
+        if (!mkdtemp(tmpl.data())) return false;
+        outDir_ = tmpl;
+        const std::string inRoot = ScriptExecutor::pathInRoot(outDir_, rootDir_);
+
+        // Sockets rather than pipes so a dead worker is an EPIPE, not a SIGPIPE
+        int in[2], out[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, in) != 0) return false;
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, out) != 0) {
+            close(in[0]); close(in[1]);
+            return false;
+        }
+
+        std::vector<std::string> argv = {"/bin/sh", "-c", kWorkerLoop, "gradient-hooks", inRoot};
+        std::vector<char*> args;
+        for (auto& a : argv) args.push_back(a.data());
+        args.push_back(nullptr);
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+            return false;
+        }
+        if (pid == 0) {
+            if (chroot(rootDir_.c_str()) != 0 || chdir("/") != 0) _exit(126);
+            dup2(in[1], STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+            execve(args[0], args.data(), const_cast<char* const*>(kWorkerEnv));
+            _exit(127);
+        }
+
+        close(in[1]);
+        close(out[1]);
+        pid_ = pid;
+        toWorker_ = in[0];
+        fromWorker_ = fdopen(out[0], "r");
+        if (!fromWorker_) {
+            close(out[0]);
+            stop();
+            return false;
+        }
+        return true;
+    }
+
+    int HookWorker::submit(const std::string& script, const std::string& hook) {
+        if (toWorker_ < 0) return -1;
+        const int id = nextId_++;
+        const std::string req = std::to_string(id) + "\n"
+                              + ScriptExecutor::pathInRoot(script, rootDir_) + "\n"
+                              + hook + "\n";
+        const char* p = req.data();
+        size_t left = req.size();
+        while (left > 0) {
+            ssize_t n = send(toWorker_, p, left, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        return id;
+    }
+
+    bool HookWorker::next(int& id, int& status) {
+        if (!fromWorker_) return false;
+        char* line = nullptr;
+        size_t cap = 0;
+        const bool ok = getline(&line, &cap, fromWorker_) > 0
+                     && std::sscanf(line, "%d %d", &id, &status) == 2;
+        std::free(line);
+        return ok;
+    }
+
+    std::string HookWorker::takeOutput(const int id) {
+        fs::path file = fs::path(outDir_) / std::to_string(id);
+        std::ifstream in(file, std::ios::binary);
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        std::error_code ec;
+        fs::remove(file, ec);
+        return ss.str();
+    }
+
+    void HookWorker::stop() {
+        // EOF on stdin ends the loop; the shell waits for stragglers
+        if (toWorker_ >= 0) {
+            close(toWorker_);
+            toWorker_ = -1;
+        }
+        if (fromWorker_) {
+            fclose(fromWorker_);
+            fromWorker_ = nullptr;
+        }
+        if (pid_ > 0) {
+            int st;
+            while (waitpid(pid_, &st, 0) < 0 && errno == EINTR) {}
+            pid_ = -1;
+        }
+        if (!outDir_.empty()) {
+            std::error_code ec;
+            fs::remove_all(outDir_, ec);
+            outDir_.clear();
+        }
+    }
+
+} // namespace gradient
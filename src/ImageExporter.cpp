@@ -0,0 +1,270 @@
+// src/ImageExporter.cpp
+
+#include "ImageExporter.h"
+#include "Database.h"
+#include "PackageSet.h"
+#include "TarStream.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        constexpr const char* kStateDir = "var/lib/gradient";
+
+        /// SOURCE_DATE_EPOCH, if set: the latest mtime allowed in the image
+        /// and the mtime of everything gradient generates.
+        std::int64_t sourceDateEpoch(bool& set) {
+            const char* env = std::getenv("SOURCE_DATE_EPOCH");
+            set = env && *env;
+            return set ? std::strtoll(env, nullptr, 10) : 0;
+        }
+
+        /// One output tar: writes each directory once, parents first.
+        class Layer {
+        public:
+            Layer(FILE* out, std::int64_t epoch) : tar_(out), epoch_(epoch) {}
+
+            TarWriter& tar() { return tar_; }
+
+            /// Emit `path` (relative, no trailing '/') unless already there;
+            /// false means it was there already.
+            bool claimDir(const std::string& path) { return dirs_.insert(path).second; }
+
+            bool parents(const std::string& path) {
+                for (size_t pos = path.find('/'); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+                    std::string dir = path.substr(0, pos);
+                    if (!claimDir(dir)) continue;
+                    TarEntry d;
+                    d.path = dir + "/";
+                    d.type = '5';
+                    d.mode = 0755;
+                    d.uname = d.gname = "root";
+                    d.mtime = epoch_;
+                    if (!tar_.begin(d) || !tar_.end()) return false;
+                }
+                return true;
+            }
+
+            bool file(const std::string& path, const std::string& data, std::uint32_t mode) {
+                TarEntry f;
+                f.path = path;
+                f.mode = mode;
+                f.size = data.size();
+                f.uname = f.gname = "root";
+                f.mtime = epoch_;
+                return parents(path) && tar_.add(f, data);
+            }
+
+        private:
+            TarWriter tar_;
+            std::int64_t epoch_;
+            std::unordered_set<std::string> dirs_;
+        };
+
+        /// Copy the payload of `member` into `layer`, renamed from
+        /// package/<path> to <path>.
+        bool streamPayload(const PackageSet::Member& member, Layer& layer,
+                           bool clamp, std::int64_t epoch) {
+            if (member.idx.payloadMember.empty()) return true;
+            const std::string prefix = member.idx.payloadMember + "/";
+            auto strip = [&](std::string& p) {
+                if (!p.starts_with(prefix)) return false;
+                p.erase(0, prefix.size());
+                return true;
+            };
+
+            TarReader in(member.archive);
+            if (!in.open()) return false;
+            TarEntry e;
+            while (in.next(e)) {
+                if (!strip(e.path) || e.path.empty()) continue;
+                if (e.sparse || e.acl) {
+                    std::cerr << "\033[31merror:\033[0m '" << member.archive << "': '" << e.path
+                              << (e.sparse ? "' is a sparse file" : "' carries ACLs")
+                              << ", which export-image cannot carry over\n";
+                    return false;
+                }
+                if (e.type == '1') strip(e.linkpath);   // hard links name a member
+                if (clamp) e.mtime = std::min(e.mtime, epoch);
+
+                if (e.type == '5') {
+                    std::string dir = e.path.back() == '/' ? e.path.substr(0, e.path.size() - 1) : e.path;
+                    if (!layer.claimDir(dir)) continue;
+                    e.path = dir + "/";
+                }
+                if (!layer.tar().begin(e)
+                    || !in.read([&](const char* d, size_t n) { return layer.tar().write(d, n); })
+                    || !layer.tar().end())
+                {
+                    return false;
+                }
+            }
+            if (in.failed())
+                std::cerr << "\033[31merror:\033[0m '" << member.archive << "' is damaged or not a tar archive\n";
+            return !in.failed();
+        }
+
+        bool readFile(const std::string& path, std::string& out) {
+            std::ifstream in(path, std::ios::binary);
+            out.assign(std::istreambuf_iterator<char>(in), {});
+            return !in.bad();
+        }
+    }
+
+    ImageExporter::ImageExporter(std::string out, bool layers, bool force)
+        : out_(std::move(out))
+        , layers_(layers)
+        , force_(force)
+    {}
+
+    bool ImageExporter::run(const std::vector<std::string>& archives, const ExportedFn& onExported) {
+        // 1) Read and check the set as if installing it into an empty root
+        PackageSet set;
+        if (!set.read(archives, std::max(1u, std::thread::hardware_concurrency())))
+            return false;
+
+        Database db(":memory:");
+        if (!db.open() || !db.initSchema()) {
+            std::cerr << "\033[31merror:\033[0m Unable to open in-memory database.\n";
+            return false;
+        }
+        bool overlapping = false;
+        if (!set.check(db, force_, overlapping))
+            return false;
+        auto& members = set.members();
+
+        // 2) Records for the image's gradient.db, with paths as seen inside it
+        auto scriptPath = [](const PackageSet::Member& m) {
+            return m.idx.scriptMember.empty()
+                 ? std::string{}
+                 : "/" + std::string(kStateDir) + "/scripts/" + m.meta.name + "-" + m.meta.version + ".anemonix";
+        };
+        bool ok = db.beginTransaction();
+        for (size_t i = 0; ok && i < members.size(); ++i) {
+            const auto& m = members[i];
+            ok = db.addPackage(m.meta, scriptPath(m));
+            for (size_t k = 0; ok && k < m.idx.paths.size(); ++k)
+                ok = db.logFile(m.meta.name, m.idx.paths[k]);
+            if (ok && m.broken) ok = db.markBroken(m.meta.name, m.broken);
+        }
+        if (!ok || !db.commitTransaction()) {
+            std::cerr << "\033[31merror:\033[0m Failed to build the image database.\n";
+            return false;
+        }
+
+        // SQLite only writes to files; keep the copy just long enough to stream it
+        std::string dbBytes;
+        {
+            fs::path tmp = fs::temp_directory_path() / "gradient_imagedbXXXXXX";
+            std::string tmpl = tmp.string();
+            int fd = mkstemp(tmpl.data());
+            if (fd < 0) {
+                std::cerr << "\033[31merror:\033[0m could not create temp file for the database\n";
+                return false;
+            }
+            close(fd);
+            ok = db.saveTo(tmpl) && readFile(tmpl, dbBytes);
+            std::remove(tmpl.c_str());
+            if (!ok) return false;
+        }
+
+        // 3) Stream everything out
+        bool clamp = false;
+        const std::int64_t epoch = sourceDateEpoch(clamp);
+        std::error_code ec;
+        if (layers_) fs::create_directories(out_, ec);
+
+        auto openOut = [&](const std::string& path) -> FILE* {
+            FILE* f = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+            if (!f) {
+                std::cerr << "\033[31merror:\033[0m cannot write '" << path << "': "
+                          << std::strerror(errno) << "\n";
+            }
+            return f;
+        };
+        auto closeOut = [&](FILE* f, Layer& layer) {
+            bool good = layer.tar().finish();
+            if (f != stdout) good = std::fclose(f) == 0 && good;
+            return good;
+        };
+        auto layerName = [&](size_t n, const std::string& what) {
+            char num[8];
+            std::snprintf(num, sizeof num, "%03zu-", n);
+            return (fs::path(out_) / (num + what + ".tar")).string();
+        };
+
+        FILE* single = nullptr;
+        std::unique_ptr<Layer> image;
+        if (!layers_) {
+            if (!(single = openOut(out_))) return false;
+            image = std::make_unique<Layer>(single, epoch);
+        }
+
+        for (size_t i = 0; i < members.size(); ++i) {
+            const auto& m = members[i];
+            const std::string label = m.meta.name + "-" + m.meta.version;
+            FILE* f = single;
+            std::unique_ptr<Layer> own;
+            if (layers_) {
+                if (!(f = openOut(layerName(i + 1, label)))) return false;
+                own = std::make_unique<Layer>(f, epoch);
+            }
+            Layer& layer = layers_ ? *own : *image;
+
+            bool good = streamPayload(m, layer, clamp, epoch);
+            if (good && !m.script.empty())
+                good = layer.file(scriptPath(m).substr(1), m.script, 0644);
+            if (layers_) good = closeOut(f, layer) && good;
+            if (!good) {
+                std::cerr << "\033[31merror:\033[0m Failed to export '" << label << "'.\n";
+                if (single && single != stdout) std::fclose(single);
+                return false;
+            }
+            if (onExported) onExported(label, i + 1, members.size());
+        }
+
+        // 4) The database last, as its own layer when layering
+        FILE* f = single;
+        std::unique_ptr<Layer> own;
+        if (layers_) {
+            if (!(f = openOut(layerName(members.size() + 1, "gradient-db")))) return false;
+            own = std::make_unique<Layer>(f, epoch);
+        }
+        Layer& layer = layers_ ? *own : *image;
+        if (!layer.file(std::string(kStateDir) + "/gradient.db", dbBytes, 0644) || !closeOut(f, layer)) {
+            std::cerr << "\033[31merror:\033[0m Failed to write the image database.\n";
+            return false;
+        }
+
+        // Hooks and triggers need the image mounted somewhere to run in
+        std::vector<std::string> pending;
+        for (auto& m : members) {
+            if (!m.script.empty() || !m.meta.triggers.empty() || !m.meta.activates.empty())
+                pending.push_back(m.meta.name);
+        }
+        if (!pending.empty()) {
+            std::cerr << "\033[33mwarning:\033[0m hooks and triggers were not run for:";
+            for (auto& n : pending) std::cerr << " " << n;
+            std::cerr << "\n";
+        }
+        return true;
+    }
+
+} // namespace gradient
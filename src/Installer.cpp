@@ -2,11 +2,19 @@
 // Created by cv2 on 6/12/25.
 
 #include "Installer.h"
+#include "ConflictChecker.h"
+#include "IoPolicy.h"
+#include "PayloadWriter.h"
+#include "Staging.h"
 #include "TarHandler.h"
-#include "ScriptExecutor.h"
+#include "YamlParser.h"
 
+#include <sys/stat.h>
 #include <sys/utsname.h>
+#include <unistd.h>
+#include <cerrno>
 #include <filesystem>
+#include <fstream>
 #include <cstdlib>
 #include <iostream>
 #include <ranges>
@@ -31,7 +39,9 @@ Installer::Installer(Database& db,
     , resolver_(db, repo)
     , force_(force)
     , rootDir_(std::move(rootDir))
-    , warnings_(false)
+    , warnings_(0)
+    , triggers_(db)
+    , hooks_(rootDir_)
     , staged_ (staged)
 {}
 
@@ -48,15 +58,34 @@ std::string Installer::makeTempDir() {
 }
 
 bool Installer::installArchive(const std::string& archivePath) {
-    warnings_ = false;
+    return install(archivePath, {});
+}
+
+bool Installer::applyStaged(const std::string& slot) {
+    return install({}, slot);
+}
 
-    // 1) Load metadata
+bool Installer::install(const std::string& archivePath, const std::string& slot) {
+    warnings_ = 0;
+    if (throttle_) throttle_->pace();
+
+    // 1) Load metadata. A plain tar is read in place (its table of contents
+    // and two members) and its files copied straight into the root later;
+    // anything else is unpacked to a temp dir first. A staged package was
+    // unpacked by Staging already and only has to be moved into place.
+    const bool prestaged = !slot.empty();
     Package pkg(archivePath);
-    if (!pkg.loadMetadata()) {
+    const bool direct = !prestaged && !store_ && PayloadWriter::supports(archivePath);
+    ArchiveIndex idx;
+    std::string scriptText;
+    Package::Metadata meta;
+    if (prestaged ? !YamlParser::parseMetadata((fs::path(slot) / "anemonix.yaml").string(), meta)
+                  : direct ? !pkg.inspect(idx, scriptText) : !pkg.loadMetadata())
+    {
         std::cerr << "\033[31merror:\033[0m Failed to read package metadata.\n";
         return false;
     }
-    auto meta = pkg.metadata();
+    if (!prestaged) meta = pkg.metadata();
 
     // 2) Architecture check
     if (auto hostArch = detectHostArch(); (meta.arch != "any" && meta.arch != "all") && meta.arch != hostArch) {
@@ -78,12 +107,10 @@ bool Installer::installArchive(const std::string& archivePath) {
         {
             continue;
         }
-        // skip if any installed pkg Provides it
-        if (db_.isProvided(dep)) continue;
-
-            if (db_.providesSatisfies(c)) {
-                continue;   // dependency is satisfied by some provider at the right version
-            }
+        // skip if any installed pkg Provides it (at the right version)
+        if (db_.providesSatisfies(c)) {
+            continue;
+        }
         // skip if staged install
         if (staged_.contains(dep)) continue;
 
@@ -99,7 +126,7 @@ bool Installer::installArchive(const std::string& archivePath) {
                     std::cerr << "\033[31merror:\033[0m Aborting due to version mismatch.\n";
                     return false;
                 }
-                warnings_ = true;
+                warnings_ |= Broken::Deps;
                 continue;
             }
         }
@@ -111,7 +138,7 @@ bool Installer::installArchive(const std::string& archivePath) {
             std::cerr << "\033[31merror:\033[0m Aborting due to missing dependency.\n";
             return false;
         }
-        warnings_ = true;
+        warnings_ |= Broken::Deps;
     }
 
     // === 4) Conflicts check with version support ===
@@ -126,7 +153,7 @@ bool Installer::installArchive(const std::string& archivePath) {
                     std::cerr << "\033[31merror:\033[0m Aborting due to conflict.\n";
                     return false;
                 }
-                warnings_ = true;
+                warnings_ |= Broken::Conflicts;
             }
         }
     }
@@ -143,46 +170,106 @@ bool Installer::installArchive(const std::string& archivePath) {
         }
     }
 
-    // 6) Extract entire archive
-    auto tmp = makeTempDir();
-    if (tmp.empty() || !TarHandler::extract(archivePath, tmp)) {
+    // Upgrading in place? Remember what the old version owned.
+    std::string prevVersion;
+    const bool upgrading = db_.getPackageVersion(meta.name, prevVersion);
+    const std::string prevScript = upgrading ? db_.getInstallScript(meta.name) : std::string{};
+    const std::vector<std::string> prevFiles = upgrading ? db_.getFiles(meta.name)
+                                                         : std::vector<std::string>{};
+
+    // 6) Extract entire archive (next to the store, so files enter it by link)
+    std::string tmp = slot;
+    if (!direct && !prestaged) tmp = store_ ? store_->makeTempDir() : makeTempDir();
+    struct TempDir {
+        std::string path;
+        ~TempDir() { std::error_code ec; if (!path.empty()) fs::remove_all(path, ec); }
+    } tmpGuard{prestaged ? std::string{} : tmp};
+    if (!direct && !prestaged && (tmp.empty() || !TarHandler::extract(archivePath, tmp))) {
         std::cerr << "\033[31merror:\033[0m Failed to extract package.\n";
         return false;
     }
 
+    // 6b) File conflicts: nothing has been written to the root yet
+    std::vector<std::string> incoming;
+    {
+        fs::path payload = fs::path(tmp) / "package";
+        if (direct) {
+            incoming = idx.paths;
+        } else if (fs::is_directory(payload)) {
+            for (auto& entry : fs::recursive_directory_iterator(payload)) {
+                if (entry.is_symlink() || entry.is_regular_file())
+                    incoming.push_back((fs::path("/") / fs::relative(entry.path(), payload)).string());
+            }
+        }
+        ConflictChecker checker(db_);
+        checker.addPackage(meta.name, incoming, meta.replaces);
+        if (auto conflicts = checker.check(); !conflicts.empty()) {
+            ConflictChecker::report(conflicts);
+            if (!force_) {
+                std::cerr << "\033[31merror:\033[0m Aborting due to file conflicts.\n";
+                return false;
+            }
+            warnings_ |= Broken::Files;
+        }
+    }
+
     // 7) Locate any install.gradientnix script under tmp
     fs::path scriptSrc;
-    for (auto& entry : fs::recursive_directory_iterator(tmp)) {
-        if (entry.is_regular_file() &&
-            entry.path().filename() == "install.anemonix")
-        {
-            scriptSrc = entry.path();
-            break;
+    if (prestaged) {
+        scriptSrc = fs::path(tmp) / "install.anemonix";
+    } else if (!direct) {
+        for (auto& entry : fs::recursive_directory_iterator(tmp)) {
+            if (entry.is_regular_file() &&
+                entry.path().filename() == "install.anemonix")
+            {
+                scriptSrc = entry.path();
+                break;
+            }
         }
     }
 
     // 7) Persist install script (if present)
     std::string storedScriptPath;
-    if (fs::exists(scriptSrc) && fs::is_regular_file(scriptSrc)) {
+    if (direct ? !idx.scriptMember.empty()
+               : fs::exists(scriptSrc) && fs::is_regular_file(scriptSrc)) {
         fs::path scriptsDir = fs::path(rootDir_) / "var/lib/gradient/scripts";
         fs::create_directories(scriptsDir);
         std::string scriptName = meta.name + "-" + meta.version + ".anemonix";
         fs::path scriptDst = scriptsDir / scriptName;
-        fs::copy_file(scriptSrc, scriptDst, fs::copy_options::overwrite_existing);
+        if (direct)
+            std::ofstream(scriptDst, std::ios::binary | std::ios::trunc) << scriptText;
+        else
+            fs::copy_file(scriptSrc, scriptDst, fs::copy_options::overwrite_existing);
         storedScriptPath = scriptDst.string();
     }
 
     // 8) Prepare for rollback
     std::vector<fs::path> installedFiles;
+    std::vector<std::string> recordPaths;
     auto rollback = [&]() {
         if (!db_.rollbackTransaction()) {
             std::cerr << "\033[31merror:\033[0m Failed to rollback transaction.\n";
         }
-        for (auto & installedFile : std::ranges::reverse_view(installedFiles)) {
-            fs::remove(installedFile);
+        // A path some package still owns once the records are rolled back
+        // (the old version's, on an upgrade) now holds this version's data:
+        // it stays, and its owner is marked broken instead
+        std::unordered_set<std::string> owned, overwritten;
+        for (auto& [path, owner] : db_.getOwners(recordPaths)) {
+            owned.insert(path);
+            overwritten.insert(owner);
+        }
+        for (size_t i = installedFiles.size(); i-- > 0; ) {
+            std::error_code ec;
+            if (!owned.contains(recordPaths[i])) fs::remove(installedFiles[i], ec);
         }
-        if (!storedScriptPath.empty()) {
-            fs::remove(storedScriptPath);
+        for (auto& owner : overwritten) {
+            std::cerr << "\033[33mwarning:\033[0m files of '" << owner
+                      << "' were overwritten; marking as broken.\n";
+            db_.markBroken(owner, Broken::Files);
+        }
+        if (!storedScriptPath.empty() && storedScriptPath != prevScript) {
+            std::error_code ec;
+            fs::remove(storedScriptPath, ec);
         }
     };
 
@@ -198,16 +285,23 @@ bool Installer::installArchive(const std::string& archivePath) {
         rollback();
         return false;
     }
+    if (upgrading && !db_.removeFiles(meta.name)) {
+        std::cerr << "\033[31merror:\033[0m Failed to clear old file records.\n";
+        rollback();
+        return false;
+    }
 
     // 11) Locate package/ directory
     fs::path pkgRoot;
-    for (auto& entry : fs::recursive_directory_iterator(tmp)) {
-        if (entry.is_directory() && entry.path().filename() == "package") {
-            pkgRoot = entry.path();
-            break;
+    if (!direct) {
+        for (auto& entry : fs::recursive_directory_iterator(tmp)) {
+            if (entry.is_directory() && entry.path().filename() == "package") {
+                pkgRoot = entry.path();
+                break;
+            }
         }
     }
-    if (pkgRoot.empty()) {
+    if (pkgRoot.empty() && !direct) {
         fs::path candidate = fs::path(tmp) / "package";
         pkgRoot = (fs::exists(candidate) && fs::is_directory(candidate))
                   ? candidate
@@ -217,53 +311,94 @@ bool Installer::installArchive(const std::string& archivePath) {
     // 12) Install files & log them by extracting via tar (preserves symlinks)
     {
         fs::path pkg_root = fs::path(tmp) / "package";
-        bool hasFiles = fs::exists(pkg_root)
-                     && fs::is_directory(pkg_root)
-                     && !fs::is_empty(pkg_root);
+        bool hasFiles = direct ? !idx.payloadMember.empty()
+                               : fs::exists(pkg_root)
+                                 && fs::is_directory(pkg_root)
+                                 && !fs::is_empty(pkg_root);
 
         if (!hasFiles) {
             std::cerr << "\033[33minfo:\033[0m package contains no files; skipping file installation\n";
-        } else {
-            // (a) Stream pkgRoot into rootDir_, preserving ACLs, xattrs, symlinks, perms
-            //
-            //   tar --acls --xattrs -C pkgRoot -cf - . \
-            //     | tar --acls --xattrs -C rootDir_ -xpf -
-            //
-            // -c: create, -f - : write to stdout
-            // -x: extract, -f - : read from stdin, -p: preserve permissions
-            // --acls, --xattrs: preserve ACLs and extended attributes
-            std::string tarCmd =
-                "tar --acls --xattrs -C '"  + pkg_root.string()  + "' -cf - . "
-                "| "
-                "tar --acls --xattrs -C '"  + rootDir_        + "' -xpf -";
-            if (std::system(tarCmd.c_str()) != 0) {
-                std::cerr << "\033[31merror:\033[0m Failed to extract package files via tar pipeline.\n";
+        } else if (direct) {
+            // (a'') Data is cloned or copied straight out of the archive
+            if (!PayloadWriter::extract(archivePath, idx, rootDir_, throttle_)) {
+                std::cerr << "\033[31merror:\033[0m Failed to install package files.\n";
                 rollback();
                 return false;
             }
+        } else {
+            // (a''') A staged tree is renamed into place, unless the store
+            // is to hold its files; whatever lies on another filesystem is
+            // left behind and copied below
+            const bool fromStore = store_ && storable(pkg_root);
+            bool placed = false;
+            if (prestaged && !fromStore) {
+                placed = Staging::move(pkg_root.string(), rootDir_);
+                if (!placed && errno != EXDEV) {
+                    std::cerr << "\033[31merror:\033[0m Failed to move staged files into place.\n";
+                    rollback();
+                    return false;
+                }
+            }
 
-            // (b) Walk pkgRoot to log every regular file and symlink we just installed
-            for (auto& entry : fs::recursive_directory_iterator(pkg_root)) {
-                if (!fs::is_regular_file(entry.path())
-                 && !fs::is_symlink(entry.path()))
-                {
-                    continue;
+            if (placed) {
+                // nothing left to copy
+            } else if (fromStore) {
+                // (a') Files come from the content-addressed store
+                if (!materializeTree(pkg_root, meta.backup)) {
+                    std::cerr << "\033[31merror:\033[0m Failed to install package files from the store.\n";
+                    rollback();
+                    return false;
                 }
-                auto rel = fs::relative(entry.path(), pkg_root);
-                // recordPath is absolute on the target system
-                std::string recordPath = (fs::path("/") / rel).string();
+            } else {
+                // (a) Stream pkgRoot into rootDir_, preserving ACLs, xattrs, symlinks, perms
+                //
+                //   tar --acls --xattrs -C pkgRoot -cf - . \
+                //     | tar --acls --xattrs -C rootDir_ -xpf -
+                //
+                // -c: create, -f - : write to stdout
+                // -x: extract, -f - : read from stdin, -p: preserve permissions
+                // --acls, --xattrs: preserve ACLs and extended attributes
+                std::string tarCmd =
+                    "tar --acls --xattrs -C '"  + pkg_root.string()  + "' -cf - . "
+                    "| "
+                    "tar --acls --xattrs -C '"  + rootDir_        + "' -xpf -";
+                if (std::system(tarCmd.c_str()) != 0) {
+                    std::cerr << "\033[31merror:\033[0m Failed to extract package files via tar pipeline.\n";
+                    rollback();
+                    return false;
+                }
+            }
+        }
+
+        // (b) Log every regular file and symlink we just installed: the
+        // archive's table of contents, or what 6b found walking pkgRoot (a
+        // staged pkgRoot has been moved away by now)
+        if (hasFiles) {
+            for (const auto& recordPath : incoming) {
                 if (!db_.logFile(meta.name, recordPath)) {
                     std::cerr << "\033[31merror:\033[0m Failed logging file '"
                               << recordPath << "'.\n";
                     rollback();
                     return false;
                 }
-                installedFiles.emplace_back(fs::path(rootDir_) / rel);
+                installedFiles.emplace_back(fs::path(rootDir_) / recordPath.substr(1));
+                recordPaths.push_back(recordPath);
             }
         }
     }
 
 
+    // 12b) Files reach the disk before the database says they are there
+    std::vector<std::string> written;
+    written.reserve(installedFiles.size() + 1);
+    for (auto& f : installedFiles) written.push_back(f.string());
+    if (!storedScriptPath.empty()) written.push_back(storedScriptPath);
+    if (!Durability::barrier(durability_, rootDir_, written)) {
+        std::cerr << "\033[31merror:\033[0m Package files could not be flushed; not committing.\n";
+        rollback();
+        return false;
+    }
+
     // 13) Commit transaction
     if (!db_.commitTransaction()) {
         std::cerr << "\033[31merror:\033[0m Failed to commit DB transaction.\n";
@@ -271,25 +406,122 @@ bool Installer::installArchive(const std::string& archivePath) {
         return false;
     }
 
+    // On upgrade, drop files the new version no longer ships, unless a
+    // package earlier in this transaction took them over (replaces:)
+    if (upgrading) {
+        std::unordered_set<std::string> current(recordPaths.begin(), recordPaths.end());
+        std::vector<std::string> dropped;
+        for (auto& f : prevFiles) {
+            if (!current.contains(f)) dropped.push_back(f);
+        }
+        std::unordered_set<std::string> taken;
+        for (auto& [path, owner] : db_.getOwners(dropped)) taken.insert(path);
+        for (auto& f : dropped) {
+            if (taken.contains(f)) continue;
+            std::error_code ec;
+            fs::remove(fs::path(rootDir_) / f.substr(1), ec);
+            recordPaths.push_back(f);
+        }
+        if (!prevScript.empty() && prevScript != storedScriptPath) {
+            std::error_code ec;
+            fs::remove(prevScript, ec);
+        }
+    }
+
+    // 13a) Leave the page cache to the services running on this host
+    if (gentle_) {
+        written.push_back(archivePath);
+        IoPolicy::dropCache(written);
+    }
+
+    // 13b) Queue triggers; they run once at the end of the transaction
+    triggers_.pathsChanged(recordPaths);
+    for (auto& name : meta.activates)
+        triggers_.activate(name);
+
     // 14) Mark broken if forced with warnings
     if (warnings_ && force_) {
         std::cout << "\033[33mwarning:\033[0m Package installed with warnings; marking as broken.\n";
-        return db_.markBroken(meta.name);
+        return db_.markBroken(meta.name, warnings_);
     }
 
-    // 15) Run post-install hook
+    // 15) Queue post-install (or post-upgrade) hook for the end of the transaction
     if (!storedScriptPath.empty()) {
-        ScriptExecutor::runScript(storedScriptPath, "post_install", rootDir_);
+        hooks_.add({meta.name, Tools::bareNames(meta.provides), Tools::bareNames(meta.deps),
+                    storedScriptPath, upgrading ? "post_upgrade" : "post_install"});
     }
 
     // 16) Success
-    std::cout << "\033[32msuccess:\033[0m Installed '"
-              << meta.name << "-" << meta.version << "'.\n";
+    if (upgrading && prevVersion == meta.version) {
+        std::cout << "\033[32msuccess:\033[0m Reinstalled '"
+                  << meta.name << "-" << meta.version << "'.\n";
+    } else if (upgrading) {
+        std::cout << "\033[32msuccess:\033[0m Upgraded '"
+                  << meta.name << "' " << prevVersion << " -> " << meta.version << ".\n";
+    } else {
+        std::cout << "\033[32msuccess:\033[0m Installed '"
+                  << meta.name << "-" << meta.version << "'.\n";
+    }
 
     return true;
 }
 
-bool Installer::removePackage(const std::string& name) const {
+/// The store holds regular files only; packages shipping device nodes or
+/// FIFOs go through the tar pipeline as before.
+bool Installer::storable(const fs::path& pkgRoot) {
+    for (auto& entry : fs::recursive_directory_iterator(pkgRoot)) {
+        auto st = entry.symlink_status();
+        if (!fs::is_directory(st) && !fs::is_symlink(st) && !fs::is_regular_file(st))
+            return false;
+    }
+    return true;
+}
+
+/// Recreate `pkgRoot` under rootDir_: directories and symlinks directly,
+/// regular files as links to (or clones of) their store objects. Files
+/// under etc/ and those the package lists as `backup:` are edited in place
+/// by admins and daemons alike, so each root gets a copy of its own.
+bool Installer::materializeTree(const fs::path& pkgRoot,
+                                const std::vector<std::string>& backup) const {
+    std::unordered_set<std::string> privateFiles;
+    for (const auto& path : backup)
+        privateFiles.insert(fs::path(path).relative_path().lexically_normal().string());
+
+    for (auto& entry : fs::recursive_directory_iterator(pkgRoot)) {
+        const fs::path rel = fs::relative(entry.path(), pkgRoot);
+        const fs::path dest = fs::path(rootDir_) / rel;
+        std::error_code ec;
+        if (entry.is_symlink()) {
+            auto target = fs::read_symlink(entry.path(), ec);
+            if (!ec && !fs::is_directory(fs::symlink_status(dest)))
+                fs::remove(dest, ec);
+            if (!ec) fs::create_symlink(target, dest, ec);
+        } else if (entry.is_directory()) {
+            if (!fs::is_directory(dest)) fs::create_directories(dest, ec);
+            struct stat st{};
+            if (!ec && ::lstat(entry.path().c_str(), &st) == 0) {
+                // Same as tar -p: the package decides mode and ownership
+                if (::chown(dest.c_str(), st.st_uid, st.st_gid) != 0 && errno != EPERM) return false;
+                fs::permissions(dest, fs::perms(st.st_mode & 07777), ec);
+            }
+        } else {
+            const bool own = *rel.begin() == "etc" || privateFiles.contains(rel.string());
+            if (own ? !store_->copy(entry.path().string(), dest.string())
+                    : !store_->materialize(entry.path().string(), dest.string())) {
+                std::cerr << "\033[31merror:\033[0m cannot place '" << dest.string() << "'\n";
+                return false;
+            }
+        }
+        if (ec) {
+            std::cerr << "\033[31merror:\033[0m cannot place '" << dest.string() << "': "
+                      << ec.message() << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Installer::removePackage(const std::string& name) {
     // 1) Check installed
     if (!db_.isInstalled(name, "")) {
         std::cerr << "\033[31merror:\033[0m Package '" << name << "' is not installed.\n";
@@ -310,7 +542,7 @@ bool Installer::removePackage(const std::string& name) const {
             std::cerr << "\033[33mwarning:\033[0m Force removing '" << name
                       << "'; marking dependents as broken.\n";
             for (auto& pkg : rev) {
-                db_.markBroken(pkg);
+                db_.markBroken(pkg, Broken::Deps);
             }
         }
     }
@@ -347,18 +579,10 @@ bool Installer::removePackage(const std::string& name) const {
     //     return false;
     // }
 
-    // 9) Run post-remove hook
-    if (!script.empty() && fs::exists(script)) {
-        std::cout << script << std::endl;
-        ScriptExecutor::runScript(script, "post_remove");
-    }
-
-    // 6) Remove stored script file
+    // 6) Queue post-remove hook; the runner deletes the stored script after it
     if (!script.empty()) {
-        if (!fs::remove(script)) {
-            std::cerr << "\033[33mwarning:\033[0m Failed to remove script '"
-                      << script << "'.\n";
-        }
+        hooks_.add({name, {}, Tools::bareNames(db_.getDependencies(name)),
+                    script, "post_remove", /*discardScript=*/true});
     }
 
     // 7) Delete from packages table
@@ -375,8 +599,36 @@ bool Installer::removePackage(const std::string& name) const {
         return false;
     }
 
+    // What it removed may fire others' triggers
+    triggers_.pathsChanged(files);
+
     std::cout << "\033[32msuccess:\033[0m Removed '" << name << "'.\n";
     return true;
 }
 
+void Installer::finish() {
+    hooks_.run();
+    triggers_.run(rootDir_);
+}
+
+void Installer::setStore(const ObjectStore* store) {
+    store_ = store;
+}
+
+void Installer::setDurability(const Durability::Mode mode) {
+    durability_ = mode;
+}
+
+void Installer::setGentle(const bool gentle) {
+    gentle_ = gentle;
+}
+
+void Installer::setThrottle(DiskThrottle* throttle) {
+    throttle_ = throttle;
+}
+
+void Installer::setHookJobs(const unsigned jobs) {
+    hooks_ = HookRunner(rootDir_, jobs);
+}
+
 } // namespace gradient
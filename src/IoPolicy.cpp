@@ -0,0 +1,47 @@
+// src/IoPolicy.cpp
+
+#include "IoPolicy.h"
+
+#include <fcntl.h>
+#include <linux/ioprio.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace gradient {
+
+    void IoPolicy::lowerPriority(bool idle) {
+        // Linux applies both per thread despite the PRIO_PROCESS / WHO_PROCESS names
+        const pid_t self = static_cast<pid_t>(::syscall(SYS_gettid));
+        if (::setpriority(PRIO_PROCESS, self, idle ? 19 : 10) != 0)
+            std::cerr << "\033[33mwarning:\033[0m cannot lower CPU priority: " << std::strerror(errno) << "\n";
+        const int ioprio = idle ? IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0)
+                                : IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, 7);
+        if (::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, self, ioprio) != 0)
+            std::cerr << "\033[33mwarning:\033[0m cannot lower I/O priority: " << std::strerror(errno) << "\n";
+    }
+
+    void IoPolicy::dropCache(const std::vector<std::string>& files) {
+        // DONTNEED only drops clean pages: start writeback of everything,
+        // then wait for each file before dropping it
+        for (int pass = 0; pass < 2; ++pass) {
+            for (auto& path : files) {
+                int fd = ::open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+                if (fd < 0) continue;
+                if (pass == 0) {
+                    ::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+                } else {
+                    ::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+                                                | SYNC_FILE_RANGE_WAIT_AFTER);
+                    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                }
+                ::close(fd);
+            }
+        }
+    }
+
+} // namespace gradient
@@ -0,0 +1,158 @@
+// src/IoRing.cpp
+
+#include "IoRing.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+namespace gradient {
+
+    namespace {
+        int setup(unsigned entries, io_uring_params& p) {
+            return static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+        }
+
+        int enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+            return static_cast<int>(::syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0));
+        }
+
+        int registerOp(int fd, unsigned op, const void* arg, unsigned n) {
+            return static_cast<int>(::syscall(__NR_io_uring_register, fd, op, arg, n));
+        }
+
+        template <typename T>
+        T* at(void* base, unsigned offset) {
+            return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+        }
+    }
+
+    IoRing::IoRing(unsigned entries) {
+        io_uring_params p{};
+        int fd = setup(entries, p);
+        if (fd < 0) return;
+
+        sqMapLen_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqMapLen_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        // 5.4+ map both rings at once
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            sqMapLen_ = cqMapLen_ = std::max(sqMapLen_, cqMapLen_);
+        }
+        sqMap_ = ::mmap(nullptr, sqMapLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQ_RING);
+        if (sqMap_ == MAP_FAILED) { sqMap_ = nullptr; ::close(fd); return; }
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            cqMap_ = sqMap_;
+        } else {
+            cqMap_ = ::mmap(nullptr, cqMapLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd, IORING_OFF_CQ_RING);
+            if (cqMap_ == MAP_FAILED) {
+                ::munmap(sqMap_, sqMapLen_);
+                sqMap_ = cqMap_ = nullptr;
+                ::close(fd);
+                return;
+            }
+        }
+        sqesLen_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, sqesLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            if (cqMap_ != sqMap_) ::munmap(cqMap_, cqMapLen_);
+            ::munmap(sqMap_, sqMapLen_);
+            sqMap_ = cqMap_ = nullptr;
+            ::close(fd);
+            return;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        sqHead_  = at<unsigned>(sqMap_, p.sq_off.head);
+        sqTail_  = at<unsigned>(sqMap_, p.sq_off.tail);
+        sqMask_  = at<unsigned>(sqMap_, p.sq_off.ring_mask);
+        sqArray_ = at<unsigned>(sqMap_, p.sq_off.array);
+        cqHead_  = at<unsigned>(cqMap_, p.cq_off.head);
+        cqTail_  = at<unsigned>(cqMap_, p.cq_off.tail);
+        cqMask_  = at<unsigned>(cqMap_, p.cq_off.ring_mask);
+        cqes_    = at<io_uring_cqe>(cqMap_, p.cq_off.cqes);
+        entries_ = p.sq_entries;
+        fd_ = fd;
+    }
+
+    IoRing::~IoRing() {
+        if (fd_ < 0) return;
+        ::munmap(sqes_, sqesLen_);
+        if (cqMap_ != sqMap_) ::munmap(cqMap_, cqMapLen_);
+        ::munmap(sqMap_, sqMapLen_);
+        ::close(fd_);
+    }
+
+    bool IoRing::supports(std::initializer_list<int> ops) const {
+        if (fd_ < 0) return false;
+        const size_t len = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+        std::vector<unsigned char> buf(len, 0);
+        auto* probe = reinterpret_cast<io_uring_probe*>(buf.data());
+        if (registerOp(fd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) return false;
+        for (int op : ops) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+                return false;
+        }
+        return true;
+    }
+
+    bool IoRing::registerFiles(unsigned n) {
+        std::vector<int> slots(n, -1);
+        return fd_ >= 0 && registerOp(fd_, IORING_REGISTER_FILES, slots.data(), n) == 0;
+    }
+
+    unsigned IoRing::space() const {
+        const unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        return entries_ - (*sqTail_ + queued_ - head);
+    }
+
+    io_uring_sqe* IoRing::sqe() {
+        if (fd_ < 0 || space() == 0) return nullptr;
+        const unsigned index = (*sqTail_ + queued_) & *sqMask_;
+        io_uring_sqe* s = &sqes_[index];
+        std::memset(s, 0, sizeof *s);
+        sqArray_[index] = index;
+        ++queued_;
+        return s;
+    }
+
+    bool IoRing::submit(unsigned wait) {
+        // Publish the new tail only once the SQEs themselves are written
+        __atomic_store_n(sqTail_, *sqTail_ + queued_, __ATOMIC_RELEASE);
+        unsigned toSubmit = queued_;
+        queued_ = 0;
+        while (toSubmit || wait) {
+            int n = enter(fd_, toSubmit, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            toSubmit -= std::min<unsigned>(toSubmit, static_cast<unsigned>(n));
+            if (!toSubmit) break;
+        }
+        return true;
+    }
+
+    bool IoRing::wait(io_uring_cqe& cqe) {
+        while (!reap(cqe)) {
+            if (enter(fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) return false;
+        }
+        return true;
+    }
+
+    bool IoRing::reap(io_uring_cqe& cqe) {
+        const unsigned head = *cqHead_;
+        if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) return false;
+        cqe = cqes_[head & *cqMask_];
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+} // namespace gradient
@@ -0,0 +1,90 @@
+// src/LockFile.cpp
+
+#include "LockFile.h"
+
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+namespace gradient {
+
+    LockFile::LockFile(std::string path)
+        : path_(std::move(path))
+    {}
+
+    LockFile::~LockFile() {
+        release();
+    }
+
+    bool LockFile::acquire(const std::chrono::seconds timeout) {
+        if (fd_ >= 0) return true;
+        fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            std::cerr << "\033[31merror:\033[0m cannot open lock file '" << path_
+                      << "': " << strerror(errno) << "\n";
+            return false;
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        bool announced = false;
+        while (flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+            if (errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "\033[31merror:\033[0m cannot lock '" << path_
+                          << "': " << strerror(errno) << "\n";
+                release();
+                return false;
+            }
+            const std::string holder = describeHolder();
+            if (std::chrono::steady_clock::now() >= deadline) {
+                std::cerr << "\033[31merror:\033[0m database is locked"
+                          << (holder.empty() ? "" : " by " + holder)
+                          << "; gave up after " << timeout.count() << "s\n";
+                release();
+                return false;
+            }
+            if (!announced) {
+                std::cerr << "\033[33minfo:\033[0m waiting for the database lock"
+                          << (holder.empty() ? "" : " held by " + holder) << "\n";
+                announced = true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+
+        // Record ourselves for anyone who has to wait
+        const std::string pid = std::to_string(getpid()) + "\n";
+        if (ftruncate(fd_, 0) != 0 || pwrite(fd_, pid.data(), pid.size(), 0) < 0) {
+            std::cerr << "\033[33mwarning:\033[0m could not record pid in '" << path_ << "'\n";
+        }
+        return true;
+    }
+
+    void LockFile::release() {
+        if (fd_ < 0) return;
+        // Closing drops the flock; the file itself stays for the next writer
+        close(fd_);
+        fd_ = -1;
+    }
+
+    std::string LockFile::describeHolder() const {
+        std::ifstream in(path_);
+        long pid = 0;
+        if (!(in >> pid) || pid <= 0) return {};
+
+        std::string desc = "pid " + std::to_string(pid);
+        std::ifstream cmdline("/proc/" + std::to_string(pid) + "/cmdline", std::ios::binary);
+        std::string args, arg;
+        while (std::getline(cmdline, arg, '\0')) {
+            if (!args.empty()) args += ' ';
+            args += arg;
+        }
+        if (!args.empty()) desc += " (" + args + ")";
+        return desc;
+    }
+
+} // namespace gradient
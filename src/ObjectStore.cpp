@@ -0,0 +1,287 @@
+// src/ObjectStore.cpp
+
+#include "ObjectStore.h"
+#include "FileCopy.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        using Xattrs = std::vector<std::pair<std::string, std::string>>;
+
+        /// Extended attributes of `fd`, sorted by name. POSIX ACLs are among
+        /// them (system.posix_acl_*), as are file capabilities.
+        bool readXattrs(int fd, Xattrs& out) {
+            out.clear();
+            ssize_t len = ::flistxattr(fd, nullptr, 0);
+            if (len < 0) return errno == ENOTSUP;
+            std::string names(static_cast<size_t>(len), '\0');
+            if ((len = ::flistxattr(fd, names.data(), names.size())) < 0) return false;
+            for (size_t pos = 0; pos < static_cast<size_t>(len); ) {
+                std::string name(names.c_str() + pos);
+                pos += name.size() + 1;
+                ssize_t vlen = ::fgetxattr(fd, name.c_str(), nullptr, 0);
+                if (vlen < 0) return false;
+                std::string value(static_cast<size_t>(vlen), '\0');
+                if ((vlen = ::fgetxattr(fd, name.c_str(), value.data(), value.size())) < 0) return false;
+                value.resize(static_cast<size_t>(vlen));
+                out.emplace_back(std::move(name), std::move(value));
+            }
+            std::ranges::sort(out);
+            return true;
+        }
+
+        std::string toHex(const unsigned char* md, unsigned len) {
+            static constexpr char digits[] = "0123456789abcdef";
+            std::string hex;
+            for (unsigned i = 0; i < len; ++i) {
+                hex += digits[md[i] >> 4];
+                hex += digits[md[i] & 0xf];
+            }
+            return hex;
+        }
+
+        /// Short digest of `attrs` for object names; empty when there are none.
+        std::string xattrDigest(const Xattrs& attrs) {
+            if (attrs.empty()) return {};
+            std::string blob;
+            for (auto& [name, value] : attrs)
+                blob += name + '\0' + std::to_string(value.size()) + '\0' + value;
+            unsigned char md[EVP_MAX_MD_SIZE];
+            unsigned len = 0;
+            if (EVP_Digest(blob.data(), blob.size(), md, &len, EVP_sha256(), nullptr) != 1) return {};
+            return toHex(md, len).substr(0, 16);
+        }
+
+        /// Copy `src` to a new file `dst` with its mode, ownership and
+        /// extended attributes.
+        bool copyFile(const std::string& src, const std::string& dst,
+                      const struct stat& st, ObjectStore::Method& how) {
+            int in = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+            if (in < 0) return false;
+            int out = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            if (out < 0) { ::close(in); return false; }
+            FileCopy::Method used;
+            bool ok = FileCopy::whole(in, out, &used);
+            how = used == FileCopy::Method::Clone ? ObjectStore::Method::Reflink
+                                                  : ObjectStore::Method::Copy;
+            // Ownership first: chown clears setuid/setgid bits and capabilities
+            ok = ok && (fchown(out, st.st_uid, st.st_gid) == 0 || errno == EPERM);
+            ok = ok && fchmod(out, st.st_mode & 07777) == 0;
+            Xattrs attrs;
+            ok = ok && readXattrs(in, attrs);
+            for (auto& [name, value] : attrs) {
+                if (!ok) break;
+                ok = ::fsetxattr(out, name.c_str(), value.data(), value.size(), 0) == 0;
+                if (!ok)
+                    std::cerr << "\033[31merror:\033[0m cannot set " << name << " on '" << dst
+                              << "': " << std::strerror(errno) << "\n";
+            }
+            ok = ::close(out) == 0 && ok;
+            ::close(in);
+            if (!ok) ::unlink(dst.c_str());
+            return ok;
+        }
+
+        std::string scratchName(const std::string& path) {
+            return path + ".gradient-new";
+        }
+    }
+
+    ObjectStore::ObjectStore(std::string dir) : dir_(std::move(dir)) {}
+
+    bool ObjectStore::open() {
+        std::error_code ec;
+        fs::create_directories(fs::path(dir_) / "objects", ec);
+        if (!ec) fs::create_directories(fs::path(dir_) / "tmp", ec);
+        if (ec) {
+            std::cerr << "\033[31merror:\033[0m cannot create store at '" << dir_ << "': "
+                      << ec.message() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    std::string ObjectStore::makeTempDir() const {
+        std::string tmpl = (fs::path(dir_) / "tmp" / "unpackXXXXXX").string();
+        return mkdtemp(tmpl.data()) ? tmpl : std::string{};
+    }
+
+    bool ObjectStore::hashFile(const std::string& path, std::string& hex) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+        bool ok = ctx && EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr) == 1;
+        char buf[1 << 16];
+        for (ssize_t n; ok && (n = ::read(fd, buf, sizeof buf)) != 0; ) {
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ok = false;
+                break;
+            }
+            ok = EVP_DigestUpdate(ctx.get(), buf, n) == 1;
+        }
+        ::close(fd);
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned len = 0;
+        if (!ok || EVP_DigestFinal_ex(ctx.get(), md, &len) != 1) return false;
+        hex = toHex(md, len);
+        return true;
+    }
+
+    bool ObjectStore::ingest(const std::string& src, const std::string& object,
+                             const std::string& hex) const {
+        std::error_code ec;
+        fs::create_directories(fs::path(object).parent_path(), ec);
+        // Same filesystem: the unpacked file simply becomes the object
+        if (::link(src.c_str(), object.c_str()) == 0) return true;
+        if (errno == EEXIST) {
+            // Anything writing into an installed file in place writes into
+            // the object: check it still holds what its name says
+            std::string have;
+            if (hashFile(object, have) && have == hex) return true;
+            std::cerr << "\033[33mwarning:\033[0m store object '" << object
+                      << "' was modified; replacing it\n";
+        }
+
+        const std::string tmp = scratchName(object);
+        ::unlink(tmp.c_str());
+        if (::link(src.c_str(), tmp.c_str()) != 0) {
+            struct stat st{};
+            Method how;
+            if (::lstat(src.c_str(), &st) != 0 || !copyFile(src, tmp, st, how)) return false;
+        }
+        if (::rename(tmp.c_str(), object.c_str()) != 0) {
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool ObjectStore::copy(const std::string& src, const std::string& dest, Method* how) const {
+        struct stat st{};
+        if (::lstat(src.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+        const std::string tmp = scratchName(dest);
+        ::unlink(tmp.c_str());
+        Method used;
+        if (!copyFile(src, tmp, st, used)) return false;
+        if (::rename(tmp.c_str(), dest.c_str()) != 0) {
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        if (how) *how = used;
+        return true;
+    }
+
+    bool ObjectStore::materialize(const std::string& src, const std::string& dest, Method* how) const {
+        struct stat st{};
+        std::string hex;
+        if (::lstat(src.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || !hashFile(src, hex))
+            return false;
+
+        // Files that differ only in xattrs (a capability, an ACL) need
+        // separate objects too
+        Xattrs attrs;
+        int fd = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        const bool listed = readXattrs(fd, attrs);
+        ::close(fd);
+        if (!listed) return false;
+
+        char suffix[64];
+        std::snprintf(suffix, sizeof suffix, "-%o-%u-%u",
+                      unsigned(st.st_mode & 07777), unsigned(st.st_uid), unsigned(st.st_gid));
+        std::string name = hex.substr(2) + suffix;
+        if (auto digest = xattrDigest(attrs); !digest.empty()) name += "-x" + digest;
+        const std::string object = (fs::path(dir_) / "objects" / hex.substr(0, 2) / name).string();
+
+        const std::string tmp = scratchName(dest);
+        Method used = Method::Hardlink;
+        bool placed = false;
+        // A concurrent gc() may drop the object between ingest and link; once
+        // re-ingested it is linked here and so safe from the next one.
+        for (int attempt = 0; attempt < 2 && !placed; ++attempt) {
+            if (!ingest(src, object, hex)) return false;
+            // Already linked (a reinstall): rename() between two links to one
+            // inode is a no-op and would leave the scratch link behind
+            struct stat dst{}, obj{};
+            if (::lstat(dest.c_str(), &dst) == 0 && ::stat(object.c_str(), &obj) == 0
+                && dst.st_dev == obj.st_dev && dst.st_ino == obj.st_ino)
+            {
+                if (how) *how = Method::Hardlink;
+                return true;
+            }
+            ::unlink(tmp.c_str());
+            if (::link(object.c_str(), tmp.c_str()) == 0) {
+                placed = true;
+            } else if (errno == ENOENT) {
+                continue;
+            } else {
+                // Other filesystem, or the object has run out of links
+                struct stat ost{};
+                if (::stat(object.c_str(), &ost) != 0) continue;
+                if (!copyFile(object, tmp, ost, used)) return false;
+                placed = true;
+            }
+        }
+        if (!placed) return false;
+
+        if (::rename(tmp.c_str(), dest.c_str()) != 0) {
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        if (how) *how = used;
+        return true;
+    }
+
+    ObjectStore::GcStats ObjectStore::gc() const {
+        GcStats stats;
+        std::error_code ec;
+
+        for (auto it = fs::recursive_directory_iterator(fs::path(dir_) / "objects", ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+        {
+            struct stat st{};
+            if (::lstat(it->path().c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+                continue;
+            if (st.st_nlink > 1) {
+                ++stats.kept;
+                continue;
+            }
+            if (::unlink(it->path().c_str()) == 0) {
+                ++stats.removed;
+                stats.bytes += static_cast<std::uint64_t>(st.st_size);
+            }
+        }
+
+        // Unpack directories of installs that never finished; a live install
+        // removes its own long before it is a day old
+        const auto cutoff = fs::file_time_type::clock::now() - std::chrono::hours(24);
+        for (auto& entry : fs::directory_iterator(fs::path(dir_) / "tmp", ec)) {
+            std::error_code wec;
+            if (fs::last_write_time(entry.path(), wec) < cutoff && !wec)
+                fs::remove_all(entry.path(), wec);
+        }
+        return stats;
+    }
+
+} // namespace gradient
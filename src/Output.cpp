@@ -0,0 +1,139 @@
+// src/Output.cpp
+
+#include "Output.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace gradient {
+
+    void Output::packageList(std::ostream& out, const std::vector<PackageInfo>& pkgs, const bool parse) {
+        if (parse) {
+            // machine‐friendly: name|version|arch|broken
+            for (auto& p : pkgs) {
+                out
+                  << p.name    << '|'
+                  << p.version << '|'
+                  << p.arch    << '|'
+                  << (p.broken ? '1' : '0')
+                  << "\n";
+            }
+        } else {
+            // human‐friendly
+            out << "\n\033[1;34m📦 Installed Packages\033[0m\n\n";
+            for (auto& p : pkgs) {
+                // green check or yellow warning
+                const char* sym   = p.broken ? "⚠" : "✔";
+                const char* color = p.broken ? "\033[33m" : "\033[32m";
+
+                out
+                  << "  "
+                  << color << sym << " "
+                  << "\033[1m" << p.name << "\033[0m"
+                  << " \033[90m" << p.version << "\033[0m"
+                  << " (" << p.arch << ")"
+                  << "\033[0m\n";
+            }
+            out << "\n";
+        }
+    }
+
+    void Output::packageInfo(std::ostream& out, const PackageInfo& pkg, const bool parse) {
+        if (parse) {
+            // name|version|arch
+            out
+            << pkg.name    << '|'
+            << pkg.version << '|'
+            << pkg.arch    << "\n";
+        } else {
+            out << "\n"
+            << "\033[1;36m📄 Package:\033[0m \033[1m" << pkg.name << "\033[0m\n"
+            << "  \033[1mVersion:\033[0m " << pkg.version << "\n"
+            << "  \033[1mArch:\033[0m    " << pkg.arch << "\n";
+        }
+    }
+
+    void Output::notInstalled(std::ostream& err, const std::string& name) {
+        err << "\033[31merror:\033[0m Package '"
+            << name << "' is not installed\n";
+    }
+
+    void Output::owners(std::ostream& out,
+                        const std::vector<std::string>& paths,
+                        const std::vector<std::pair<std::string, std::string>>& owners,
+                        const bool parse) {
+        std::unordered_map<std::string, std::vector<std::string>> byPath;
+        for (auto& [path, pkg] : owners) byPath[path].push_back(pkg);
+
+        for (auto& path : paths) {
+            auto it = byPath.find(path);
+            if (parse) {
+                // path|package (empty package when unowned)
+                if (it == byPath.end()) {
+                    out << path << "|\n";
+                } else {
+                    for (auto& pkg : it->second) out << path << '|' << pkg << "\n";
+                }
+            } else if (it == byPath.end()) {
+                out << "\033[33m" << path << "\033[0m is not owned by any package\n";
+            } else {
+                for (auto& pkg : it->second)
+                    out << path << " is owned by \033[1m" << pkg << "\033[0m\n";
+            }
+        }
+    }
+
+    void Output::query(std::ostream& out, std::ostream& err,
+                       const RepoIndex& index, const std::string& rawPattern, const bool parse) {
+        std::string pattern = rawPattern;
+        std::ranges::transform(pattern, pattern.begin(), ::tolower);
+
+        bool anyMatch = false;
+        for (auto& repo : index.repos()) {
+            if (!repo.synced) {
+                if (!parse) {
+                    err << "\033[33minfo:\033[0m repo '"
+                        << repo.name << "' not synced; skipping\n";
+                }
+                continue;
+            }
+
+            bool printedHeader = false;
+            for (const auto& pkg : repo.packages) {
+                std::string lowName = pkg.pkgname;
+                std::ranges::transform(lowName, lowName.begin(), ::tolower);
+
+                if (lowName.find(pattern) == std::string::npos)
+                    continue;
+
+                anyMatch = true;
+                if (parse) {
+                    // repo|name|version|arch|filename
+                    out
+                      << repo.name   << '|'
+                      << pkg.pkgname << '|'
+                      << pkg.pkgver  << '|'
+                      << pkg.arch    << '|'
+                      << pkg.filename << "\n";
+                } else {
+                    if (!printedHeader) {
+                        out << "\033[1;35mRepository:\033[0m \033[1m"
+                            << repo.name << "\033[0m\n";
+                        printedHeader = true;
+                    }
+                    out
+                      << "  \033[32m•\033[0m " << pkg.pkgname
+                      << " \033[90m" << pkg.pkgver << "\033[0m"
+                      << " [" << pkg.arch << "]\n"
+                      << "      " << pkg.description << "\n";
+                }
+            }
+        }
+
+        if (!anyMatch && !parse) {
+            out << "\033[33minfo:\033[0m no packages matching '"
+                << rawPattern << "' found in any repo\n";
+        }
+    }
+
+} // namespace gradient
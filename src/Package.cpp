@@ -4,11 +4,13 @@
 #include "Package.h"
 #include "YamlParser.h"
 #include "TarHandler.h"
+#include "TarStream.h"
 
 #include <cstdlib>
 #include <iostream>
 #include <unistd.h>
 #include <filesystem>
+#include <string_view>
 
 namespace fs = std::filesystem;
 
@@ -60,6 +62,52 @@ namespace gradient {
         return true;
     }
 
+    bool Package::inspect(ArchiveIndex& index, std::string& script) {
+        // One sequential read yields the table of contents and both metadata
+        // members, so a compressed archive is decompressed once
+        TarReader reader(archivePath_);
+        std::string yaml;
+        auto slurp = [&](std::string& out) {
+            out.clear();
+            return reader.read([&](const char* data, size_t n) { out.append(data, n); return true; });
+        };
+        bool ok = reader.open();
+        for (TarEntry e; ok && reader.next(e); ) {
+            std::string_view v(e.path);
+            if (v.starts_with("./")) v.remove_prefix(2);
+            if (v == "anemonix.yaml") {
+                index.metaMember = e.path;
+                ok = slurp(yaml);
+            } else if (v == "install.anemonix") {
+                index.scriptMember = e.path;
+                ok = slurp(script);
+            } else if (v == "package/" || v == "package") {
+                index.payloadMember = e.path.back() == '/' ? e.path.substr(0, e.path.size() - 1) : e.path;
+            } else if (v.starts_with("package/")) {
+                if (index.payloadMember.empty())
+                    index.payloadMember = e.path.substr(0, e.path.size() - v.size() + std::string_view("package").size());
+                // directories may be shared freely; only files and symlinks are owned
+                if (e.type != '5' && !v.ends_with('/'))
+                    index.paths.emplace_back(v.substr(std::string_view("package").size()));
+            }
+        }
+        if (!ok || reader.failed()) {
+            std::cerr << "\033[31merror:\033[0m failed to read '" << archivePath_ << "'\n";
+            return false;
+        }
+        if (index.metaMember.empty()) {
+            std::cerr << "\033[31merror:\033[0m anemonix.yaml not found in '"
+                      << archivePath_ << "'\n";
+            return false;
+        }
+        if (!YamlParser::parseMetadataText(yaml, meta_)) {
+            std::cerr << "\033[31merror:\033[0m failed to parse metadata in '"
+                      << archivePath_ << "'\n";
+            return false;
+        }
+        return true;
+    }
+
     const Package::Metadata& Package::metadata() const {
         return meta_;
     }
@@ -0,0 +1,130 @@
+// src/PackageSet.cpp
+
+#include "PackageSet.h"
+#include "ConflictChecker.h"
+#include "tools.h"
+
+#include <sys/utsname.h>
+
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace gradient {
+
+    namespace {
+        std::string hostArch() {
+            utsname u{};
+            uname(&u);
+            return {u.machine};
+        }
+    }
+
+    bool PackageSet::read(const std::vector<std::string>& archives, size_t jobs) {
+        members_.assign(archives.size(), {});
+        std::vector<char> ok(archives.size(), 0);
+        parallelFor(members_.size(), jobs, [&](size_t i) {
+            Member& m = members_[i];
+            m.archive = archives[i];
+            Package pkg(m.archive);
+            ok[i] = pkg.inspect(m.idx, m.script);
+            m.meta = pkg.metadata();
+        });
+        for (size_t i = 0; i < archives.size(); ++i) {
+            if (!ok[i]) {
+                std::cerr << "\033[31merror:\033[0m Failed to read package metadata from '"
+                          << archives[i] << "'.\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool PackageSet::check(const Database& db, const bool force, bool& overlapping) {
+        overlapping = false;
+
+        // 1) Arch, what is already there, duplicates
+        const std::string arch = hostArch();
+        std::unordered_map<std::string, Member*> batch;
+        std::unordered_set<std::string> batchProvides;
+        for (auto& m : members_) {
+            const auto& meta = m.meta;
+            if (meta.arch != "any" && meta.arch != "all" && meta.arch != arch) {
+                std::cerr << "\033[31merror:\033[0m Arch mismatch: package '" << meta.name << "' is '"
+                          << meta.arch << "' but host is '" << arch << "'.\n";
+                return false;
+            }
+            if (std::string instVer; db.getPackageVersion(meta.name, instVer)) {
+                if (instVer != meta.version) {
+                    std::cerr << "\033[31merror:\033[0m '" << meta.name << "' is already installed at "
+                              << instVer << "; use 'install' to upgrade it.\n";
+                    return false;
+                }
+                m.installed = true;
+                continue;
+            }
+            if (!batch.emplace(meta.name, &m).second) {
+                std::cerr << "\033[31merror:\033[0m '" << meta.name << "' appears twice in the set.\n";
+                return false;
+            }
+            for (auto& p : meta.provides) batchProvides.insert(Tools::parseConstraint(p).name);
+        }
+
+        // 2) Dependencies and package conflicts, satisfied by the set or by `db`
+        auto fail = [&](Member& m, unsigned reason, const std::string& warning, const char* abort) {
+            std::cerr << "\033[33mwarning:\033[0m " << warning << "\n";
+            if (!force) {
+                std::cerr << "\033[31merror:\033[0m " << abort << "\n";
+                return false;
+            }
+            m.broken |= reason;
+            return true;
+        };
+        for (auto& m : members_) {
+            if (m.installed) continue;
+            for (const auto& raw : m.meta.deps) {
+                Tools::Constraint c = Tools::parseConstraint(raw);
+                if (c.name.find(".so") != std::string::npos) continue;
+                if (auto it = batch.find(c.name); it != batch.end()) {
+                    if (c.op.empty() || Tools::evalConstraint(it->second->meta.version, c)) continue;
+                } else if (batchProvides.contains(c.name) || db.providesSatisfies(c)) {
+                    continue;
+                } else if (std::string v; db.getPackageVersion(c.name, v)
+                           && (c.op.empty() || Tools::evalConstraint(v, c))) {
+                    continue;
+                }
+                if (!fail(m, Broken::Deps, "'" + m.meta.name + "': unsatisfied dependency '" + raw + "'",
+                          "Aborting due to missing dependency."))
+                    return false;
+            }
+            for (const auto& raw : m.meta.conflicts) {
+                Tools::Constraint c = Tools::parseConstraint(raw);
+                std::string v;
+                if (auto it = batch.find(c.name); it != batch.end()) v = it->second->meta.version;
+                else if (!db.getPackageVersion(c.name, v)) continue;
+                if (!Tools::evalConstraint(v, c)) continue;
+                if (!fail(m, Broken::Conflicts, "'" + m.meta.name + "' conflicts with '" + raw + "'",
+                          "Aborting due to conflict."))
+                    return false;
+            }
+        }
+
+        // 3) File conflicts for the whole set in one pass. Without replaces:,
+        //    taking over installed files is a conflict too.
+        ConflictChecker checker(db);
+        for (auto& m : members_) {
+            if (!m.installed) checker.addPackage(m.meta.name, m.idx.paths);
+        }
+        if (auto conflicts = checker.check(); !conflicts.empty()) {
+            ConflictChecker::report(conflicts);
+            if (!force) {
+                std::cerr << "\033[31merror:\033[0m Aborting due to file conflicts.\n";
+                return false;
+            }
+            for (auto& c : conflicts) batch.at(c.incoming)->broken |= Broken::Files;
+            overlapping = true;
+        }
+        return true;
+    }
+
+} // namespace gradient
@@ -0,0 +1,302 @@
+// src/PayloadWriter.cpp
+
+#include "PayloadWriter.h"
+#include "DiskThrottle.h"
+#include "FileBatch.h"
+#include "FileCopy.h"
+#include "TarStream.h"
+
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <ranges>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        /// Owner as tar -p restores it: names first, ids when the name is
+        /// unknown. Reentrant lookups, as the bootstrapper unpacks in parallel.
+        void owner(const TarEntry& e, uid_t& uid, gid_t& gid) {
+            uid = static_cast<uid_t>(e.uid);
+            gid = static_cast<gid_t>(e.gid);
+            char buf[4096];
+            if (!e.uname.empty()) {
+                passwd pw{}, *found = nullptr;
+                if (getpwnam_r(e.uname.c_str(), &pw, buf, sizeof buf, &found) == 0 && found)
+                    uid = pw.pw_uid;
+            }
+            if (!e.gname.empty()) {
+                group gr{}, *found = nullptr;
+                if (getgrnam_r(e.gname.c_str(), &gr, buf, sizeof buf, &found) == 0 && found)
+                    gid = gr.gr_gid;
+            }
+        }
+
+        bool failed(const std::string& what, const std::string& path) {
+            std::cerr << "\033[31merror:\033[0m cannot " << what << " '" << path << "': "
+                      << std::strerror(errno) << "\n";
+            return false;
+        }
+
+        /// Ownership (only root may give files away), then mode, since chown
+        /// clears setuid bits, then xattrs; `path` is not a symlink.
+        bool restore(const std::string& path, const TarEntry& e, bool asRoot) {
+            if (asRoot) {
+                uid_t uid; gid_t gid;
+                owner(e, uid, gid);
+                if (::lchown(path.c_str(), uid, gid) != 0) return failed("chown", path);
+            }
+            if (::chmod(path.c_str(), e.mode & 07777) != 0) return failed("chmod", path);
+            for (auto& [name, value] : e.xattrs) {
+                if (::lsetxattr(path.c_str(), name.c_str(), value.data(), value.size(), 0) != 0)
+                    std::cerr << "\033[33mwarning:\033[0m cannot set " << name << " on '"
+                              << path << "': " << std::strerror(errno) << "\n";
+            }
+            return true;
+        }
+
+        void stamp(const std::string& path, const TarEntry& e) {
+            const timespec times[2] = {{0, UTIME_NOW}, {static_cast<time_t>(e.mtime), 0}};
+            ::utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW);
+        }
+
+        /// Move a finished scratch entry over `dest`. When both already name
+        /// one inode (a hard link reinstalled) rename() does nothing, hence
+        /// the unlink.
+        bool commit(const std::string& tmp, const std::string& dest) {
+            if (::rename(tmp.c_str(), dest.c_str()) != 0) {
+                int err = errno;
+                ::unlink(tmp.c_str());
+                errno = err;
+                return failed("replace", dest);
+            }
+            ::unlink(tmp.c_str());
+            return true;
+        }
+
+        /// Regular file: data at `offset` in the archive, cloned or copied
+        /// into a scratch file that is renamed over `dest` once complete.
+        bool writeFile(int archive, std::uint64_t offset, const std::string& dest,
+                       const TarEntry& e, bool asRoot) {
+            const std::string tmp = dest + ".gradient-new";
+            ::unlink(tmp.c_str());
+            int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            if (fd < 0) return failed("create", tmp);
+            bool ok = FileCopy::range(archive, static_cast<off_t>(offset), fd, e.size);
+            ok = ::close(fd) == 0 && ok;
+            if (!ok) {
+                failed("write", dest);
+                ::unlink(tmp.c_str());
+                return false;
+            }
+            if (!restore(tmp, e, asRoot)) {
+                ::unlink(tmp.c_str());
+                return false;
+            }
+            stamp(tmp, e);
+            return commit(tmp, dest);
+        }
+
+        bool writeSymlink(const std::string& dest, const TarEntry& e, bool asRoot) {
+            const std::string tmp = dest + ".gradient-new";
+            ::unlink(tmp.c_str());
+            if (::symlink(e.linkpath.c_str(), tmp.c_str()) != 0) return failed("create symlink", dest);
+            if (asRoot) {
+                uid_t uid; gid_t gid;
+                owner(e, uid, gid);
+                ::lchown(tmp.c_str(), uid, gid);
+            }
+            stamp(tmp, e);
+            return commit(tmp, dest);
+        }
+
+        /// A symlink that may lead out of the payload: later members must
+        /// not be written through it.
+        bool leadsOut(const std::string& linkpath) {
+            if (linkpath.starts_with('/')) return true;
+            for (auto& part : fs::path(linkpath)) {
+                if (part == "..") return true;
+            }
+            return false;
+        }
+
+        /// Below this many files a ring costs more to set up than it saves.
+        constexpr size_t kBatchMin = 32;
+    }
+
+    bool PayloadWriter::supports(const std::string& archive) {
+        TarReader reader(archive);
+        if (!reader.open() || !reader.seekable()) return false;
+        // Headers only: every member's data is skipped with a seek
+        TarEntry e;
+        while (reader.next(e)) {
+            if (e.acl || e.sparse) return false;
+            if (std::string_view("01234567").find(e.type) == std::string_view::npos) return false;
+        }
+        return !reader.failed();
+    }
+
+    bool PayloadWriter::extract(const std::string& archive, const ArchiveIndex& idx,
+                                const std::string& rootDir, DiskThrottle* throttle) {
+        if (idx.payloadMember.empty()) return true;   // metadata-only package
+        TarReader reader(archive);
+        if (!reader.open() || !reader.seekable()) return false;
+
+        const std::string prefix = idx.payloadMember + "/";
+        const bool asRoot = ::geteuid() == 0;
+        // Where a payload member lands: empty for members outside the
+        // payload, nullopt for one whose ".." would leave it
+        auto target = [&](std::string_view member) -> std::optional<std::string> {
+            if (!member.starts_with(prefix)) return std::string{};
+            member.remove_prefix(prefix.size());
+            const fs::path rel = fs::path(member).lexically_normal();
+            if (rel.is_absolute() || (!rel.empty() && *rel.begin() == "..")) return std::nullopt;
+            std::string clean = rel.string();
+            while (clean.ends_with('/')) clean.pop_back();
+            if (clean.empty() || clean == ".") return std::string{};
+            return (fs::path(rootDir) / clean).string();
+        };
+        auto escapes = [&](const std::string& member) {
+            std::cerr << "\033[31merror:\033[0m '" << archive << "': '" << member
+                      << "' points outside the package\n";
+            return false;
+        };
+
+        // Small files without xattrs are written in io_uring batches; the
+        // batch falls back to writeFile() for anything it cannot do
+        std::optional<FileBatch> batch;
+        if (idx.paths.size() >= kBatchMin) {
+            batch.emplace(reader.fd(), [&](const FileBatch::File& f) {
+                TarEntry plain;
+                plain.size = f.size;
+                plain.mode = f.mode;
+                plain.mtime = f.mtime;
+                plain.uid = f.uid;
+                plain.gid = f.gid;
+                return writeFile(reader.fd(), f.offset, f.dest, plain, f.own);
+            });
+        }
+
+        // Directory metadata waits until their contents are in place, or
+        // the mtimes would not hold and read-only modes would lock us out
+        std::vector<std::pair<std::string, TarEntry>> dirs;
+        // Symlinks leading out of the payload are made last, as tar does,
+        // so no later member is written through one into the host
+        std::map<std::string, TarEntry> deferred;
+        TarEntry e;
+        while (reader.next(e)) {
+            const auto where = target(e.path);
+            if (!where) return escapes(e.path);
+            const std::string& dest = *where;
+            if (dest.empty()) continue;
+            if (throttle) throttle->pace();
+            deferred.erase(dest);   // the last member of a name wins
+            const bool batched = batch && (e.type == '0' || e.type == '7') && e.xattrs.empty();
+            // Queued files must land first: a hard link's target, or an
+            // earlier member of the same name
+            if (batch && !batched && (e.type == '1' || batch->pending(dest)) && !batch->flush())
+                return false;
+            std::error_code ec;
+            fs::create_directories(fs::path(dest).parent_path(), ec);
+            const std::string tmp = dest + ".gradient-new";
+
+            switch (e.type) {
+            case '5': {
+                struct stat st{};
+                if (::lstat(dest.c_str(), &st) != 0) {
+                    // Another package being unpacked alongside may have won the race
+                    if (::mkdir(dest.c_str(), 0700) != 0 && errno != EEXIST)
+                        return failed("create directory", dest);
+                    dirs.emplace_back(dest, e);
+                } else if (S_ISDIR(st.st_mode)) {
+                    dirs.emplace_back(dest, e);
+                } else if (!S_ISLNK(st.st_mode) || !fs::is_directory(dest, ec)) {
+                    // A symlink to a directory (merged /usr...) is kept as is
+                    errno = EEXIST;
+                    return failed("create directory", dest);
+                }
+                break;
+            }
+            case '0':
+            case '7': {
+                if (!batched) {
+                    if (!writeFile(reader.fd(), reader.dataOffset(), dest, e, asRoot)) return false;
+                    break;
+                }
+                FileBatch::File f{dest, reader.dataOffset(), e.size, e.mode, e.mtime, asRoot};
+                if (asRoot) {
+                    uid_t uid; gid_t gid;
+                    owner(e, uid, gid);
+                    f.uid = uid;
+                    f.gid = gid;
+                }
+                if (!batch->add(std::move(f))) return false;
+                break;
+            }
+            case '2':
+                if (leadsOut(e.linkpath)) {
+                    deferred.insert_or_assign(dest, e);
+                    break;
+                }
+                if (!writeSymlink(dest, e, asRoot)) return false;
+                break;
+            case '1': {
+                const auto from = target(e.linkpath);
+                if (!from) return escapes(e.linkpath);
+                ::unlink(tmp.c_str());
+                if (from->empty() || ::link(from->c_str(), tmp.c_str()) != 0) return failed("link", dest);
+                if (!commit(tmp, dest)) return false;
+                break;
+            }
+            case '3':
+            case '4':
+            case '6': {
+                const mode_t kind = e.type == '3' ? S_IFCHR : e.type == '4' ? S_IFBLK : S_IFIFO;
+                ::unlink(tmp.c_str());
+                if (::mknod(tmp.c_str(), kind | 0600, makedev(e.devmajor, e.devminor)) != 0)
+                    return failed("create", dest);
+                if (!restore(tmp, e, asRoot)) {
+                    ::unlink(tmp.c_str());
+                    return false;
+                }
+                stamp(tmp, e);
+                if (!commit(tmp, dest)) return false;
+                break;
+            }
+            default:
+                std::cerr << "\033[31merror:\033[0m unsupported member '" << e.path << "'\n";
+                return false;
+            }
+        }
+        if (reader.failed()) {
+            std::cerr << "\033[31merror:\033[0m '" << archive << "' is truncated or corrupt\n";
+            return false;
+        }
+        if (batch && !batch->flush()) return false;
+
+        for (auto& [dest, entry] : deferred) {
+            if (!writeSymlink(dest, entry, asRoot)) return false;
+        }
+        for (auto& [dest, entry] : std::ranges::reverse_view(dirs)) {
+            if (!restore(dest, entry, asRoot)) return false;
+            stamp(dest, entry);
+        }
+        return true;
+    }
+
+} // namespace gradient
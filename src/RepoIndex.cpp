@@ -0,0 +1,153 @@
+// src/RepoIndex.cpp
+
+#include "RepoIndex.h"
+#include "tools.h"
+
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    RepoIndex::RepoIndex(fs::path repoBase)
+        : repoBase_(std::move(repoBase)) {}
+
+    bool RepoIndex::load() {
+        repos_.clear();
+        pkgMap_.clear();
+        mtimes_.clear();
+
+        std::error_code ec;
+        if (!fs::is_directory(repoBase_, ec)) return false;
+        mtimes_[repoBase_.string()] = fs::last_write_time(repoBase_, ec);
+
+        for (auto& entry : fs::directory_iterator(repoBase_)) {
+            if (entry.path().extension() != ".json") continue;
+            Repo repo;
+            repo.name = entry.path().stem();
+            mtimes_[entry.path().string()] = fs::last_write_time(entry.path(), ec);
+
+            // Load the repo descriptor (name/url/priority)
+            YAML::Node desc;
+            try { desc = YAML::LoadFile(entry.path().string()); }
+            catch (const YAML::Exception& e) {
+                std::cerr << "\033[31merror:\033[0m parsing " << entry.path().filename()
+                          << ": " << e.what() << "\n";
+                continue;
+            }
+            auto url             = desc["url"].as<std::string>();
+            int priority         = desc["priority"].as<int>();
+
+            // Load the remote index we synced earlier
+            fs::path indexFile = repoBase_ / repo.name / "repo.json";
+            if (!fs::exists(indexFile)) {
+                repos_.push_back(std::move(repo));
+                continue;
+            }
+            mtimes_[indexFile.string()] = fs::last_write_time(indexFile, ec);
+
+            YAML::Node idx;
+            try { idx = YAML::LoadFile(indexFile.string()); }
+            catch (const YAML::Exception& e) {
+                std::cerr << "\033[31merror:\033[0m parsing " << indexFile.filename()
+                          << ": " << e.what() << "\n";
+                continue;
+            }
+            repo.synced = true;
+            auto packages = idx["packages"];
+            if (!packages || !packages.IsSequence()) {
+                repos_.push_back(std::move(repo));
+                continue;
+            }
+
+            for (const auto& node : packages) {
+                RepoPkg rp;
+                rp.pkgname   = node["pkgname"].as<std::string>();
+                rp.pkgver    = node["pkgver"].as<std::string>();
+                rp.arch      = node["arch"].as<std::string>();
+                rp.filename  = node["filename"].as<std::string>();
+                rp.repoUrl   = url;
+                rp.priority  = priority;
+                rp.repoName  = repo.name;
+                if (node["description"])
+                    rp.description = node["description"].as<std::string>();
+                if (node["sha256"])
+                    rp.sha256 = node["sha256"].as<std::string>();
+                if (node["size"])
+                    rp.size = node["size"].as<std::uint64_t>();
+
+                // Dependencies
+                if (node["depends"]) {
+                    for (const auto& dnode : node["depends"])
+                        rp.depends.push_back(dnode.as<std::string>());
+                }
+
+                // Provides (strip version suffix after '=')
+                if (node["provides"]) {
+                    for (const auto& pnode : node["provides"]) {
+                        auto prov = pnode.as<std::string>();
+                        if (auto eq = prov.find('='); eq != std::string::npos)
+                            prov.resize(eq);
+                        rp.provides.push_back(prov);
+                    }
+                }
+
+                // Optional binary deltas from earlier versions
+                if (node["deltas"] && node["deltas"].IsSequence()) {
+                    for (const auto& dnode : node["deltas"]) {
+                        if (!dnode["from"] || !dnode["filename"]) continue;
+                        rp.deltas.push_back({dnode["from"].as<std::string>(),
+                                             dnode["filename"].as<std::string>(),
+                                             dnode["sha256"] ? dnode["sha256"].as<std::string>()
+                                                             : std::string{}});
+                    }
+                }
+
+                repo.packages.push_back(rp);
+            }
+            repos_.push_back(std::move(repo));
+        }
+
+        for (auto& repo : repos_) {
+            for (auto& rp : repo.packages) {
+                // 1) Always index under its real name
+                pkgMap_[rp.pkgname].push_back(rp);
+
+                // 2) Also index under each provided name, but skip the case prov==pkgname
+                for (const auto& prov : rp.provides) {
+                    if (prov == rp.pkgname)
+                        continue;    // <-- this line avoids self‐cycle on "libcap"
+                    pkgMap_[prov].push_back(rp);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool RepoIndex::stale() const {
+        std::error_code ec;
+        if (mtimes_.empty()) return true;
+        for (auto& [path, when] : mtimes_) {
+            if (fs::last_write_time(path, ec) != when || ec) return true;
+        }
+        // a repo that was not synced at load time may be now
+        for (auto& repo : repos_) {
+            if (!repo.synced && fs::exists(repoBase_ / repo.name / "repo.json", ec)) return true;
+        }
+        return false;
+    }
+
+    const RepoPkg& RepoIndex::pickBest(std::vector<RepoPkg>& candidates) {
+        std::sort(candidates.begin(), candidates.end(),
+            [](auto const& a, auto const& b) {
+                if (a.priority != b.priority)
+                    return a.priority > b.priority;
+                return Tools::versionCompare(a.pkgver, b.pkgver) > 0;
+            });
+        return candidates[0];
+    }
+
+} // namespace gradient
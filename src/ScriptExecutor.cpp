@@ -4,12 +4,115 @@
 
 #include "ScriptExecutor.h"
 
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
 #include <filesystem>
-#include <cstdlib>
 #include <iostream>
 
 namespace fs = std::filesystem;
 namespace gradient {
+
+    namespace {
+        // Hooks see the same environment whoever runs gradient
+        const char* const kHookEnv[] = {
+            "PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin",
+            "HOME=/",
+            "SHELL=/bin/sh",
+            "LC_ALL=C",
+            nullptr
+        };
+
+        // Script path and hook name arrive as $1/$2, so nothing is ever
+        // spliced into shell source
+        constexpr const char* kHookBody =
+            ". \"$1\"; "
+            "if command -v post_common >/dev/null 2>&1; then post_common; fi; "
+            "if command -v \"$2\" >/dev/null 2>&1; then \"$2\"; fi";
+
+        bool inChroot(const std::string& chrootDir) {
+            return !chrootDir.empty() && chrootDir != "/";
+        }
+    }
+
+    int ScriptExecutor::execute(const std::vector<std::string>& argv,
+                                const std::string& chrootDir,
+                                std::string& output)
+    {
+        if (argv.empty()) return -1;
+
+        // Everything the child needs is prepared before fork(): after it,
+        // only async-signal-safe calls are allowed
+        std::vector<char*> args;
+        for (auto& a : argv) args.push_back(const_cast<char*>(a.c_str()));
+        args.push_back(nullptr);
+        const bool doChroot = inChroot(chrootDir);
+
+        int pipefd[2];
+        if (pipe2(pipefd, O_CLOEXEC) != 0) return -1;
+        int devnull = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(pipefd[0]);
+            close(pipefd[1]);
+            if (devnull >= 0) close(devnull);
+            return -1;
+        }
+        if (pid == 0) {
+            if (doChroot && chroot(chrootDir.c_str()) != 0) _exit(126);
+            if (chdir("/") != 0) _exit(126);
+            if (devnull >= 0) dup2(devnull, STDIN_FILENO);
+            dup2(pipefd[1], STDOUT_FILENO);
+            dup2(pipefd[1], STDERR_FILENO);
+            execve(args[0], args.data(), const_cast<char* const*>(kHookEnv));
+            _exit(127);
+        }
+
+        close(pipefd[1]);
+        if (devnull >= 0) close(devnull);
+        char buf[4096];
+        for (;;) {
+            ssize_t n = read(pipefd[0], buf, sizeof buf);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            output.append(buf, static_cast<size_t>(n));
+        }
+        close(pipefd[0]);
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) return -1;
+        }
+        if (WIFEXITED(status)) return WEXITSTATUS(status);
+        if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+        return -1;
+    }
+
+    int ScriptExecutor::runHook(const std::string& scriptPath,
+                                const std::string& hookName,
+                                const std::string& chrootDir,
+                                std::string& output)
+    {
+        return execute({"/bin/sh", "-e", "-c", kHookBody, "sh",
+                        pathInRoot(scriptPath, chrootDir), hookName},
+                       chrootDir, output);
+    }
+
+    std::string ScriptExecutor::pathInRoot(const std::string& path,
+                                           const std::string& chrootDir)
+    {
+        // strip the leading chrootDir prefix
+        std::string inChrootPath = path;
+        if (inChroot(chrootDir) && path.rfind(chrootDir, 0) == 0) {
+            inChrootPath = path.substr(chrootDir.size());
+            if (inChrootPath.empty() || inChrootPath[0] != '/')
+                inChrootPath.insert(0, "/");
+        }
+        return inChrootPath;
+    }
+
     void ScriptExecutor::runScript(const std::string& scriptPath,
                                    const std::string& hookName,
                                    const std::string& chrootDir)
@@ -21,36 +124,27 @@ namespace gradient {
             return;
         }
 
-        // 2) Determine in‐chroot path
-        std::string inChrootPath = scriptPath;
-        bool doChroot = !chrootDir.empty() && chrootDir != "/";
-        if (doChroot) {
-            // strip leading chrootDir prefix
-            if (scriptPath.rfind(chrootDir, 0) == 0) {
-                inChrootPath = scriptPath.substr(chrootDir.size());
-                if (inChrootPath.empty()) inChrootPath = "/";
-            }
-        }
-
-        // 3) Build the shell fragment that sources + hooks
-        std::string inner = ". '" + inChrootPath + "'; "
-            "if command -v post_common >/dev/null 2>&1; then post_common; fi; "
-            "if command -v " + hookName + " >/dev/null 2>&1; then " + hookName + "; fi";
-
-        // 4) Final command: either direct or via chroot
-        std::string cmd;
-        if (doChroot) {
-            cmd = "chroot '" + chrootDir + "' /bin/sh -e -c \"" + inner + "\"";
-        } else {
-            cmd = "/bin/sh -e -c \"" + inner + "\"";
-        }
-
-        // 5) Execute it
-        int rc = std::system(cmd.c_str());
+        // 2) Run it and pass its output through
+        std::string output;
+        int rc = runHook(scriptPath, hookName, chrootDir, output);
+        std::cout << output << std::flush;
         if (rc != 0) {
             std::cerr << "\033[33mwarning:\033[0m hook '" << hookName
                       << "' in script '" << scriptPath
                       << "' exited with code " << rc << "\n";
         }
     }
-}
\ No newline at end of file
+
+    void ScriptExecutor::runCommand(const std::string& command,
+                                    const std::string& chrootDir,
+                                    const std::string& what)
+    {
+        std::string output;
+        int rc = execute({"/bin/sh", "-e", "-c", command}, chrootDir, output);
+        std::cout << output << std::flush;
+        if (rc != 0) {
+            std::cerr << "\033[33mwarning:\033[0m " << what
+                      << " exited with code " << rc << "\n";
+        }
+    }
+}
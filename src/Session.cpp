@@ -0,0 +1,798 @@
+// src/Session.cpp
+
+#include "Session.h"
+#include "Bootstrapper.h"
+#include "ConflictChecker.h"
+#include "DeltaHandler.h"
+#include "DownloadHelper.h"
+#include "ImageExporter.h"
+#include "Installer.h"
+#include "IoPolicy.h"
+#include "ObjectStore.h"
+#include "Package.h"
+#include "Staging.h"
+#include "TarHandler.h"
+#include "tools.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    Session::Session(SessionOptions options)
+        : opts_(std::move(options))
+    {
+        if (opts_.root.empty()) opts_.root = "/";
+        if (opts_.stateDir.empty()) {
+            std::string prefix = opts_.root == "/" ? "" : opts_.root;
+            opts_.stateDir = prefix + "/var/lib/gradient";
+        }
+        if (opts_.repoDir.empty())
+            opts_.repoDir = (fs::path(opts_.stateDir) / "repos").string();
+        if (opts_.cacheDir.empty()) {
+            std::string prefix = opts_.root == "/" ? "" : opts_.root;
+            opts_.cacheDir = prefix + "/var/cache/gradient/pkgs";
+        }
+    }
+
+    bool Session::open() {
+        for (const fs::path& dir : {fs::path(opts_.stateDir), fs::path(opts_.repoDir)}) {
+            std::error_code ec;
+            if (fs::exists(dir)) continue;
+            fs::create_directories(dir, ec);
+            if (ec) {
+                std::cerr << "\033[31merror:\033[0m cannot create directory '"
+                          << dir << "': " << ec.message() << "\n";
+                return false;
+            }
+        }
+
+        fs::path dbPath = fs::path(opts_.stateDir) / "gradient.db";
+        db_ = std::make_unique<Database>(dbPath.string());
+        bool ok = db_->open();
+        if (ok && !db_->schemaCurrent()) {
+            // Creating or migrating the schema is a write like any other
+            auto guard = lock();
+            ok = guard && db_->initSchema();
+        } else if (ok) {
+            ok = db_->initSchema();
+        }
+        if (!ok) {
+            std::cerr << "\033[31merror:\033[0m Unable to open or initialize database at "
+                      << dbPath << "\n";
+            db_.reset();
+            return false;
+        }
+        return true;
+    }
+
+    bool Session::openReadOnly() {
+        fs::path dbPath = fs::path(opts_.stateDir) / "gradient.db";
+
+        // Nothing installed yet: answer from an empty in-memory schema rather
+        // than creating state directories for a query
+        if (std::error_code ec; !fs::exists(dbPath, ec)) {
+            return openScratch();
+        }
+
+        db_ = std::make_unique<Database>(dbPath.string());
+        if (db_->open(/*readOnly=*/true) && db_->schemaCurrent() && db_->initSchema())
+            return true;
+
+        // An older layout has to be migrated first, which needs write access
+        db_.reset();
+        return open();
+    }
+
+    bool Session::openScratch() {
+        db_ = std::make_unique<Database>(":memory:");
+        return db_->open() && db_->initSchema();
+    }
+
+    std::unique_ptr<LockFile> Session::lock() {
+        auto guard = std::make_unique<LockFile>((fs::path(opts_.stateDir) / "lock").string());
+        if (!guard->acquire(opts_.lockTimeout)) return nullptr;
+        return guard;
+    }
+
+    Repository& Session::repository() {
+        if (!repo_) repo_ = std::make_unique<Repository>(/* url */"", opts_.repoDir);
+        return *repo_;
+    }
+
+    template <typename F>
+    auto Session::run(F&& fn) -> std::future<decltype(fn())> {
+        return std::async(std::launch::async, [this, fn = std::forward<F>(fn)]() mutable {
+            std::lock_guard<std::mutex> lk(mtx_);
+            // Downloads, extraction workers, tar and hooks all inherit it
+            if (opts_.gentle || opts_.background) IoPolicy::lowerPriority(opts_.background);
+            return fn();
+        });
+    }
+
+    const RepoIndex* Session::repos() {
+        fs::path repoBase(opts_.repoDir);
+        if (!fs::exists(repoBase) || !fs::is_directory(repoBase)) {
+            std::cerr << "\033[31merror:\033[0m repos directory '"
+                      << repoBase << "' does not exist\n";
+            return nullptr;
+        }
+        if (!index_) {
+            index_ = std::make_unique<RepoIndex>(repoBase);
+            index_->load();
+        } else if (index_->stale()) {
+            index_->load();
+        }
+        return index_.get();
+    }
+
+    /// Resolve dependencies (DFS, picking highest-priority entries) and append
+    /// everything not yet satisfied to `installOrder`.
+    bool Session::resolveInto(const std::vector<std::string>& requests,
+                              std::vector<RepoPkg>& installOrder)
+    {
+        const RepoIndex* index = repos();
+        if (!index) return false;
+        const PkgMap& pkgMap = index->packages();
+        const Database& db = *db_;
+        std::unordered_set<std::string> visited, inStack;
+
+        auto dfs = [&](auto& self, const std::string& raw_req) -> bool {
+            // 1) Parse name + optional version operator
+            const Tools::Constraint c = Tools::parseConstraint(raw_req);
+            const std::string& name = c.name;
+
+            // 2) If we've already visited or the package is installed and satisfies the version, skip it
+            if (visited.contains(name))
+                return true;
+
+            if (std::string instVer; db.getPackageVersion(name, instVer) &&
+                                     (c.op.empty() || Tools::evalConstraint(instVer, c)))
+            {
+                visited.insert(name);
+                return true;
+            }
+
+            // 3) Lookup candidates by base name
+            auto it = pkgMap.find(name);
+            if (it == pkgMap.end()) {
+                std::cerr << "\033[31merror:\033[0m package '"
+                          << raw_req << "' not found in any repo\n";
+                return false;
+            }
+
+            // 4) Filter by version constraint
+            std::vector<RepoPkg> candidates;
+            for (auto& rp : it->second) {
+                if (c.op.empty() || Tools::evalConstraint(rp.pkgver, c)) {
+                    candidates.push_back(rp);
+                }
+            }
+            if (candidates.empty()) {
+                std::cerr << "\033[31merror:\033[0m no candidate for '"
+                          << raw_req << "'\n";
+                return false;
+            }
+
+            // 5) Prefer real pkgname == name over pure providers
+            std::vector<RepoPkg> realOnly;
+            for (auto& rp : candidates) {
+                if (rp.pkgname == name) realOnly.push_back(rp);
+            }
+            if (!realOnly.empty()) candidates = std::move(realOnly);
+
+            // 6) Sort by priority, then version
+            const RepoPkg& best = RepoIndex::pickBest(candidates);
+
+            // 7) Cycle detection
+            if (inStack.count(name)) {
+                std::cout << "  \033[33mwarning:\033[0m cycle on '" << name
+                          << "', skipping\n";
+                visited.insert(name);
+                return true;
+            }
+            inStack.insert(name);
+
+            // 8) Recurse into its dependencies (passing raw strings so version matters)
+            for (auto const& raw_dep : best.depends) {
+                Tools::Constraint dc = Tools::parseConstraint(raw_dep);
+                const std::string& dn = dc.name;
+
+                // skip SONAMEs
+                if (dn.find(".so") != std::string::npos) continue;
+                // skip self‐depend
+                if (dn == name) continue;
+                // installed & matching version?
+                std::string dv;
+                if (db.getPackageVersion(dn, dv) &&
+                    (dc.op.empty() || Tools::evalConstraint(dv, dc)))
+                {
+                    continue;
+                }
+
+                if (!self(self, raw_dep))
+                    return false;
+            }
+
+            // 9) Done with this package
+            inStack.erase(name);
+            visited.insert(name);
+            installOrder.push_back(best);
+            return true;
+        };
+
+        // Kick it off with raw args (which may include version qualifiers)
+        for (auto const& r : requests) {
+            if (!dfs(dfs, r))
+                return false;
+        }
+        return true;
+    }
+
+    std::future<std::optional<Plan>> Session::resolve(std::vector<std::string> requests) {
+        return run([this, requests = std::move(requests)]() -> std::optional<Plan> {
+            std::vector<RepoPkg> order;
+            if (!resolveInto(requests, order))
+                return std::nullopt;
+
+            Plan plan;
+            for (auto& p : order) {
+                std::string instVer;
+                if (db_->getPackageVersion(p.pkgname, instVer) && instVer == p.pkgver)
+                    plan.skipped.push_back(std::move(p));
+                else
+                    plan.packages.push_back(std::move(p));
+            }
+            return plan;
+        });
+    }
+
+    std::future<std::optional<Plan>> Session::resolveUpgrades() {
+        return run([this]() -> std::optional<Plan> {
+            const RepoIndex* index = repos();
+            if (!index) return std::nullopt;
+            const PkgMap& pkgMap = index->packages();
+
+            // 1) Every installed package with a newer build under its real name
+            std::vector<RepoPkg> upgrades;
+            for (auto& installed : db_->listPackages()) {
+                auto it = pkgMap.find(installed.name);
+                if (it == pkgMap.end()) continue;
+                std::vector<RepoPkg> candidates;
+                for (auto& rp : it->second) {
+                    if (rp.pkgname == installed.name) candidates.push_back(rp);
+                }
+                if (candidates.empty()) continue;
+                const RepoPkg& best = RepoIndex::pickBest(candidates);
+                if (Tools::versionCompare(best.pkgver, installed.version) > 0)
+                    upgrades.push_back(best);
+            }
+
+            Plan plan;
+            if (upgrades.empty())
+                return plan;
+
+            // 2) Resolve those exact builds together, so anything new they
+            //    need comes first, an upgrade another one depends on is
+            //    installed before it, and none is planned twice
+            std::vector<std::string> requests;
+            for (auto& up : upgrades)
+                requests.push_back(up.pkgname + "=" + up.pkgver);
+            if (!resolveInto(requests, plan.packages))
+                return std::nullopt;
+            return plan;
+        });
+    }
+
+    namespace {
+        /// Whether a full read of `archive` succeeds and its metadata names
+        /// the package and version `p` describes.
+        bool holdsPackage(const fs::path& archive, const RepoPkg& p) {
+            Package pkg(archive.string());
+            ArchiveIndex idx;
+            std::string script;
+            if (!pkg.inspect(idx, script)) return false;
+            if (pkg.metadata().name == p.pkgname && pkg.metadata().version == p.pkgver) return true;
+            std::cerr << "\n\033[31merror:\033[0m '" << p.filename << "' holds "
+                      << pkg.metadata().name << "-" << pkg.metadata().version
+                      << ", not " << p.pkgname << "-" << p.pkgver << "\n";
+            return false;
+        }
+
+        /// Whether `archive` is the build `p` describes: its SHA-256 when the
+        /// index publishes one, otherwise holdsPackage().
+        bool verifyArchive(const fs::path& archive, const RepoPkg& p) {
+            if (!p.sha256.empty()) {
+                std::string hex;
+                if (ObjectStore::hashFile(archive.string(), hex) && hex == p.sha256) return true;
+                std::cerr << "\n\033[31merror:\033[0m checksum mismatch for '" << p.filename << "'\n";
+                return false;
+            }
+            return holdsPackage(archive, p);
+        }
+
+        /// Beside an archive rebuilt from a delta, which never matches the
+        /// published checksum: "<published sha256> <sha256 of the rebuild>".
+        fs::path verifiedMarker(const fs::path& archive) {
+            return archive.string() + ".verified";
+        }
+
+        /// Vouch for `rebuilt`, about to become `archive`.
+        bool markVerified(const fs::path& rebuilt, const fs::path& archive, const RepoPkg& p) {
+            if (p.sha256.empty()) return true;
+            std::string hex;
+            if (!ObjectStore::hashFile(rebuilt.string(), hex)) return false;
+            std::ofstream out(verifiedMarker(archive), std::ios::trunc);
+            out << p.sha256 << " " << hex << "\n";
+            return bool(out.flush());
+        }
+
+        /// A cached archive was verified before it was renamed into place;
+        /// only a published checksum can tell that it has gone stale since.
+        /// A rebuilt one passes while its marker vouches for it against the
+        /// checksum the index publishes now.
+        bool cached(const fs::path& archive, const RepoPkg& p) {
+            std::error_code ec;
+            if (!fs::is_regular_file(archive, ec)) return false;
+            if (p.sha256.empty()) return true;
+            std::string hex;
+            if (!ObjectStore::hashFile(archive.string(), hex)) return false;
+            if (hex == p.sha256) return true;
+            std::ifstream marker(verifiedMarker(archive));
+            std::string published, rebuilt;
+            return marker >> published >> rebuilt && published == p.sha256 && rebuilt == hex;
+        }
+    }
+
+    /// Download every entry of `plan` into `tmp` and return the archive to
+    /// install for each, in plan order. When the package is already installed
+    /// and the repo publishes a delta from that exact version, the delta is
+    /// fetched and rebuilt into a full archive instead; any failure on that
+    /// path falls back to the full download. Archives are written to a .part
+    /// name and only take their final name once verified, so whatever `tmp`
+    /// already holds under that name is reused as is, and a .part left by a
+    /// failed transfer is resumed where it stopped.
+    std::optional<std::vector<fs::path>>
+    Session::fetchLocked(const Plan& plan, const fs::path& tmp, const ProgressFn& progress) {
+        std::error_code ec;
+        fs::create_directories(tmp, ec);
+        if (ec) {
+            std::cerr << "\033[31merror:\033[0m cannot create directory '"
+                      << tmp.string() << "': " << ec.message() << "\n";
+            return std::nullopt;
+        }
+
+        // Initialize curl once
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+
+        // We'll collect futures here
+        const auto& pkgs = plan.packages;
+        std::vector<std::future<fs::path>> futures;
+        futures.reserve(pkgs.size());
+
+        // A mutex to serialize progress‐bar prints
+        static std::mutex printMutex;
+        const std::string installRoot = opts_.root;
+        // Downloads run side by side and draw from one budget
+        std::unique_ptr<RateLimiter> limiter;
+        if (opts_.maxDownloadRate) limiter = std::make_unique<RateLimiter>(opts_.maxDownloadRate);
+
+        // Launch one download task per package
+        for (size_t i = 0; i < pkgs.size(); ++i) {
+            const auto& p = pkgs[i];
+            std::string url = p.repoUrl + "/" + p.filename;
+            fs::path out   = tmp / p.filename;
+
+            // Pick a delta against the installed version, if any
+            std::optional<DeltaInfo> delta;
+            DeltaHandler::Base base;
+            if (DeltaHandler::snapshotBase(*db_, p.pkgname, base)) {
+                for (auto& d : p.deltas) {
+                    if (d.from == base.version) { delta = d; break; }
+                }
+            }
+
+            // Copy the context by value so each thread has its own
+            DownloadContext ctx{
+                int(i+1),
+                int(pkgs.size()),
+                p.pkgname + "-" + p.pkgver,
+                &printMutex,
+                opts_.interactive
+            };
+            ctx.segments = static_cast<int>(std::max(opts_.downloadSegments, 1u));
+            ctx.limiter = limiter.get();
+            ctx.expected = static_cast<curl_off_t>(p.size);
+            if (progress) {
+                ctx.onProgress = [progress, label = ctx.name, i, n = pkgs.size()](curl_off_t now, curl_off_t total) {
+                    progress(Progress{Progress::Stage::Download, label, i + 1, n,
+                                      static_cast<std::uint64_t>(now),
+                                      static_cast<std::uint64_t>(total)});
+                };
+            }
+
+            // async launch
+            futures.push_back(std::async(std::launch::async,
+                [p, url, out, ctx, delta, base, tmp, installRoot]() mutable -> fs::path {
+                    if (cached(out, p)) {
+                        if (ctx.onProgress) {
+                            std::error_code ec;
+                            auto size = static_cast<curl_off_t>(fs::file_size(out, ec));
+                            ctx.onProgress(size, size);
+                        }
+                        if (ctx.show) {
+                            std::lock_guard<std::mutex> lk(*ctx.printMutex);
+                            printf("  ✔ [%d/%d] %-20s cached\n", ctx.index, ctx.total, ctx.name.c_str());
+                            fflush(stdout);
+                        }
+                        return out;
+                    }
+
+                    // A full download interrupted earlier resumes from its .part
+                    // file (or the .part.seg of a segmented one), which outlives
+                    // failed attempts; a delta is only tried when there is none
+                    const fs::path part = out.string() + ".part";
+                    std::error_code ec;
+                    if (delta && !fs::exists(part, ec) && !fs::exists(part.string() + ".seg", ec)) {
+                        fs::path deltaOut = tmp / delta->filename;
+                        fs::path rebuilt  = tmp / (p.filename + ".rebuilt");
+                        ctx.name += " (delta)";
+                        // The rebuilt archive is checked file by file against the
+                        // hashes the delta carries, which the delta's own published
+                        // checksum vouches for; it never matches p.sha256
+                        std::string hex;
+                        bool got = downloadWithCurl(p.repoUrl + "/" + delta->filename, deltaOut.string(), ctx)
+                                   && (delta->sha256.empty()
+                                       || (ObjectStore::hashFile(deltaOut.string(), hex) && hex == delta->sha256))
+                                   && DeltaHandler::reconstruct(deltaOut.string(), base,
+                                                                installRoot, rebuilt.string())
+                                   && holdsPackage(rebuilt, p)
+                                   && markVerified(rebuilt, out, p);
+                        if (got) fs::rename(rebuilt, out, ec);
+                        fs::remove(deltaOut, ec);
+                        fs::remove(rebuilt, ec);
+                        if (got && fs::exists(out, ec)) return out;
+                        ctx.name = p.pkgname + "-" + p.pkgver;
+                    }
+
+                    for (int tries = 0; tries < 2; ++tries) {
+                        if (!downloadSegmented(url, part.string(), ctx)) return {};
+                        if (verifyArchive(part, p)) {
+                            fs::remove(verifiedMarker(out), ec);
+                            fs::rename(part, out, ec);
+                            return ec ? fs::path{} : out;
+                        }
+                        // Bad data is not worth resuming; a resumed file may have
+                        // had a stale start, so it gets one clean download
+                        fs::remove(part, ec);
+                        if (ctx.resumed == 0) break;
+                    }
+                    return {};
+                }
+            ));
+        }
+
+        // Wait for all to finish; one failure does not stop the others, and
+        // whatever they complete stays cached for the next attempt
+        bool allOk = true;
+        std::vector<fs::path> archives;
+        for (size_t i = 0; i < futures.size(); ++i) {
+            archives.push_back(futures[i].get());
+            if (archives.back().empty()) {
+                std::cerr << "\033[31merror:\033[0m could not download '" << pkgs[i].filename << "'\n";
+                allOk = false;
+            }
+        }
+
+        curl_global_cleanup();
+        if (!allOk) return std::nullopt;
+        return archives;
+    }
+
+    std::future<std::optional<std::vector<fs::path>>>
+    Session::fetch(Plan plan, fs::path dir, ProgressFn progress) {
+        return run([this, plan = std::move(plan), dir = std::move(dir), progress = std::move(progress)] {
+            return fetchLocked(plan, dir, progress);
+        });
+    }
+
+    /// Check `archives` for file conflicts with each other and with what is
+    /// installed, as one transaction.
+    bool Session::checkConflicts(const std::vector<std::string>& archives) {
+        if (archives.size() < 2) return true;
+        ConflictChecker checker(*db_);
+        for (auto& a : archives) {
+            if (!checker.addArchive(a)) return false;
+        }
+        if (auto conflicts = checker.check(); !conflicts.empty()) {
+            ConflictChecker::report(conflicts);
+            if (!opts_.force) {
+                std::cerr << "\033[31merror:\033[0m Aborting due to file conflicts.\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Check `archives` for file conflicts as one transaction, then install
+    /// them in order. Stops at the first failure when `staged` is set (a
+    /// resolved plan), otherwise carries on like `install-bin` always has.
+    bool Session::installLocked(const std::vector<std::string>& archives,
+                                const std::vector<std::string>& labels,
+                                const std::unordered_set<std::string>& staged,
+                                const ProgressFn& progress)
+    {
+        auto guard = lock();
+        if (!guard) return false;
+        if (!checkConflicts(archives)) return false;
+
+        Installer inst(*db_, repository(), opts_.force, opts_.root, staged);
+        inst.setHookJobs(opts_.jobs);
+        inst.setDurability(opts_.durability);
+        inst.setGentle(opts_.gentle);
+        std::optional<DiskThrottle> throttle;
+        if (opts_.background) inst.setThrottle(&throttle.emplace(opts_.root));
+        std::optional<ObjectStore> store;
+        if (!opts_.storeDir.empty()) {
+            if (!store.emplace(opts_.storeDir).open()) return false;
+            inst.setStore(&*store);
+        }
+        bool allOk = true;
+        for (size_t i = 0; i < archives.size(); ++i) {
+            if (progress)
+                progress(Progress{Progress::Stage::Install, labels[i], i + 1, archives.size()});
+            if (!inst.installArchive(archives[i])) {
+                std::cerr << "\033[31merror:\033[0m Failed to install '" << labels[i] << "'\n";
+                allOk = false;
+                if (!staged.empty()) break;
+            }
+        }
+        inst.finish();
+        return allOk;
+    }
+
+    std::future<bool> Session::install(Plan plan, ProgressFn progress) {
+        return run([this, plan = std::move(plan), progress = std::move(progress)] {
+            if (plan.packages.empty()) return true;
+
+            auto archives = fetchLocked(plan, opts_.cacheDir, progress);
+            if (!archives) {
+                std::cerr << "\n\033[31merror:\033[0m one or more downloads failed; aborting install\n";
+                return false;
+            }
+
+            std::vector<std::string> paths, labels;
+            std::unordered_set<std::string> staged;
+            for (size_t i = 0; i < plan.packages.size(); ++i) {
+                auto const& p = plan.packages[i];
+                paths.push_back((*archives)[i].string());
+                labels.push_back(p.pkgname + "-" + p.pkgver);
+                staged.insert(p.pkgname);
+            }
+            return installLocked(paths, labels, staged, progress);
+        });
+    }
+
+    std::future<bool> Session::stage(Plan plan, ProgressFn progress) {
+        return run([this, plan = std::move(plan), progress = std::move(progress)] {
+            if (plan.packages.empty()) return true;
+
+            auto archives = fetchLocked(plan, opts_.cacheDir, progress);
+            if (!archives) {
+                std::cerr << "\n\033[31merror:\033[0m one or more downloads failed; aborting stage\n";
+                return false;
+            }
+
+            // Nothing is installed, but apply must not see a half-written stage
+            auto guard = lock();
+            if (!guard) return false;
+            std::vector<std::string> paths;
+            for (auto& a : *archives) paths.push_back(a.string());
+            if (!checkConflicts(paths)) return false;
+
+            Staging staging((fs::path(opts_.stateDir) / "staged").string());
+            if (!staging.reset()) return false;
+            for (size_t i = 0; i < plan.packages.size(); ++i) {
+                auto const& p = plan.packages[i];
+                const std::string label = p.pkgname + "-" + p.pkgver;
+                if (progress)
+                    progress(Progress{Progress::Stage::Unpack, label, i + 1, plan.packages.size()});
+                std::string from;
+                db_->getPackageVersion(p.pkgname, from);
+                if (!staging.add(paths[i], from)) {
+                    std::cerr << "\033[31merror:\033[0m Failed to stage '" << label << "'\n";
+                    staging.reset();
+                    return false;
+                }
+            }
+            return staging.commit();
+        });
+    }
+
+    std::future<bool> Session::apply(ProgressFn progress) {
+        return run([this, progress = std::move(progress)] {
+            auto guard = lock();
+            if (!guard) return false;
+
+            Staging staging((fs::path(opts_.stateDir) / "staged").string());
+            if (!staging.load()) {
+                std::cerr << "\033[31merror:\033[0m nothing is staged\n";
+                return false;
+            }
+            // The checks stage made only hold for the system it saw
+            std::unordered_set<std::string> staged;
+            for (auto& e : staging.entries()) {
+                std::string now;
+                db_->getPackageVersion(e.name, now);
+                if (now != e.from) {
+                    std::cerr << "\033[31merror:\033[0m '" << e.name << "' changed since it was staged ("
+                              << (e.from.empty() ? "not installed" : e.from) << " -> "
+                              << (now.empty() ? "not installed" : now) << "); stage again\n";
+                    return false;
+                }
+                staged.insert(e.name);
+            }
+
+            Installer inst(*db_, repository(), opts_.force, opts_.root, staged);
+            inst.setHookJobs(opts_.jobs);
+            inst.setDurability(opts_.durability);
+            inst.setGentle(opts_.gentle);
+            std::optional<DiskThrottle> throttle;
+            if (opts_.background) inst.setThrottle(&throttle.emplace(opts_.root));
+            std::optional<ObjectStore> store;
+            if (!opts_.storeDir.empty()) {
+                if (!store.emplace(opts_.storeDir).open()) return false;
+                inst.setStore(&*store);
+            }
+            bool allOk = true;
+            const auto& entries = staging.entries();
+            for (size_t i = 0; i < entries.size(); ++i) {
+                const std::string label = entries[i].name + "-" + entries[i].version;
+                if (progress)
+                    progress(Progress{Progress::Stage::Install, label, i + 1, entries.size()});
+                if (!inst.applyStaged(staging.slotPath(entries[i]))) {
+                    std::cerr << "\033[31merror:\033[0m Failed to install '" << label << "'\n";
+                    allOk = false;
+                    break;
+                }
+            }
+            inst.finish();
+            // Moved-out slots cannot be applied twice
+            staging.reset();
+            return allOk;
+        });
+    }
+
+    std::future<bool> Session::installArchives(std::vector<std::string> archives, ProgressFn progress) {
+        return run([this, archives = std::move(archives), progress = std::move(progress)] {
+            return installLocked(archives, archives, {}, progress);
+        });
+    }
+
+    bool Session::bootstrapLocked(const std::vector<std::string>& archives, const ProgressFn& progress) {
+        auto guard = lock();
+        if (!guard) return false;
+
+        Bootstrapper::ExtractedFn onExtracted;
+        if (progress) {
+            // Extraction runs on worker threads; keep events one at a time
+            onExtracted = [&progress, m = std::make_shared<std::mutex>()]
+                          (const std::string& label, size_t done, size_t total) {
+                std::lock_guard<std::mutex> lk(*m);
+                progress(Progress{Progress::Stage::Install, label, done, total});
+            };
+        }
+        Bootstrapper boot(opts_.root, (fs::path(opts_.stateDir) / "gradient.db").string(),
+                          opts_.jobs, opts_.force, opts_.durability);
+        std::optional<DiskThrottle> throttle;
+        if (opts_.background) boot.setThrottle(&throttle.emplace(opts_.root));
+        return boot.run(archives, onExtracted);
+    }
+
+    std::future<bool> Session::bootstrap(Plan plan, ProgressFn progress) {
+        return run([this, plan = std::move(plan), progress = std::move(progress)] {
+            if (plan.packages.empty()) return true;
+
+            auto archives = fetchLocked(plan, opts_.cacheDir, progress);
+            if (!archives) {
+                std::cerr << "\n\033[31merror:\033[0m one or more downloads failed; aborting bootstrap\n";
+                return false;
+            }
+            std::vector<std::string> paths;
+            for (auto& a : *archives) paths.push_back(a.string());
+            return bootstrapLocked(paths, progress);
+        });
+    }
+
+    std::future<bool> Session::bootstrapArchives(std::vector<std::string> archives, ProgressFn progress) {
+        return run([this, archives = std::move(archives), progress = std::move(progress)] {
+            return bootstrapLocked(archives, progress);
+        });
+    }
+
+    std::future<bool> Session::exportImage(Plan plan, std::string out, bool layers, ProgressFn progress) {
+        return run([this, plan = std::move(plan), out = std::move(out), layers,
+                    progress = std::move(progress)] {
+            auto archives = fetchLocked(plan, opts_.cacheDir, progress);
+            if (!archives) {
+                std::cerr << "\n\033[31merror:\033[0m one or more downloads failed; aborting export\n";
+                return false;
+            }
+            std::vector<std::string> paths;
+            for (auto& a : *archives) paths.push_back(a.string());
+            ImageExporter exporter(out, layers, opts_.force);
+            return exporter.run(paths, [&](const std::string& label, size_t done, size_t total) {
+                if (progress) progress(Progress{Progress::Stage::Install, label, done, total});
+            });
+        });
+    }
+
+    std::future<bool> Session::exportArchives(std::vector<std::string> archives, std::string out,
+                                              bool layers, ProgressFn progress) {
+        return run([this, archives = std::move(archives), out = std::move(out), layers,
+                    progress = std::move(progress)] {
+            ImageExporter exporter(out, layers, opts_.force);
+            return exporter.run(archives, [&](const std::string& label, size_t done, size_t total) {
+                if (progress) progress(Progress{Progress::Stage::Install, label, done, total});
+            });
+        });
+    }
+
+    std::future<bool> Session::remove(std::vector<std::string> names, ProgressFn progress) {
+        return run([this, names = std::move(names), progress = std::move(progress)] {
+            auto guard = lock();
+            if (!guard) return false;
+
+            Installer inst(*db_, repository(), opts_.force, opts_.root);
+            inst.setHookJobs(opts_.jobs);
+            bool allOk = true;
+            for (size_t i = 0; i < names.size(); ++i) {
+                if (progress)
+                    progress(Progress{Progress::Stage::Remove, names[i], i + 1, names.size()});
+                if (!inst.removePackage(names[i])) {
+                    std::cerr << "\033[31merror:\033[0m Failed to remove '" << names[i] << "'\n";
+                    allOk = false;
+                }
+            }
+            inst.finish();
+            return allOk;
+        });
+    }
+
+    std::future<std::vector<PackageInfo>> Session::query() {
+        return run([this] { return db_->listPackages(); });
+    }
+
+    std::future<std::optional<PackageInfo>> Session::info(std::string name) {
+        return run([this, name = std::move(name)]() -> std::optional<PackageInfo> {
+            PackageInfo pkg;
+            if (!db_->getPackage(name, pkg)) return std::nullopt;
+            return pkg;
+        });
+    }
+
+    std::future<std::vector<RepoPkg>> Session::search(std::string pattern) {
+        return run([this, pattern = std::move(pattern)]() mutable {
+            std::vector<RepoPkg> matches;
+            const RepoIndex* index = repos();
+            if (!index) return matches;
+
+            std::ranges::transform(pattern, pattern.begin(), ::tolower);
+            for (auto& repo : index->repos()) {
+                for (const auto& pkg : repo.packages) {
+                    std::string lowName = pkg.pkgname;
+                    std::ranges::transform(lowName, lowName.begin(), ::tolower);
+                    if (lowName.find(pattern) != std::string::npos)
+                        matches.push_back(pkg);
+                }
+            }
+            return matches;
+        });
+    }
+
+} // namespace gradient
@@ -0,0 +1,183 @@
+// src/Staging.cpp
+
+#include "Staging.h"
+#include "Durability.h"
+#include "Package.h"
+#include "PayloadWriter.h"
+#include "TarHandler.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <ranges>
+#include <utility>
+#include <yaml-cpp/yaml.h>
+
+namespace fs = std::filesystem;
+
+namespace gradient {
+
+    namespace {
+        constexpr const char* kManifest = "manifest.yaml";
+    }
+
+    Staging::Staging(std::string dir) : dir_(std::move(dir)) {}
+
+    std::string Staging::slotPath(const Entry& e) const {
+        return (fs::path(dir_) / e.slot).string();
+    }
+
+    bool Staging::reset() {
+        entries_.clear();
+        std::error_code ec;
+        fs::remove_all(dir_, ec);
+        // Staged setuid binaries must not be reachable by anyone but root
+        if (!ec) fs::create_directories(dir_, ec);
+        if (!ec) fs::permissions(dir_, fs::perms::owner_all, ec);
+        if (ec) {
+            std::cerr << "\033[31merror:\033[0m cannot reset staging directory '" << dir_
+                      << "': " << ec.message() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool Staging::add(const std::string& archive, const std::string& from) {
+        Package pkg(archive);
+        ArchiveIndex idx;
+        std::string script, yaml;
+        if (!pkg.inspect(idx, script) || !TarHandler::readMember(archive, idx.metaMember, yaml))
+            return false;
+
+        Entry e{pkg.metadata().name, pkg.metadata().version, from, std::to_string(entries_.size())};
+        const fs::path slot = slotPath(e);
+        std::error_code ec;
+        fs::create_directories(slot / "package", ec);
+        if (ec) {
+            std::cerr << "\033[31merror:\033[0m cannot create '" << slot.string() << "': "
+                      << ec.message() << "\n";
+            return false;
+        }
+        std::ofstream(slot / "anemonix.yaml", std::ios::binary | std::ios::trunc) << yaml;
+        if (!idx.scriptMember.empty())
+            std::ofstream(slot / "install.anemonix", std::ios::binary | std::ios::trunc) << script;
+
+        const std::string payload = (slot / "package").string();
+        const bool ok = idx.payloadMember.empty()
+                     || (PayloadWriter::supports(archive) ? PayloadWriter::extract(archive, idx, payload)
+                                                          : TarHandler::extractPayload(archive, idx, payload));
+        if (!ok) {
+            std::cerr << "\033[31merror:\033[0m failed to unpack '" << archive << "'\n";
+            return false;
+        }
+        entries_.push_back(std::move(e));
+        return true;
+    }
+
+    bool Staging::commit() const {
+        // The slots are on disk before the manifest says they are complete
+        if (!Durability::syncFilesystem(dir_)) return false;
+
+        YAML::Node root;
+        for (auto& e : entries_) {
+            YAML::Node n;
+            n["name"] = e.name;
+            n["version"] = e.version;
+            n["from"] = e.from;
+            n["slot"] = e.slot;
+            root["packages"].push_back(n);
+        }
+        const fs::path tmp = fs::path(dir_) / (std::string(kManifest) + ".tmp");
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            out << root << "\n";
+            if (!out.flush()) {
+                std::cerr << "\033[31merror:\033[0m cannot write '" << tmp.string() << "'\n";
+                return false;
+            }
+        }
+        if (std::rename(tmp.c_str(), (fs::path(dir_) / kManifest).c_str()) != 0) {
+            std::cerr << "\033[31merror:\033[0m cannot write staging manifest: "
+                      << std::strerror(errno) << "\n";
+            return false;
+        }
+        return Durability::syncFilesystem(dir_);
+    }
+
+    bool Staging::load() {
+        entries_.clear();
+        const fs::path manifest = fs::path(dir_) / kManifest;
+        std::error_code ec;
+        if (!fs::exists(manifest, ec)) return false;
+        try {
+            YAML::Node root = YAML::LoadFile(manifest.string());
+            for (const auto& n : root["packages"]) {
+                entries_.push_back({n["name"].as<std::string>(), n["version"].as<std::string>(),
+                                    n["from"].as<std::string>(), n["slot"].as<std::string>()});
+            }
+        } catch (const YAML::Exception& ex) {
+            std::cerr << "\033[31merror:\033[0m parsing " << manifest << ": " << ex.what() << "\n";
+            entries_.clear();
+            return false;
+        }
+        return !entries_.empty();
+    }
+
+    bool Staging::move(const std::string& payload, const std::string& rootDir) {
+        // Decide everything before renaming: a directory being read is not
+        // one to move entries out of, and renames change the mtime of both
+        std::vector<fs::path> moves;
+        std::vector<std::pair<fs::path, struct stat>> merges;
+        std::error_code ec;
+        for (auto it = fs::recursive_directory_iterator(payload, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+        {
+            const fs::path dest = fs::path(rootDir) / fs::relative(it->path(), payload);
+            std::error_code dec;
+            // Existing directories (or symlinks to them, like /lib -> usr/lib) are merged into
+            struct stat st{};
+            if (!it->is_symlink() && it->is_directory() && fs::is_directory(dest, dec)
+                && ::lstat(it->path().c_str(), &st) == 0)
+            {
+                merges.emplace_back(it->path(), st);
+            } else {
+                moves.push_back(it->path());
+                it.disable_recursion_pending();
+            }
+        }
+        if (ec) {
+            std::cerr << "\033[31merror:\033[0m cannot read '" << payload << "': " << ec.message() << "\n";
+            return false;
+        }
+
+        for (auto& src : moves) {
+            const fs::path dest = fs::path(rootDir) / fs::relative(src, payload);
+            if (::rename(src.c_str(), dest.c_str()) != 0) {
+                const int err = errno;
+                if (err != EXDEV)
+                    std::cerr << "\033[31merror:\033[0m cannot move '" << dest.string() << "' into place: "
+                              << std::strerror(err) << "\n";
+                errno = err;
+                return false;
+            }
+        }
+        // Same as tar -p: the package decides mode, ownership and mtime;
+        // innermost first, so stamping a directory is the last change to it
+        for (auto& [src, st] : std::views::reverse(merges)) {
+            const fs::path dest = fs::path(rootDir) / fs::relative(src, payload);
+            if (::chown(dest.c_str(), st.st_uid, st.st_gid) != 0 && errno != EPERM) return false;
+            ::chmod(dest.c_str(), st.st_mode & 07777);
+            const timespec times[2] = {st.st_atim, st.st_mtim};
+            ::utimensat(AT_FDCWD, dest.c_str(), times, 0);
+        }
+        return true;
+    }
+
+} // namespace gradient
@@ -3,11 +3,14 @@
 //
 
 #include "TarHandler.h"
+#include <cstdio>
 #include <cstdlib>
+#include <string_view>
 namespace gradient {
 
     bool TarHandler::extract(const std::string& archive, const std::string& dest) {
-        std::string cmd = "tar -xf " + archive + " -C " + dest;
+        // Every xattr namespace, so capabilities survive into the store
+        std::string cmd = "tar --acls --xattrs --xattrs-include='*' -xpf " + archive + " -C " + dest;
         return std::system(cmd.c_str()) == 0;
     }
 
@@ -20,4 +23,67 @@ namespace gradient {
         return std::system(cmd.c_str()) == 0;
     }
 
+    bool TarHandler::list(const std::string& archive, std::vector<std::string>& members) {
+        std::string cmd = "tar -tf '" + archive + "'";
+        FILE* p = popen(cmd.c_str(), "r");
+        if (!p) return false;
+        char* line = nullptr;
+        size_t cap = 0;
+        ssize_t n;
+        while ((n = getline(&line, &cap, p)) > 0) {
+            if (line[n - 1] == '\n') --n;
+            members.emplace_back(line, n);
+        }
+        free(line);
+        return pclose(p) == 0;
+    }
+
+    bool TarHandler::readMember(const std::string& archive,
+                                const std::string& member,
+                                std::string& out) {
+        std::string cmd = "tar -xOf '" + archive + "' '" + member + "'";
+        FILE* p = popen(cmd.c_str(), "r");
+        if (!p) return false;
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof buf, p)) > 0) out.append(buf, n);
+        return pclose(p) == 0;
+    }
+
+    bool TarHandler::index(const std::string& archive, ArchiveIndex& out) {
+        std::vector<std::string> members;
+        if (!list(archive, members)) return false;
+
+        for (auto& m : members) {
+            std::string_view v(m);
+            if (v.starts_with("./")) v.remove_prefix(2);
+            if (v == "anemonix.yaml") {
+                out.metaMember = m;
+            } else if (v == "install.anemonix") {
+                out.scriptMember = m;
+            } else if (v == "package/" || v == "package") {
+                out.payloadMember = m.back() == '/' ? m.substr(0, m.size() - 1) : m;
+            } else if (v.starts_with("package/")) {
+                if (out.payloadMember.empty())
+                    out.payloadMember = m.substr(0, m.size() - v.size() + std::string_view("package").size());
+                // directories may be shared freely; only files and symlinks are owned
+                if (!v.ends_with('/'))
+                    out.paths.emplace_back(v.substr(std::string_view("package").size()));
+            }
+        }
+        return !out.metaMember.empty();
+    }
+
+    bool TarHandler::extractPayload(const std::string& archive, const ArchiveIndex& idx,
+                                    const std::string& rootDir) {
+        if (idx.payloadMember.empty()) return true;   // metadata-only package
+        // "./package/x" -> "x": one component per path segment of the prefix
+        int strip = 1;
+        for (char c : idx.payloadMember) strip += c == '/';
+        std::string cmd = "tar --acls --xattrs --xattrs-include='*' -xpf '" + archive + "' -C '" + rootDir
+                        + "' --strip-components=" + std::to_string(strip)
+                        + " '" + idx.payloadMember + "'";
+        return std::system(cmd.c_str()) == 0;
+    }
+
 } // namespace anemo
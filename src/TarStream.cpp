@@ -0,0 +1,356 @@
+// src/TarStream.cpp
+
+#include "TarStream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+namespace gradient {
+
+    namespace {
+        constexpr size_t kBlock = 512;
+
+        // ustar header field offsets and widths
+        struct Field { size_t off, len; };
+        constexpr Field kName{0, 100}, kMode{100, 8}, kUid{108, 8}, kGid{116, 8},
+                        kSize{124, 12}, kMtime{136, 12}, kChksum{148, 8}, kType{156, 1},
+                        kLink{157, 100}, kMagic{257, 6}, kVersion{263, 2}, kUname{265, 32},
+                        kGname{297, 32}, kDevMajor{329, 8}, kDevMinor{337, 8}, kPrefix{345, 155};
+
+        std::string text(const char* h, Field f) {
+            const char* p = h + f.off;
+            return {p, strnlen(p, f.len)};
+        }
+
+        // Octal, or GNU base-256 when the high bit of the first byte is set
+        std::uint64_t number(const char* h, Field f) {
+            const auto* p = reinterpret_cast<const unsigned char*>(h + f.off);
+            std::uint64_t v = 0;
+            if (p[0] & 0x80) {
+                v = p[0] & 0x7f;
+                for (size_t i = 1; i < f.len; ++i) v = (v << 8) | p[i];
+                return v;
+            }
+            for (size_t i = 0; i < f.len; ++i) {
+                if (p[i] == ' ' && v == 0) continue;
+                if (p[i] < '0' || p[i] > '7') break;
+                v = v * 8 + (p[i] - '0');
+            }
+            return v;
+        }
+
+        bool putNumber(char* h, Field f, std::uint64_t v) {
+            // len-1 octal digits plus NUL
+            if (f.len - 1 < 22 && v >> (3 * (f.len - 1))) return false;
+            std::snprintf(h + f.off, f.len, "%0*llo", int(f.len - 1),
+                          static_cast<unsigned long long>(v));
+            return true;
+        }
+
+        void putText(char* h, Field f, const std::string& s) {
+            std::memcpy(h + f.off, s.data(), std::min(s.size(), f.len));
+        }
+
+        std::uint64_t padTo(std::uint64_t n) { return (kBlock - n % kBlock) % kBlock; }
+
+        // Pax record: "<len> <key>=<value>\n", where <len> counts itself
+        std::string paxRecord(const std::string& key, const std::string& value) {
+            size_t body = key.size() + value.size() + 3;   // ' ', '=', '\n'
+            size_t len = body + std::to_string(body).size();
+            if (std::to_string(len).size() != std::to_string(body).size()) ++len;
+            return std::to_string(len) + " " + key + "=" + value + "\n";
+        }
+
+        void applyPax(const std::string& data, std::map<std::string, std::string>& out) {
+            size_t pos = 0;
+            while (pos < data.size()) {
+                size_t sp = data.find(' ', pos);
+                if (sp == std::string::npos) break;
+                size_t len = std::strtoull(data.c_str() + pos, nullptr, 10);
+                if (len == 0 || pos + len > data.size()) break;
+                std::string rec = data.substr(sp + 1, pos + len - sp - 2);
+                if (auto eq = rec.find('='); eq != std::string::npos)
+                    out[rec.substr(0, eq)] = rec.substr(eq + 1);
+                pos += len;
+            }
+        }
+
+        bool decimal(const std::string& text, std::uint64_t& out) {
+            if (text.empty() || text[0] < '0' || text[0] > '9') return false;
+            char* end = nullptr;
+            errno = 0;
+            const unsigned long long v = std::strtoull(text.c_str(), &end, 10);
+            if (errno || *end) return false;
+            out = v;
+            return true;
+        }
+
+        // pax mtime: decimal seconds, optionally negative and fractional
+        bool seconds(const std::string& text, std::int64_t& out) {
+            char* end = nullptr;
+            errno = 0;
+            const long long v = std::strtoll(text.c_str(), &end, 10);
+            if (errno || end == text.c_str() || (*end && *end != '.')) return false;
+            out = v;
+            return true;
+        }
+
+        const char* decompressor(const unsigned char* m, size_t n) {
+            if (n >= 2 && m[0] == 0x1f && m[1] == 0x8b) return "gzip -dc";
+            if (n >= 6 && std::memcmp(m, "\xfd" "7zXZ\0", 6) == 0) return "xz -dc";
+            if (n >= 4 && std::memcmp(m, "\x28\xb5\x2f\xfd", 4) == 0) return "zstd -dc";
+            if (n >= 3 && std::memcmp(m, "BZh", 3) == 0) return "bzip2 -dc";
+            return nullptr;
+        }
+    }
+
+    // ---- TarReader -------------------------------------------------------
+
+    TarReader::TarReader(std::string archive) : archive_(std::move(archive)) {}
+
+    TarReader::~TarReader() {
+        if (!in_) return;
+        if (pipe_) pclose(in_);
+        else fclose(in_);
+    }
+
+    bool TarReader::open() {
+        in_ = std::fopen(archive_.c_str(), "rb");
+        if (!in_) return false;
+        unsigned char magic[6] = {};
+        size_t n = std::fread(magic, 1, sizeof magic, in_);
+        if (const char* tool = decompressor(magic, n)) {
+            std::fclose(in_);
+            std::string cmd = std::string(tool) + " '" + archive_ + "'";
+            in_ = popen(cmd.c_str(), "r");
+            pipe_ = true;
+            return in_ != nullptr;
+        }
+        std::rewind(in_);
+        return true;
+    }
+
+    int TarReader::fd() const {
+        return in_ ? fileno(in_) : -1;
+    }
+
+    bool TarReader::readBlock(char* block) {
+        if (std::fread(block, 1, kBlock, in_) == kBlock) {
+            offset_ += kBlock;
+            return true;
+        }
+        failed_ = true;
+        return false;
+    }
+
+    bool TarReader::skip(std::uint64_t bytes) {
+        if (!bytes) return true;
+        if (!pipe_) {
+            if (fseeko(in_, static_cast<off_t>(bytes), SEEK_CUR) != 0) { failed_ = true; return false; }
+            offset_ += bytes;
+            return true;
+        }
+        char buf[8192];
+        while (bytes) {
+            size_t n = std::fread(buf, 1, std::min<std::uint64_t>(bytes, sizeof buf), in_);
+            if (n == 0) { failed_ = true; return false; }
+            bytes -= n;
+            offset_ += n;
+        }
+        return true;
+    }
+
+    bool TarReader::readAll(std::uint64_t size, std::string& out) {
+        out.resize(size);
+        if (size && std::fread(out.data(), 1, size, in_) != size) { failed_ = true; return false; }
+        offset_ += size;
+        return skip(padTo(size));
+    }
+
+    bool TarReader::next(TarEntry& e) {
+        if (!in_ || failed_ || !skip(remaining_ + padding_)) return false;
+        remaining_ = padding_ = 0;
+
+        std::map<std::string, std::string> pax;
+        std::string longName, longLink;
+        char h[kBlock];
+        for (;;) {
+            if (!readBlock(h)) return false;
+            if (std::all_of(h, h + kBlock, [](char c) { return c == 0; }))
+                return false;   // end of archive
+
+            const char type = h[kType.off];
+            const std::uint64_t size = number(h, kSize);
+            std::string data;
+            if (type == 'x') {
+                if (!readAll(size, data)) return false;
+                applyPax(data, pax);
+                continue;
+            }
+            if (type == 'g') {   // global pax header: nothing we keep
+                if (!skip(size + padTo(size))) return false;
+                continue;
+            }
+            if (type == 'L' || type == 'K') {
+                if (!readAll(size, data)) return false;
+                data.resize(strnlen(data.data(), data.size()));
+                (type == 'L' ? longName : longLink) = std::move(data);
+                continue;
+            }
+
+            e = TarEntry{};
+            e.type = type ? type : '0';
+            e.path = text(h, kName);
+            if (text(h, kMagic).starts_with("ustar")) {
+                if (auto prefix = text(h, kPrefix); !prefix.empty())
+                    e.path = prefix + "/" + e.path;
+            }
+            e.linkpath = text(h, kLink);
+            e.uname = text(h, kUname);
+            e.gname = text(h, kGname);
+            e.mode = static_cast<std::uint32_t>(number(h, kMode) & 07777);
+            e.uid = number(h, kUid);
+            e.gid = number(h, kGid);
+            e.size = size;
+            e.mtime = static_cast<std::int64_t>(number(h, kMtime));
+            e.devmajor = static_cast<std::uint32_t>(number(h, kDevMajor));
+            e.devminor = static_cast<std::uint32_t>(number(h, kDevMinor));
+
+            if (!longName.empty()) e.path = longName;
+            if (!longLink.empty()) e.linkpath = longLink;
+            if (auto it = pax.find("path"); it != pax.end()) e.path = it->second;
+            if (auto it = pax.find("GNU.sparse.name"); it != pax.end()) e.path = it->second;
+            if (auto it = pax.find("linkpath"); it != pax.end()) e.linkpath = it->second;
+            if (auto it = pax.find("uname"); it != pax.end()) e.uname = it->second;
+            if (auto it = pax.find("gname"); it != pax.end()) e.gname = it->second;
+            // A malformed number fails the archive rather than guess a size
+            for (auto [key, field] : {std::pair{"uid", &e.uid}, std::pair{"gid", &e.gid},
+                                      std::pair{"size", &e.size}}) {
+                if (auto it = pax.find(key); it != pax.end() && !decimal(it->second, *field)) {
+                    failed_ = true;
+                    return false;
+                }
+            }
+            if (auto it = pax.find("mtime"); it != pax.end() && !seconds(it->second, e.mtime)) {
+                failed_ = true;
+                return false;
+            }
+            for (auto& [key, value] : pax) {
+                if (key.starts_with("SCHILY.xattr."))
+                    e.xattrs.emplace_back(key.substr(13), value);
+                else if (key.starts_with("SCHILY.acl."))
+                    e.acl = true;
+                else if (key.starts_with("GNU.sparse."))
+                    e.sparse = true;
+            }
+            if (e.type == 'S') e.sparse = true;
+
+            // Links, directories and devices carry no data whatever size says
+            const bool hasData = e.type == '0' || e.type == '7' || e.type == 'S';
+            if (!hasData) e.size = 0;
+            remaining_ = hasData ? e.size : size;
+            padding_ = padTo(remaining_);
+            return true;
+        }
+    }
+
+    bool TarReader::read(const std::function<bool(const char*, size_t)>& sink) {
+        char buf[65536];
+        while (remaining_) {
+            size_t n = std::fread(buf, 1, std::min<std::uint64_t>(remaining_, sizeof buf), in_);
+            if (n == 0) { failed_ = true; return false; }
+            remaining_ -= n;
+            offset_ += n;
+            if (!sink(buf, n)) return false;
+        }
+        return true;
+    }
+
+    // ---- TarWriter -------------------------------------------------------
+
+    TarWriter::TarWriter(FILE* out) : out_(out) {}
+
+    bool TarWriter::header(const TarEntry& e, const std::string& name, const std::string& link) {
+        char h[kBlock] = {};
+        putText(h, kName, name);
+        putText(h, kLink, link);
+        putText(h, kUname, e.uname);
+        putText(h, kGname, e.gname);
+        putNumber(h, kMode, e.mode);
+        putNumber(h, kUid, e.uid);
+        putNumber(h, kGid, e.gid);
+        putNumber(h, kSize, e.size);
+        putNumber(h, kMtime, e.mtime < 0 ? 0 : static_cast<std::uint64_t>(e.mtime));
+        putNumber(h, kDevMajor, e.devmajor);
+        putNumber(h, kDevMinor, e.devminor);
+        h[kType.off] = e.type;
+        std::memcpy(h + kMagic.off, "ustar", 6);
+        std::memcpy(h + kVersion.off, "00", 2);
+
+        std::memset(h + kChksum.off, ' ', kChksum.len);
+        unsigned sum = 0;
+        for (unsigned char c : h) sum += c;
+        std::snprintf(h + kChksum.off, kChksum.len, "%06o", sum);   // "dddddd\0 "
+        h[kChksum.off + 7] = ' ';
+        return write(h, kBlock);
+    }
+
+    bool TarWriter::begin(const TarEntry& e) {
+        // Neither the sparse map nor ACL records are carried over; writing
+        // the entry without them would give a different file
+        if (e.sparse || e.acl) return false;
+
+        // Whatever ustar cannot hold goes into a pax header for this entry
+        std::string pax;
+        const bool longName = e.path.size() > kName.len;
+        const bool longLink = e.linkpath.size() > kLink.len;
+        if (longName) pax += paxRecord("path", e.path);
+        if (longLink) pax += paxRecord("linkpath", e.linkpath);
+        if (e.size >> 33) pax += paxRecord("size", std::to_string(e.size));
+        if (e.uid >> 21) pax += paxRecord("uid", std::to_string(e.uid));
+        if (e.gid >> 21) pax += paxRecord("gid", std::to_string(e.gid));
+        if (e.uname.size() > kUname.len) pax += paxRecord("uname", e.uname);
+        if (e.gname.size() > kGname.len) pax += paxRecord("gname", e.gname);
+        for (auto& [name, value] : e.xattrs) pax += paxRecord("SCHILY.xattr." + name, value);
+
+        if (!pax.empty()) {
+            TarEntry x;
+            x.type = 'x';
+            x.size = pax.size();
+            x.mtime = e.mtime;
+            if (!header(x, "PaxHeader", "") || !write(pax.data(), pax.size()) || !end())
+                return false;
+        }
+
+        TarEntry clipped = e;
+        if (e.size >> 33) clipped.size = 0;
+        if (e.uid >> 21) clipped.uid = 0;
+        if (e.gid >> 21) clipped.gid = 0;
+        return header(clipped, longName ? e.path.substr(0, kName.len) : e.path,
+                      longLink ? e.linkpath.substr(0, kLink.len) : e.linkpath);
+    }
+
+    bool TarWriter::write(const char* data, size_t n) {
+        if (n && std::fwrite(data, 1, n, out_) != n) return false;
+        written_ += n;
+        return true;
+    }
+
+    bool TarWriter::end() {
+        static const char zeros[kBlock] = {};
+        return write(zeros, padTo(written_));
+    }
+
+    bool TarWriter::add(const TarEntry& e, const std::string& data) {
+        return begin(e) && write(data.data(), data.size()) && end();
+    }
+
+    bool TarWriter::finish() {
+        static const char zeros[2 * kBlock] = {};
+        return write(zeros, sizeof zeros) && std::fflush(out_) == 0;
+    }
+
+} // namespace gradient
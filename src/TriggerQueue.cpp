@@ -0,0 +1,66 @@
+// src/TriggerQueue.cpp
+
+#include "TriggerQueue.h"
+#include "ScriptExecutor.h"
+
+#include <fnmatch.h>
+#include <algorithm>
+#include <iostream>
+#include <unordered_set>
+
+namespace gradient {
+
+    TriggerQueue::TriggerQueue(const Database& db)
+        : db_(db)
+    {}
+
+    void TriggerQueue::pathsChanged(const std::vector<std::string>& paths) {
+        if (!paths.empty()) events_.push_back({{}, paths});
+    }
+
+    void TriggerQueue::activate(const std::string& name) {
+        events_.push_back({name, {}});
+    }
+
+    void TriggerQueue::run(const std::string& rootDir) {
+        if (events_.empty()) return;
+        const auto known = db_.getAllTriggers();
+
+        // Resolve the transaction's events to trigger names, each once
+        std::vector<std::string> pending;
+        std::unordered_set<std::string> fired;
+        auto fire = [&](const std::string& name) {
+            if (fired.insert(name).second) pending.push_back(name);
+        };
+        for (auto& ev : events_) {
+            if (!ev.name.empty()) {
+                fire(ev.name);
+                continue;
+            }
+            for (auto& row : known) {
+                const auto& t = row.trigger;
+                if (fired.contains(t.name) || t.paths.empty()) continue;
+                const bool hit = std::ranges::any_of(ev.paths, [&](const std::string& path) {
+                    return std::ranges::any_of(t.paths, [&](const std::string& pat) {
+                        return fnmatch(pat.c_str(), path.c_str(), 0) == 0;
+                    });
+                });
+                if (hit) fire(t.name);
+            }
+        }
+        events_.clear();
+
+        for (auto& name : pending) {
+            const TriggerRow* row = nullptr;
+            for (auto& r : known) {
+                if (r.trigger.name == name) { row = &r; break; }
+            }
+            if (!row) continue;   // nobody installed registers it (any more)
+
+            std::cout << "\033[1;34m⚙ Running trigger \033[1m" << name << "\033[0m\n";
+            ScriptExecutor::runCommand(row->trigger.exec, rootDir,
+                                       "trigger '" + name + "' (" + row->package + ")");
+        }
+    }
+
+} // namespace gradient
@@ -27,8 +27,10 @@ bool YamlParser::parseMetadata(const std::string& path, Package::Metadata& meta)
     }
     std::ostringstream buffer;
     buffer << in.rdbuf();
-    std::string content = buffer.str();
+    return parseMetadataText(buffer.str(), meta);
+}
 
+bool YamlParser::parseMetadataText(const std::string& content, Package::Metadata& meta) {
     // 3) Parse with yaml-cpp
     YAML::Node root;
     try {
@@ -57,6 +59,22 @@ bool YamlParser::parseMetadata(const std::string& path, Package::Metadata& meta)
         readList("conflicts",    meta.conflicts);
         readList("replaces",     meta.replaces);
         readList("provides",     meta.provides);
+        readList("activates",    meta.activates);
+        readList("backup",       meta.backup);
+
+        // triggers: [{name, paths: [...], exec}]
+        if (root["triggers"] && root["triggers"].IsSequence()) {
+            for (const auto& node : root["triggers"]) {
+                Package::Trigger t;
+                t.name = node["name"].as<std::string>();
+                t.exec = node["exec"].as<std::string>();
+                if (node["paths"] && node["paths"].IsSequence()) {
+                    for (const auto& pat : node["paths"])
+                        t.paths.push_back(pat.as<std::string>());
+                }
+                meta.triggers.push_back(std::move(t));
+            }
+        }
 
         if (root["description"])
             meta.description = root["description"].as<std::string>();
@@ -0,0 +1,28 @@
+// src/gradientd.cpp
+// gradientd - serves read-only gradient queries from memory.
+
+#include <iostream>
+#include <string>
+
+#include "Daemon.h"
+#include "cxxopts.h"
+
+int main(const int argc, char* argv[]) {
+    std::string root;
+    std::string socketPath = gradient::Daemon::kDefaultSocket;
+
+    cxxopts::Options opts("gradientd", "gradient query daemon");
+    opts.add_options()
+        ("b,bootstrap", "Root prefix whose database to serve", cxxopts::value<std::string>(root))
+        ("s,socket",    "Unix socket path",                   cxxopts::value<std::string>(socketPath))
+        ("h,help",      "Print help");
+
+    auto result = opts.parse(argc, argv);
+    if (result.count("help")) {
+        std::cout << opts.help() << "\n";
+        return 0;
+    }
+
+    gradient::Daemon daemon(root, socketPath);
+    return daemon.serve();
+}